@@ -0,0 +1,322 @@
+// Markdown marker parsing: parse_formatters() - one pass over the markers
+// with a skip to the next marker byte - against the parser it replaced, four
+// find() passes (bold, underline, strikethrough, italic) and a sort.
+//
+// First a differential test: both parse random marker-heavy lines and must
+// give the same spans, the program fails otherwise. Then the time per line
+// for plain prose (no markers - the fast path), prose with some markdown and
+// lines that are mostly markers, short and long - a screen of them, in cache.
+//
+// Usage: format_bench [lines]   (default: 200000)
+
+#include <formatter.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace reference {
+
+/// @brief The four-pass parser, as it was
+std::vector<Formatter> parse_formatters(std::string_view line) {
+    std::vector<Formatter> formatters;
+
+    // Find all bold regions **...**
+    size_t pos = 0;
+    while (pos < line.length()) {
+        pos = line.find("**", pos);
+        if (pos == std::string::npos) break;
+
+        // Make sure ** is not part of *** or more stars
+        // Check if preceded by * (making it ***)
+        if (pos > 0 && line[pos - 1] == '*') {
+            pos++;
+            continue;
+        }
+        // Check if followed by * (making it ***)
+        if (pos + 2 < line.length() && line[pos + 2] == '*') {
+            pos++;
+            continue;
+        }
+
+        size_t close_pos = pos + 2;
+        while (close_pos < line.length()) {
+            close_pos = line.find("**", close_pos);
+            if (close_pos == std::string::npos) break;
+
+            // Make sure closing ** is not part of *** or more
+            bool valid_closing = true;
+            if (close_pos > 0 && line[close_pos - 1] == '*') {
+                valid_closing = false;
+            }
+            if (close_pos + 2 < line.length() && line[close_pos + 2] == '*') {
+                valid_closing = false;
+            }
+
+            if (valid_closing) {
+                formatters.emplace_back(
+                    Formatter::Type::BOLD,
+                    pos,                    // start_index
+                    close_pos + 2,         // end_index (after closing **)
+                    pos + 2,               // content_start
+                    close_pos,             // content_end
+                    "**",
+                    "**"
+                );
+                pos = close_pos + 2;
+                break;
+            } else {
+                close_pos++;
+            }
+        }
+
+        if (close_pos == std::string::npos || close_pos >= line.length()) {
+            pos += 2;
+        }
+    }
+
+    // Find all underline regions <u>...</u>
+    pos = 0;
+    while (pos < line.length()) {
+        pos = line.find("<u>", pos);
+        if (pos == std::string::npos) break;
+
+        size_t close_pos = line.find("</u>", pos + 3);
+        if (close_pos != std::string::npos) {
+            formatters.emplace_back(
+                Formatter::Type::UNDERLINE,
+                pos,                    // start_index
+                close_pos + 4,         // end_index (after closing </u>)
+                pos + 3,               // content_start
+                close_pos,             // content_end
+                "<u>",
+                "</u>"
+            );
+            pos = close_pos + 4;
+        } else {
+            pos += 3;
+        }
+    }
+
+    // Find all strikethrough regions ~~...~~
+    pos = 0;
+    while (pos < line.length()) {
+        pos = line.find("~~", pos);
+        if (pos == std::string::npos) break;
+
+        // Make sure ~~ is not part of ~~~ or more tildes
+        if (pos > 0 && line[pos - 1] == '~') {
+            pos++;
+            continue;
+        }
+        if (pos + 2 < line.length() && line[pos + 2] == '~') {
+            pos++;
+            continue;
+        }
+
+        size_t close_pos = pos + 2;
+        while (close_pos < line.length()) {
+            close_pos = line.find("~~", close_pos);
+            if (close_pos == std::string::npos) break;
+
+            // Make sure closing ~~ is not part of ~~~ or more
+            bool valid_closing = true;
+            if (close_pos > 0 && line[close_pos - 1] == '~') {
+                valid_closing = false;
+            }
+            if (close_pos + 2 < line.length() && line[close_pos + 2] == '~') {
+                valid_closing = false;
+            }
+
+            if (valid_closing) {
+                formatters.emplace_back(
+                    Formatter::Type::STRIKETHROUGH,
+                    pos,                    // start_index
+                    close_pos + 2,         // end_index (after closing ~~)
+                    pos + 2,               // content_start
+                    close_pos,             // content_end
+                    "~~",
+                    "~~"
+                );
+                pos = close_pos + 2;
+                break;
+            } else {
+                close_pos++;
+            }
+        }
+
+        if (close_pos == std::string::npos || close_pos >= line.length()) {
+            pos += 2;
+        }
+    }
+
+    // Find all italic regions *...*  (but not **)
+    pos = 0;
+    while (pos < line.length()) {
+        pos = line.find('*', pos);
+        if (pos == std::string::npos) break;
+
+        // Skip if it's part of ** or ***
+        if (pos + 1 < line.length() && line[pos + 1] == '*') {
+            pos += 2;
+            continue;
+        }
+        if (pos > 0 && line[pos - 1] == '*') {
+            pos++;
+            continue;
+        }
+
+        // Find closing *
+        size_t close_pos = pos + 1;
+        while (close_pos < line.length()) {
+            close_pos = line.find('*', close_pos);
+            if (close_pos == std::string::npos) break;
+
+            // Make sure it's not part of **
+            bool valid_closing = true;
+            if (close_pos + 1 < line.length() && line[close_pos + 1] == '*') {
+                valid_closing = false;
+            }
+            if (close_pos > 0 && line[close_pos - 1] == '*') {
+                valid_closing = false;
+            }
+
+            if (valid_closing) {
+                // Found valid closing *
+                formatters.emplace_back(
+                    Formatter::Type::ITALIC,
+                    pos,                    // start_index
+                    close_pos + 1,         // end_index (after closing *)
+                    pos + 1,               // content_start
+                    close_pos,             // content_end
+                    "*",
+                    "*"
+                );
+                pos = close_pos + 1;
+                break;
+            } else {
+                close_pos++;
+            }
+        }
+
+        // No valid closing - the search may also have stopped at the end of
+        // the line ("*a**"), which is no match either
+        if (close_pos == std::string::npos || close_pos >= line.length()) {
+            pos++;
+        }
+    }
+
+    // Sort formatters by start position
+    std::sort(formatters.begin(), formatters.end(),
+        [](const Formatter& a, const Formatter& b) {
+            return a.start_index < b.start_index;
+        });
+
+    return formatters;
+}
+
+} // namespace reference
+
+namespace {
+
+bool same(const std::vector<Formatter>& a, const std::vector<Formatter>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].type != b[i].type || a[i].start_index != b[i].start_index || a[i].end_index != b[i].end_index ||
+            a[i].content_start != b[i].content_start || a[i].content_end != b[i].content_end ||
+            a[i].start_symbol != b[i].start_symbol || a[i].end_symbol != b[i].end_symbol) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Lines of random pieces, mostly markers and near misses of them
+bool differential_test(size_t lines) {
+    static const char* const pieces[] = {
+        "*", "**", "***", "~", "~~", "~~~", "<u>", "</u>", "<", "u>", "</", "<u", "a", "bc", " ", "é",
+    };
+    std::mt19937_64 rng(7);
+    for (size_t i = 0; i < lines; i++) {
+        std::string line;
+        const size_t count = rng() % 48;   // Up to about 100 bytes, past a SIMD step
+        for (size_t k = 0; k < count; k++) line += pieces[rng() % std::size(pieces)];
+        if (!same(parse_formatters(line), reference::parse_formatters(line))) {
+            std::printf("Different spans for \"%s\"\n", line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Prose of `length` bytes, `marked` of its words formatted
+std::vector<std::string> make_lines(size_t lines, size_t length, double marked, std::mt19937_64& rng) {
+    static const char* const markers[][2] = {{"**", "**"}, {"*", "*"}, {"~~", "~~"}, {"<u>", "</u>"}};
+    std::vector<std::string> result;
+    for (size_t y = 0; y < lines; y++) {
+        std::string line;
+        while (line.size() < length) {
+            std::string word(1 + rng() % 8, static_cast<char>('a' + rng() % 26));
+            if (std::uniform_real_distribution<double>(0, 1)(rng) < marked) {
+                const auto& marker = markers[rng() % std::size(markers)];
+                word = marker[0] + word + marker[1];
+            }
+            line += word + " ";
+        }
+        line.resize(length);
+        result.push_back(std::move(line));
+    }
+    return result;
+}
+
+/// @brief Parse `lines` over and over, `total` lines in all
+template <class Parse>
+double ns_per_line(const std::vector<std::string>& lines, size_t total, Parse&& parse) {
+    size_t spans = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < total; done += lines.size()) {
+        for (const std::string& line : lines) spans += parse(line).size();
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    // Keeps the calls from being optimized away
+    if (spans == static_cast<size_t>(-1)) std::printf("!");
+    return ns / static_cast<double>((total + lines.size() - 1) / lines.size() * lines.size());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t lines = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+    if (!differential_test(lines)) return 1;
+    std::printf("Same spans as the four-pass parser for %zu random lines\n", lines);
+
+    struct Case {
+        const char* name;
+        size_t length;
+        double marked;
+    };
+    const Case cases[] = {
+        {"80 columns, plain", 80, 0.0},
+        {"80 columns, 10% marked", 80, 0.1},
+        {"80 columns, all marked", 80, 1.0},
+        {"4 KB, plain", 4096, 0.0},
+        {"4 KB, 10% marked", 4096, 0.1},
+    };
+    std::mt19937_64 rng(42);
+    std::printf("  %-24s %14s %14s\n", "", "four passes", "one pass");
+    for (const Case& test : cases) {
+        // A screen of lines, parsed again and again like the renderer does -
+        // fewer of the long lines, the same bytes in all
+        const std::vector<std::string> text = make_lines(std::max<size_t>(80 * 80 / test.length, 1), test.length,
+                                                         test.marked, rng);
+        const size_t total = std::max<size_t>(lines * 80 / test.length, 1);
+        const double before = ns_per_line(text, total, reference::parse_formatters);
+        const double after = ns_per_line(text, total, parse_formatters);
+        std::printf("  %-24s %11.1f ns %11.1f ns   %.1fx\n", test.name, before, after, before / after);
+    }
+    return 0;
+}
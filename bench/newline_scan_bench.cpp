@@ -0,0 +1,119 @@
+// Line splitting microbenchmark: the old std::getline loop of the file loader
+// against a memchr() per line and the vectorized NewlineScanner.
+//
+// Usage: newline_scan_bench [size in MB ...]   (default: 100 1024)
+
+#include <newline_scanner.hpp>
+#include <line_table.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// @brief Log-like text: lines of 0-160 bytes, some with "\r\n" endings
+std::string make_text(size_t size) {
+    std::mt19937_64 rng(42);
+    std::string text;
+    text.reserve(size + 256);
+    while (text.size() < size) {
+        const size_t length = rng() % 161;
+        for (size_t i = 0; i < length; i++) {
+            text.push_back(static_cast<char>(' ' + rng() % 95));
+        }
+        if (rng() % 8 == 0) text.push_back('\r');
+        text.push_back('\n');
+    }
+    return text;
+}
+
+/// @brief Run `split` (returns a line count) and print throughput
+template <class Split>
+size_t measure(const char* name, const std::string& text, Split&& split) {
+    const int runs = text.size() > (256u << 20) ? 1 : 3;
+    double best = 1e30;
+    size_t lines = 0;
+    for (int run = 0; run < runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        lines = split();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+    }
+    std::printf("  %-28s %9.1f ms %9.0f MB/s  %zu lines\n", name, best * 1000, text.size() / best / (1 << 20), lines);
+    return lines;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes_mb;
+    for (int i = 1; i < argc; i++) sizes_mb.push_back(std::strtoull(argv[i], nullptr, 10));
+    if (sizes_mb.empty()) sizes_mb = {100, 1024};
+
+    const NewlineScanner::Isa default_isa = NewlineScanner::active_isa();
+    std::printf("Default implementation: %s\n", NewlineScanner::isa_name(default_isa));
+
+    bool consistent = true;
+    for (size_t size_mb : sizes_mb) {
+        const std::string text = make_text(size_mb << 20);
+        std::printf("\n%zu MB\n", size_mb);
+
+        // What FileManager::load_file used to do
+        const size_t expected = measure("std::getline", text, [&] {
+            std::istringstream stream(text);
+            std::vector<std::string> lines;
+            std::string line;
+            while (std::getline(stream, line)) lines.push_back(line);
+            return lines.size();
+        });
+
+        auto check = [&](size_t lines) { consistent = consistent && lines == expected; };
+
+        check(measure("memchr per line", text, [&] {
+            std::vector<std::string_view> lines;
+            lines.reserve(expected);
+            const std::string_view view(text);
+            size_t start = 0;
+            while (start < view.size()) {
+                size_t newline = view.find('\n', start);
+                if (newline == std::string_view::npos) newline = view.size();
+                lines.push_back(view.substr(start, newline - start));
+                start = newline + 1;
+            }
+            return lines.size();
+        }));
+
+        for (NewlineScanner::Isa isa : {NewlineScanner::Isa::SCALAR, NewlineScanner::Isa::SSE2, NewlineScanner::Isa::AVX2}) {
+            if (!NewlineScanner::set_isa(isa)) continue;
+            const std::string scan_name = std::string("scan only, ") + NewlineScanner::isa_name(isa);
+            check(measure(scan_name.c_str(), text, [&] {
+                return NewlineScanner::count_newlines(text);
+            }));
+            const std::string split_name = std::string("split_lines, ") + NewlineScanner::isa_name(isa);
+            check(measure(split_name.c_str(), text, [&] {
+                std::vector<std::string_view> lines;
+                lines.reserve(expected);
+                NewlineScanner::split_lines(text, static_cast<size_t>(-1), [&](std::string_view line) { lines.push_back(line); });
+                return lines.size();
+            }));
+        }
+        NewlineScanner::set_isa(default_isa);
+
+        // The full line index as built on load, metadata included
+        check(measure("LineTable::push_lines", text, [&] {
+            LineTable table;
+            table.push_lines(text, static_cast<size_t>(-1));
+            return table.size();
+        }));
+    }
+
+    if (!consistent) {
+        std::printf("\nERROR: line counts differ between implementations\n");
+        return 1;
+    }
+    return 0;
+}
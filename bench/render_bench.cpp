@@ -0,0 +1,129 @@
+// Text area rendering: building the Element tree of a full 300x80 screen of
+// 200-column lines, and laying it out and drawing it to an ftxui::Screen.
+// The old renderer - one text element per character - against the runs of
+// UIRenderer::render_lines(), in BASIC mode and in FANCY mode with markdown,
+// with all lines built every frame and with the lines the cursor didn't touch
+// taken from the line cache.
+//
+// Usage: render_bench [frames]   (default: 200)
+
+#include <ui_renderer.hpp>
+#include <text_buffer.hpp>
+#include <format_span_index.hpp>
+#include <ftxui/dom/elements.hpp>
+#include <ftxui/dom/node.hpp>
+#include <ftxui/screen/screen.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+using namespace ftxui;
+
+namespace {
+
+constexpr int SCREEN_WIDTH = 300;
+constexpr int SCREEN_HEIGHT = 80;
+constexpr size_t LINE_LENGTH = 200;
+
+/// @brief Prose-like lines of LINE_LENGTH bytes, with markdown markers in some
+std::string make_text(size_t lines, bool markdown) {
+    std::mt19937_64 rng(42);
+    std::string text;
+    for (size_t y = 0; y < lines; y++) {
+        std::string line;
+        while (line.size() < LINE_LENGTH) {
+            std::string word(1 + rng() % 8, static_cast<char>('a' + rng() % 26));
+            if (markdown && rng() % 12 == 0) word = "**" + word + "**";
+            else if (markdown && rng() % 12 == 0) word = "*" + word + "*";
+            line += word + " ";
+        }
+        line.resize(LINE_LENGTH);
+        text += line + "\n";
+    }
+    return text;
+}
+
+/// @brief The renderer as it was: a text element per character, an hbox of them per line (BASIC mode)
+Elements render_lines_per_char(const TextBuffer& buffer, int cursor_x, int cursor_y, int visible_lines) {
+    Elements lines_display;
+    auto line_it = buffer.iterator_at(0);
+    for (int y = 0; y < visible_lines && y < (int)buffer.line_count(); y++, ++line_it) {
+        const std::string line(*line_it);
+        Elements line_elements;
+        line_elements.reserve(line.size() + 1);
+        for (size_t x = 0; x <= line.size(); x++) {
+            if (x == line.size() && y != cursor_y) break;
+            auto elem = text(x < line.size() ? line.substr(x, 1) : " ");
+            if (y == cursor_y && (int)x == cursor_x) elem = elem | inverted | bold;
+            line_elements.push_back(elem);
+        }
+        lines_display.push_back(hbox({
+            text(std::to_string(y + 1)) | color(Color::GrayDark),
+            text(" │ ") | color(Color::GrayDark),
+            hbox(std::move(line_elements))
+        }));
+    }
+    return lines_display;
+}
+
+/// @brief Time building the lines with `build`, then layout and drawing, per frame
+template <class Build>
+void measure(const char* name, int frames, Build&& build) {
+    auto screen = Screen::Create(Dimension::Fixed(SCREEN_WIDTH), Dimension::Fixed(SCREEN_HEIGHT));
+    double build_ms = 0, layout_ms = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        Element document = vbox(build(frame));
+        auto built = std::chrono::steady_clock::now();
+        Render(screen, document);
+        auto drawn = std::chrono::steady_clock::now();
+        build_ms += std::chrono::duration<double, std::milli>(built - start).count();
+        layout_ms += std::chrono::duration<double, std::milli>(drawn - built).count();
+    }
+    std::printf("  %-24s build %7.3f ms   layout + draw %7.3f ms   per frame\n", name, build_ms / frames,
+                layout_ms / frames);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+    const SelectionRange no_selection;
+    // Over half the screen, which cuts its lines into more runs
+    const SelectionRange selection{true, 20, 0, 120, SCREEN_HEIGHT / 2};
+    UIRenderer renderer;
+    FormatSpanIndex format_spans;
+
+    TextBuffer plain;
+    plain.load(make_text(SCREEN_HEIGHT, false));
+    TextBuffer markdown;
+    markdown.load(make_text(SCREEN_HEIGHT, true));
+    std::printf("%dx%d screen, %zu-column lines, %d frames (the cursor moves every frame)\n", SCREEN_WIDTH,
+                SCREEN_HEIGHT, LINE_LENGTH, frames);
+
+    measure("per character (before)", frames, [&](int frame) {
+        return render_lines_per_char(plain, frame % LINE_LENGTH, frame % SCREEN_HEIGHT, SCREEN_HEIGHT);
+    });
+    for (bool cached : {false, true}) {
+        std::printf("%s\n", cached ? "line cache, the cursor moves:" : "all lines built:");
+        auto lines = [&](const TextBuffer& buffer, int frame, const SelectionRange& range, EditorMode mode) {
+            if (!cached) renderer.clear_line_cache();
+            return renderer.render_lines(buffer, frame % LINE_LENGTH, frame % SCREEN_HEIGHT, 0, SCREEN_HEIGHT, range,
+                                         format_spans, mode);
+        };
+        measure("runs, BASIC", frames, [&](int frame) {
+            return lines(plain, frame, no_selection, EditorMode::BASIC);
+        });
+        measure("runs, FANCY (markdown)", frames, [&](int frame) {
+            return lines(markdown, frame, no_selection, EditorMode::FANCY);
+        });
+        measure("runs, BASIC, selection", frames, [&](int frame) {
+            return lines(plain, frame, selection, EditorMode::BASIC);
+        });
+    }
+    const UIRenderer::LineCacheStats& stats = renderer.line_cache_stats();
+    std::printf("line cache: %zu lines reused, %zu built\n", stats.hits, stats.misses);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Save microbenchmark: the old line-by-line std::ofstream save against the
+// batched writev() save of FileManager, without and with fsync.
+//
+// Usage: save_bench [size in MB] [directory]   (default: 1024 .)
+
+#include <file_manager.hpp>
+#include <text_buffer.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace {
+
+/// @brief Log-like text: lines of 0-160 bytes
+std::string make_text(size_t size) {
+    std::mt19937_64 rng(42);
+    std::string text;
+    text.reserve(size + 256);
+    while (text.size() < size) {
+        const size_t length = rng() % 161;
+        for (size_t i = 0; i < length; i++) {
+            text.push_back(static_cast<char>(' ' + rng() % 95));
+        }
+        text.push_back('\n');
+    }
+    return text;
+}
+
+/// @brief Run `save` once and print throughput
+template <class Save>
+bool measure(const char* name, size_t bytes, Save&& save) {
+    auto start = std::chrono::steady_clock::now();
+    const bool saved = save();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("  %-28s %9.1f ms %9.0f MB/s%s\n", name, seconds * 1000, bytes / seconds / (1 << 20), saved ? "" : "  FAILED");
+    return saved;
+}
+
+bool same_file(const std::string& a, const std::string& b) {
+    std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+    std::string la, lb;
+    while (true) {
+        bool more_a = static_cast<bool>(std::getline(fa, la));
+        bool more_b = static_cast<bool>(std::getline(fb, lb));
+        if (more_a != more_b || la != lb) return false;
+        if (!more_a) return true;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t size_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+    const std::string dir = argc > 2 ? argv[2] : ".";
+    const std::string old_path = dir + "/save_bench_old.txt";
+    const std::string new_path = dir + "/save_bench_new.txt";
+
+    TextBuffer buffer;
+    buffer.load(make_text(size_mb << 20));
+
+    // Scattered edits, so the save mixes long original runs with short pieces
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 10000; i++) {
+        const size_t y = rng() % buffer.line_count();
+        buffer.set_line(y, "edited line " + std::to_string(i));
+    }
+    std::printf("%zu MB, %zu lines\n", size_mb, buffer.line_count());
+
+    bool ok = measure("ofstream, line by line", size_mb << 20, [&] {
+        std::ofstream ofs(old_path);
+        for (size_t y = 0; y < buffer.line_count(); y++) {
+            ofs << buffer.line(y) << '\n';
+        }
+        ofs.close();
+        return ofs.good();
+    });
+
+    FileManager file_manager;
+    file_manager.set_save_durability(SaveDurability::FAST);
+    ok &= measure("writev, fast", size_mb << 20, [&] { return file_manager.save_file(new_path, buffer).success; });
+    file_manager.set_save_durability(SaveDurability::DURABLE);
+    ok &= measure("writev, durable (fsync)", size_mb << 20, [&] { return file_manager.save_file(new_path, buffer).success; });
+
+    const bool same = same_file(old_path, new_path);
+    if (!same) std::printf("Saved files differ!\n");
+    std::remove(old_path.c_str());
+    std::remove(new_path.c_str());
+    return ok && same ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// Undo of a compressed history entry: a large paste is deleted again, a few
+// small edits make both entries cold and they are compressed in the
+// background. Undoing the delete decompresses the whole text back into the
+// buffer, so does redoing the paste - once, applying them again takes the
+// same lines.
+//
+// Usage: undo_compress_bench [size in MB]   (default: 100)
+
+#include <undo_redo_manager.hpp>
+#include <text_buffer.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace {
+
+/// @brief Code-like text: indented lines of words from a small vocabulary and numbers
+std::string make_text(size_t size) {
+    static const char* const words[] = {
+        "const", "size_t", "return", "buffer", "line", "if", "for", "auto", "std::string", "index",
+        "text", "count", "=", "+", "(", ")", "{", "}", ";", "node", "cursor", "first", "&&", "->",
+    };
+    std::mt19937_64 rng(42);
+    std::string text;
+    text.reserve(size + 256);
+    while (text.size() < size) {
+        text.append(4 * (rng() % 4), ' ');
+        const size_t length = rng() % 12;
+        for (size_t i = 0; i < length; i++) {
+            if (rng() % 5 == 0) {
+                text += std::to_string(rng() % 10000);
+            } else {
+                text += words[rng() % std::size(words)];
+            }
+            text.push_back(' ');
+        }
+        text.push_back('\n');
+    }
+    return text;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t size_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100;
+    const std::string text = make_text(size_mb << 20);
+
+    TextBuffer buffer;
+    buffer.load("first line\nlast line\n");
+    UndoRedoManager history;
+    history.set_memory_budget(size_t(16) << 30);   // Nothing is spilled
+    int cursor_x = 0, cursor_y = 0;
+
+    history.save_state(buffer, cursor_x, cursor_y);
+    buffer.append_lines(text);
+    const size_t pasted_lines = buffer.line_count() - 2;
+    history.save_state(buffer, cursor_x, cursor_y);
+    buffer.erase_lines(2, pasted_lines);
+    // Small edits after it until it is cold
+    const int small_edits = 20;
+    for (int i = 0; i < small_edits; i++) {
+        history.save_state(buffer, cursor_x, cursor_y);
+        buffer.set_line(0, "edit " + std::to_string(i));
+    }
+    history.save_state(buffer, cursor_x, cursor_y);
+
+    auto start = std::chrono::steady_clock::now();
+    while (history.compression_stats().entries < 2) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        history.poll_compression(buffer);
+        if (ms_since(start) > 60000) {
+            std::printf("Not compressed after a minute\n");
+            return 1;
+        }
+    }
+    const double compress_ms = ms_since(start);
+    const UndoRedoManager::CompressionStats& stats = history.compression_stats();
+    // Down to where the text they let go of is worth compacting, which the next save does
+    history.set_memory_budget(stats.raw_bytes);
+    history.save_state(buffer, cursor_x, cursor_y);
+    std::printf("%zu MB pasted, %zu lines\n", size_mb, pasted_lines);
+    std::printf("  compressed in the background %9.1f ms   %zu -> %zu KB (%.2fx)\n", compress_ms,
+                stats.raw_bytes / 1024, stats.compressed_bytes / 1024,
+                static_cast<double>(stats.raw_bytes) / static_cast<double>(stats.compressed_bytes));
+    // Both entries held the same text, it is freed once
+    std::printf("  compaction freed %zu KB, %lld KB saved\n", stats.freed_bytes / 1024,
+                (static_cast<long long>(stats.freed_bytes) - static_cast<long long>(stats.compressed_bytes)) / 1024);
+
+    bool ok = true;
+    for (int i = 0; i < small_edits; i++) ok = history.undo(buffer, cursor_x, cursor_y) && ok;
+    auto document = [&buffer] {
+        std::string contents;
+        buffer.write_to([&contents](std::string_view block) {
+            contents.append(block);
+            return true;
+        });
+        return contents;
+    };
+    const std::string expected = "first line\nlast line\n" + text;
+
+    start = std::chrono::steady_clock::now();
+    ok = history.undo(buffer, cursor_x, cursor_y) && ok;
+    std::printf("  undo of the delete            %9.1f ms   (in the manager %.1f ms)\n", ms_since(start),
+                stats.last_decompress.count() / 1000.0);
+    ok = ok && document() == expected;
+
+    ok = history.undo(buffer, cursor_x, cursor_y) && ok;
+    start = std::chrono::steady_clock::now();
+    ok = history.redo(buffer, cursor_x, cursor_y) && ok;
+    std::printf("  redo of the paste             %9.1f ms   (in the manager %.1f ms)\n", ms_since(start),
+                stats.last_decompress.count() / 1000.0);
+    ok = ok && document() == expected;
+
+    // Its text is in the add buffer now, applying it again decompresses nothing
+    const size_t decompressions = stats.decompressions;
+    start = std::chrono::steady_clock::now();
+    ok = history.undo(buffer, cursor_x, cursor_y) && ok;
+    ok = history.redo(buffer, cursor_x, cursor_y) && ok;
+    std::printf("  undo and redo it again        %9.1f ms   (%zu decompressed)\n", ms_since(start),
+                stats.decompressions - decompressions);
+    ok = ok && document() == expected;
+
+    if (!ok) std::printf("Undo/redo gave the wrong text!\n");
+    return ok ? 0 : 1;
+}
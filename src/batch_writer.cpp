@@ -0,0 +1,60 @@
+#include <batch_writer.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+BatchWriter::BatchWriter(int fd) : fd_(fd), staging_(std::make_unique_for_overwrite<char[]>(STAGING_SIZE)) {
+    iovecs_.reserve(MAX_IOVECS);
+}
+
+bool BatchWriter::add(std::string_view text) {
+    if (text.empty()) return true;
+
+    if (text.size() >= MIN_DIRECT_SIZE) {
+        if (iovecs_.size() == MAX_IOVECS && !flush()) return false;
+        iovecs_.push_back({const_cast<char*>(text.data()), text.size()});
+        return true;
+    }
+
+    if (staged_ + text.size() > STAGING_SIZE || iovecs_.size() == MAX_IOVECS) {
+        if (!flush()) return false;
+    }
+    char* dest = staging_.get() + staged_;
+    std::memcpy(dest, text.data(), text.size());
+    staged_ += text.size();
+
+    // Consecutive staged pieces share one iovec
+    if (!iovecs_.empty() && static_cast<char*>(iovecs_.back().iov_base) + iovecs_.back().iov_len == dest) {
+        iovecs_.back().iov_len += text.size();
+    } else {
+        iovecs_.push_back({dest, text.size()});
+    }
+    return true;
+}
+
+bool BatchWriter::flush() {
+    size_t index = 0;
+    while (index < iovecs_.size()) {
+        const int count = static_cast<int>(std::min(iovecs_.size() - index, MAX_IOVECS));
+        ssize_t written = writev(fd_, &iovecs_[index], count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes_written_ += static_cast<size_t>(written);
+
+        // Short write - skip what went out and resume in the middle of an iovec
+        size_t left = static_cast<size_t>(written);
+        while (index < iovecs_.size() && left >= iovecs_[index].iov_len) {
+            left -= iovecs_[index].iov_len;
+            index++;
+        }
+        if (left > 0) {
+            iovecs_[index].iov_base = static_cast<char*>(iovecs_[index].iov_base) + left;
+            iovecs_[index].iov_len -= left;
+        }
+    }
+    iovecs_.clear();
+    staged_ = 0;
+    return true;
+}
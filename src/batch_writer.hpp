@@ -0,0 +1,37 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <sys/uio.h>
+
+/// @brief Writes many pieces of text to a file descriptor with few writev() calls
+///
+/// Long pieces are referenced where they are, short ones (single lines, the
+/// '\n' after a run) are copied into a staging block first, so a batch is a
+/// handful of large iovecs instead of one per line. Referenced text must stay
+/// valid until the next flush().
+class BatchWriter {
+public:
+    explicit BatchWriter(int fd);
+
+    /// @brief Queue text, writing out the batch once it is full
+    /// @return False (errno set) if a write failed
+    bool add(std::string_view text);
+    /// @brief Write out everything queued
+    bool flush();
+
+    /// @brief Bytes handed to the kernel so far
+    size_t bytes_written() const { return bytes_written_; }
+
+private:
+    static constexpr size_t MAX_IOVECS = 1024;            // IOV_MAX on Linux
+    static constexpr size_t STAGING_SIZE = 256 * 1024;
+    static constexpr size_t MIN_DIRECT_SIZE = 4 * 1024;   // Shorter pieces are staged
+
+    int fd_;
+    std::vector<iovec> iovecs_;
+    std::unique_ptr<char[]> staging_;
+    size_t staged_ = 0;
+    size_t bytes_written_ = 0;
+};
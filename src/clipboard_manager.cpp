@@ -1,6 +1,7 @@
 #include <clipboard_manager.hpp>
 #include <cstdio>
 #include <array>
+#include <vector>
 #include <cstdlib>
 #include <unistd.h>
 
@@ -106,7 +107,7 @@ bool ClipboardManager::copy_to_system(const std::string& text) {
 }
 
 int ClipboardManager::paste_from_system(
-    std::vector<std::string>& buffer,
+    TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y
 ) {
@@ -137,35 +138,24 @@ int ClipboardManager::paste_from_system(
 
 int ClipboardManager::insert_multiline_text(
     const std::string& text,
-    std::vector<std::string>& buffer,
+    TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y
 ) {
+    // Split the pasted text into lines
+    std::vector<std::string> lines;
     size_t pos = 0;
-    bool is_first_line = true;
     int total_chars = 0;
 
     while (true) {
         size_t newline_pos = text.find('\n', pos);
         bool has_more_lines = (newline_pos != std::string::npos);
 
-        std::string line_text = has_more_lines
+        lines.push_back(has_more_lines
             ? text.substr(pos, newline_pos - pos)
-            : text.substr(pos);
+            : text.substr(pos));
 
-        if (is_first_line) {
-            buffer[cursor_y].insert(cursor_x, line_text);
-            cursor_x += line_text.length();
-            is_first_line = false;
-        } else {
-            std::string remainder = buffer[cursor_y].substr(cursor_x);
-            buffer[cursor_y].resize(cursor_x);
-            cursor_y++;
-            buffer.insert(buffer.begin() + cursor_y, line_text + remainder);
-            cursor_x = line_text.length();
-        }
-
-        total_chars += line_text.length();
+        total_chars += lines.back().length();
         if (has_more_lines) {
             total_chars++; // Count the newline
             pos = newline_pos + 1;
@@ -174,5 +164,28 @@ int ClipboardManager::insert_multiline_text(
         }
     }
 
+    if (lines.size() == 1) {
+        buffer.insert_text(cursor_y, cursor_x, lines.front());
+        cursor_x += lines.front().length();
+        return total_chars;
+    }
+
+    // Multi-line: the first pasted line joins the head of the cursor line, the
+    // last one takes over its tail, everything in between is inserted in one go.
+    std::string_view current = buffer.line(cursor_y);
+    std::string head(current.substr(0, cursor_x));
+    std::string remainder(current.substr(cursor_x));
+
+    int last_length = lines.back().length();
+    head += lines.front();
+    lines.back() += remainder;
+
+    buffer.set_line(cursor_y, head);
+    lines.erase(lines.begin());
+    buffer.insert_lines(cursor_y + 1, lines);
+
+    cursor_y += lines.size();
+    cursor_x = last_length;
+
     return total_chars;
 }
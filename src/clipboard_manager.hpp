@@ -1,6 +1,6 @@
 #pragma once
 #include <string>
-#include <vector>
+#include <text_buffer.hpp>
 
 /// @brief Manages system clipboard operations (cross-platform: X11, Wayland, macOS)
 class ClipboardManager {
@@ -18,16 +18,19 @@ public:
     /// @param cursor_y Cursor Y position (modified by reference)
     /// @return Number of characters pasted, or -1 on error
     int paste_from_system(
-        std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y
     );
 
+    /// @brief Insert text with '\n' line breaks at the cursor, as one edit of the buffer
+    /// @return Number of characters inserted
+    int insert_multiline_text(const std::string& text, TextBuffer& buffer,
+                              int& cursor_x, int& cursor_y);
+
 private:
     // Helper methods
     std::string detect_clipboard_tool() const;
     bool run_clipboard_command(const std::string& cmd, const std::string& input, 
                                std::string& output, std::string& error);
-    int insert_multiline_text(const std::string& text, std::vector<std::string>& buffer,
-                              int& cursor_x, int& cursor_y);
 };
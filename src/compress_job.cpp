@@ -0,0 +1,26 @@
+#include <compress_job.hpp>
+#include <lz_codec.hpp>
+
+CompressJob::CompressJob(std::vector<std::string> inputs, std::function<void()> listener)
+    : inputs_(std::move(inputs)), listener_(std::move(listener)) {
+    worker_ = std::thread(&CompressJob::run, this);
+}
+
+CompressJob::~CompressJob() {
+    cancelled_.store(true, std::memory_order_relaxed);
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void CompressJob::run() {
+    results_.resize(inputs_.size());
+    for (size_t i = 0; i < inputs_.size(); i++) {
+        if (!LzCodec::compress(inputs_[i], results_[i], &cancelled_)) break;
+        // The input isn't needed any more, let it go before the next one grows
+        std::string().swap(inputs_[i]);
+    }
+
+    done_.store(true, std::memory_order_release);
+    if (listener_) listener_();
+}
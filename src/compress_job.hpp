@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+
+/// @brief Compresses texts with LzCodec on a worker thread
+///
+/// The job owns its input, the owner may change or free whatever it was
+/// copied from meanwhile. A listener is called from the worker once it is done.
+class CompressJob {
+public:
+    /// @brief Start compressing `inputs`
+    /// @param listener Called on the worker thread once done()
+    CompressJob(std::vector<std::string> inputs, std::function<void()> listener);
+    /// @brief Cancels the job and waits for the worker
+    ~CompressJob();
+
+    CompressJob(const CompressJob&) = delete;
+    CompressJob& operator=(const CompressJob&) = delete;
+
+    bool done() const { return done_.load(std::memory_order_acquire); }
+    /// @brief The compressed form of each input, in order - valid once done()
+    std::vector<std::string>& results() { return results_; }
+
+private:
+    void run();
+
+    std::vector<std::string> inputs_;
+    std::vector<std::string> results_;     // Written by the worker before done_ is set
+    std::function<void()> listener_;
+    std::atomic<bool> cancelled_{false};
+    std::atomic<bool> done_{false};
+    std::thread worker_;                   // Last, starts after everything above exists
+};
@@ -1,5 +1,6 @@
 #include <config_manager.hpp>
 #include <toml.hpp>
+#include <cstdint>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -31,6 +32,8 @@ fs::path ConfigManager::get_config_path() const {
 
 void ConfigManager::set_defaults() {
     dark_mode = true;
+    durability = SaveDurability::DURABLE;
+    undo_memory_mb = 64;
 }
 
 ConfigStatus ConfigManager::load() {
@@ -53,6 +56,29 @@ ConfigStatus ConfigManager::load() {
             return ConfigStatus::PARSE_ERROR;
         }
 
+        // Optional, older configs don't have it
+        if (auto mode = config["save"]["durability"].value<std::string>()) {
+            if (*mode == "fast") {
+                durability = SaveDurability::FAST;
+            } else if (*mode == "durable") {
+                durability = SaveDurability::DURABLE;
+            } else {
+                last_error_ = "Save durability must be \"fast\" or \"durable\"";
+                set_defaults();
+                return ConfigStatus::PARSE_ERROR;
+            }
+        }
+
+        // Optional as well
+        if (auto memory_mb = config["undo"]["memory_mb"].value<int64_t>()) {
+            if (*memory_mb < 1) {
+                last_error_ = "Undo memory_mb must be at least 1";
+                set_defaults();
+                return ConfigStatus::PARSE_ERROR;
+            }
+            undo_memory_mb = static_cast<size_t>(*memory_mb);
+        }
+
         last_error_.clear();
         return ConfigStatus::SUCCESS;
 
@@ -82,6 +108,12 @@ ConfigStatus ConfigManager::save() {
         config.insert("theme", toml::table{
             {"dark_mode", dark_mode}
         });
+        config.insert("save", toml::table{
+            {"durability", durability == SaveDurability::FAST ? "fast" : "durable"}
+        });
+        config.insert("undo", toml::table{
+            {"memory_mb", static_cast<int64_t>(undo_memory_mb)}
+        });
 
         std::ofstream file(config_path_);
         if (!file) {
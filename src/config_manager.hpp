@@ -1,5 +1,6 @@
 #pragma once
 #include <filesystem>
+#include <cstddef>
 #include <shared_types.hpp>
 
 class ConfigManager {
@@ -14,11 +15,19 @@ public:
     bool is_dark_mode() const { return dark_mode; }
     void set_dark_mode(bool dark) { dark_mode = dark; }
 
+    SaveDurability save_durability() const { return durability; }
+    void set_save_durability(SaveDurability mode) { durability = mode; }
+
+    /// @brief Memory the undo history may use before it spills to disk
+    size_t undo_memory_bytes() const { return undo_memory_mb * 1024 * 1024; }
+
 private:
     std::filesystem::path get_config_path() const;
     void set_defaults();
 
     bool dark_mode = true;
+    SaveDurability durability = SaveDurability::DURABLE;
+    size_t undo_memory_mb = 64;
     std::filesystem::path config_path_;
     std::string last_error_;
 };
@@ -5,7 +5,7 @@
 
 CursorManager::CursorManager() {}
 
-void CursorManager::skip_formatting_markers(const std::string& line, int& cursor_x, int direction) {
+void CursorManager::skip_formatting_markers(std::string_view line, int& cursor_x, int direction) {
     if (cursor_x < 0 || cursor_x > (int)line.length()) return;
     
     // Check for markdown markers and skip over them
@@ -65,7 +65,7 @@ void CursorManager::skip_formatting_markers(const std::string& line, int& cursor
 }
 
 void CursorManager::move_left(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y,
     std::function<void()> update_selection_fn,
@@ -74,14 +74,14 @@ void CursorManager::move_left(
 ) {
     // Move cursor first - move by UTF-8 character, not byte
     if (cursor_x > 0) {
-        cursor_x = UTF8Utils::prev_char_boundary(buffer[cursor_y], cursor_x);
+        cursor_x = UTF8Utils::prev_char_boundary(buffer.line(cursor_y), cursor_x);
         // Only skip formatting markers when not selecting (allow selecting markers)
         if (!select) {
-            skip_formatting_markers(buffer[cursor_y], cursor_x, -1);
+            skip_formatting_markers(buffer.line(cursor_y), cursor_x, -1);
         }
     } else if (cursor_y > 0) {
         cursor_y--;
-        cursor_x = buffer[cursor_y].length();  // .length() returns size_t (unsigned)
+        cursor_x = buffer.line_length(cursor_y);  // line_length() returns size_t (unsigned)
     }
     
     // Update selection state (Editor already handles start_selection)
@@ -93,7 +93,7 @@ void CursorManager::move_left(
 }
 
 void CursorManager::move_right(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y,
     std::function<void()> update_selection_fn,
@@ -101,13 +101,13 @@ void CursorManager::move_right(
     bool select
 ) {
     // Move cursor first - move by UTF-8 character, not byte
-    if (cursor_x < (int)buffer[cursor_y].length()) {  // Cast size_t to int for comparison
-        cursor_x = UTF8Utils::next_char_boundary(buffer[cursor_y], cursor_x);
+    if (cursor_x < (int)buffer.line_length(cursor_y)) {  // Cast size_t to int for comparison
+        cursor_x = UTF8Utils::next_char_boundary(buffer.line(cursor_y), cursor_x);
         // Only skip formatting markers when not selecting (allow selecting markers)
         if (!select) {
-            skip_formatting_markers(buffer[cursor_y], cursor_x, 1);
+            skip_formatting_markers(buffer.line(cursor_y), cursor_x, 1);
         }
-    } else if (cursor_y < (int)buffer.size() - 1) {
+    } else if (cursor_y < (int)buffer.line_count() - 1) {
         cursor_y++;
         cursor_x = 0;
     }
@@ -121,7 +121,7 @@ void CursorManager::move_right(
 }
 
 void CursorManager::move_up(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y,
     std::function<void()> update_selection_fn,
@@ -131,7 +131,7 @@ void CursorManager::move_up(
     // Move cursor first
     if (cursor_y > 0) {
         cursor_y--;
-        cursor_x = std::min(cursor_x, (int)buffer[cursor_y].length());
+        cursor_x = std::min(cursor_x, (int)buffer.line_length(cursor_y));
     }
     
     // Update selection state (Editor already handles start_selection)
@@ -143,7 +143,7 @@ void CursorManager::move_up(
 }
 
 void CursorManager::move_down(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y,
     std::function<void()> update_selection_fn,
@@ -151,9 +151,9 @@ void CursorManager::move_down(
     bool select
 ) {
     // Move cursor first
-    if (cursor_y < (int)buffer.size() - 1) {
+    if (cursor_y < (int)buffer.line_count() - 1) {
         cursor_y++;
-        cursor_x = std::min(cursor_x, (int)buffer[cursor_y].length());
+        cursor_x = std::min(cursor_x, (int)buffer.line_length(cursor_y));
     }
     
     // Update selection state (Editor already handles start_selection)
@@ -165,7 +165,7 @@ void CursorManager::move_down(
 }
 
 void CursorManager::move_word_left(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int cursor_y,
     std::function<void()> update_selection_fn,
@@ -173,7 +173,7 @@ void CursorManager::move_word_left(
     bool select
 ) {
     // Move cursor first
-    int new_x = find_word_start(buffer[cursor_y], cursor_x);
+    int new_x = find_word_start(buffer.line(cursor_y), cursor_x);
     cursor_x = new_x;
     
     // Update selection state (Editor already handles start_selection)
@@ -185,7 +185,7 @@ void CursorManager::move_word_left(
 }
 
 void CursorManager::move_word_right(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int cursor_y,
     std::function<void()> update_selection_fn,
@@ -193,7 +193,7 @@ void CursorManager::move_word_right(
     bool select
 ) {
     // Move cursor first
-    int new_x = find_word_end(buffer[cursor_y], cursor_x);
+    int new_x = find_word_end(buffer.line(cursor_y), cursor_x);
     cursor_x = new_x;
     
     // Update selection state (Editor already handles start_selection)
@@ -204,7 +204,7 @@ void CursorManager::move_word_right(
     }
 }
 
-int CursorManager::find_word_start(const std::string& line, int x) {
+int CursorManager::find_word_start(std::string_view line, int x) {
     if (x == 0) return 0;
     
     // Move to previous character boundary first
@@ -232,7 +232,7 @@ int CursorManager::find_word_start(const std::string& line, int x) {
     return pos;
 }
 
-int CursorManager::find_word_end(const std::string& line, int x) {
+int CursorManager::find_word_end(std::string_view line, int x) {
     int len = line.length();
     
     if (x >= len) return len;
@@ -259,7 +259,7 @@ int CursorManager::find_word_end(const std::string& line, int x) {
 }
 
 void CursorManager::move_home(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int cursor_y,
     std::function<void()> update_selection_fn,
@@ -267,7 +267,7 @@ void CursorManager::move_home(
     bool select
 ) {
     // Smart Home: toggle between first non-whitespace and column 0
-    const std::string& line = buffer[cursor_y];
+    std::string_view line = buffer.line(cursor_y);
     
     // Find first non-whitespace character
     int first_non_ws = 0;
@@ -293,7 +293,7 @@ void CursorManager::move_home(
 }
 
 void CursorManager::move_end(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int& cursor_x,
     int cursor_y,
     std::function<void()> update_selection_fn,
@@ -301,7 +301,7 @@ void CursorManager::move_end(
     bool select
 ) {
     // Move to end of line
-    cursor_x = buffer[cursor_y].length();
+    cursor_x = buffer.line_length(cursor_y);
     
     // Update selection state
     if (select && update_selection_fn) {
@@ -321,184 +321,16 @@ void CursorManager::ensure_cursor_visible(int cursor_y, int& scroll_y, int scree
     }
 }
 
-bool CursorManager::is_cursor_inside_formatting_markers(const std::string& line, int cursor_x) {
-    if (cursor_x < 0 || cursor_x > (int)line.length()) return false;
-    
-    // Check if we're inside ** (bold)
-    if (cursor_x >= 2 && cursor_x < (int)line.length()) {
-        // Check for opening ** before cursor
-        size_t opening = line.rfind("**", cursor_x - 1);
-        if (opening != std::string::npos && opening < (size_t)cursor_x) {
-            // Check for closing ** at or after cursor
-            size_t closing = line.find("**", cursor_x);
-            if (closing != std::string::npos) {
-                return true;
-            }
-        }
-    }
-    
-    // Check if we're inside ~~ (strikethrough)
-    if (cursor_x >= 2 && cursor_x < (int)line.length()) {
-        size_t opening = line.rfind("~~", cursor_x - 1);
-        if (opening != std::string::npos && opening < (size_t)cursor_x) {
-            size_t closing = line.find("~~", cursor_x);
-            if (closing != std::string::npos) {
-                return true;
-            }
-        }
-    }
-    
-    // Check if we're inside <u>...</u> (underline)
-    if (cursor_x >= 3 && cursor_x < (int)line.length()) {
-        size_t opening = line.rfind("<u>", cursor_x - 1);
-        if (opening != std::string::npos && opening < (size_t)cursor_x) {
-            size_t closing = line.find("</u>", cursor_x);
-            if (closing != std::string::npos) {
-                return true;
-            }
-        }
-    }
-    
-    // Check if we're inside * (italic) - but exclude ** which we already checked
-    if (cursor_x >= 1 && cursor_x < (int)line.length()) {
-        size_t opening = line.rfind("*", cursor_x - 1);
-        if (opening != std::string::npos && opening < (size_t)cursor_x) {
-            // Make sure it's not part of **
-            if (opening == 0 || line[opening - 1] != '*') {
-                if (opening + 1 >= line.length() || line[opening + 1] != '*') {
-                    size_t closing = line.find("*", cursor_x);
-                    if (closing != std::string::npos) {
-                        // Make sure closing is not part of **
-                        if (closing == 0 || line[closing - 1] != '*') {
-                            if (closing + 1 >= line.length() || line[closing + 1] != '*') {
-                                return true;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-    
-    return false;
+bool CursorManager::is_cursor_inside_formatting_markers(const FormatSpans& spans, int cursor_x) {
+    return spans.is_inside_formatting(cursor_x);
 }
 
-void CursorManager::get_formatting_at_cursor(const std::string& line, int cursor_x, 
+void CursorManager::get_formatting_at_cursor(const FormatSpans& spans, int cursor_x, 
                                              bool& is_bold, bool& is_italic, 
                                              bool& is_underline, bool& is_strikethrough) {
-    is_bold = false;
-    is_italic = false;
-    is_underline = false;
-    is_strikethrough = false;
-    
-    if (cursor_x < 0 || cursor_x > (int)line.length()) return;
-    
-    // Check for bold **
-    // Need to find the OPENING ** before cursor, not just any **
-    if (cursor_x >= 2) {
-        // Search backwards for **, but verify it's an opening by counting ** before it
-        int bold_count = 0;
-        size_t pos = 0;
-        while (pos <= (size_t)cursor_x - 2) {
-            size_t found = line.find("**", pos);
-            if (found == std::string::npos || found >= (size_t)cursor_x) break;
-            pos = found + 2;
-            bold_count++;
-        }
-        // If odd number of ** before cursor, we're inside bold
-        if (bold_count % 2 == 1) {
-            // Verify there's a closing ** after cursor
-            size_t closing = line.find("**", cursor_x);
-            if (closing != std::string::npos) {
-                is_bold = true;
-            }
-        }
-    }
-    
-    // Check for strikethrough ~~
-    if (cursor_x >= 2) {
-        int strike_count = 0;
-        size_t pos = 0;
-        while (pos <= (size_t)cursor_x - 2) {
-            size_t found = line.find("~~", pos);
-            if (found == std::string::npos || found >= (size_t)cursor_x) break;
-            pos = found + 2;
-            strike_count++;
-        }
-        if (strike_count % 2 == 1) {
-            size_t closing = line.find("~~", cursor_x);
-            if (closing != std::string::npos) {
-                is_strikethrough = true;
-            }
-        }
-    }
-    
-    // Check for underline <u>
-    if (cursor_x >= 3) {
-        int underline_count = 0;
-        size_t pos = 0;
-        while (pos <= (size_t)cursor_x - 3) {
-            size_t open_tag = line.find("<u>", pos);
-            if (open_tag == std::string::npos || open_tag >= (size_t)cursor_x) break;
-            pos = open_tag + 3;
-            underline_count++;
-        }
-        // Count closing tags
-        pos = 0;
-        int close_count = 0;
-        while (pos < (size_t)cursor_x) {
-            size_t close_tag = line.find("</u>", pos);
-            if (close_tag == std::string::npos || close_tag >= (size_t)cursor_x) break;
-            pos = close_tag + 4;
-            close_count++;
-        }
-        if (underline_count > close_count) {
-            size_t closing = line.find("</u>", cursor_x);
-            if (closing != std::string::npos) {
-                is_underline = true;
-            }
-        }
-    }
-    
-    // Check for italic * (but exclude **)
-    if (cursor_x >= 1) {
-        int italic_count = 0;
-        size_t pos = 0;
-        while (pos < (size_t)cursor_x) {
-            size_t found = line.find("*", pos);
-            if (found == std::string::npos || found >= (size_t)cursor_x) break;
-            // Skip if it's part of **
-            if (found + 1 < line.length() && line[found + 1] == '*') {
-                pos = found + 2;
-                continue;
-            }
-            if (found > 0 && line[found - 1] == '*') {
-                pos = found + 1;
-                continue;
-            }
-            pos = found + 1;
-            italic_count++;
-        }
-        if (italic_count % 2 == 1) {
-            // Find next * that's not part of **
-            size_t search_pos = cursor_x;
-            while (search_pos < line.length()) {
-                size_t found = line.find("*", search_pos);
-                if (found == std::string::npos) break;
-                // Check if it's part of **
-                bool part_of_double = false;
-                if (found + 1 < line.length() && line[found + 1] == '*') {
-                    part_of_double = true;
-                }
-                if (found > 0 && line[found - 1] == '*') {
-                    part_of_double = true;
-                }
-                if (!part_of_double) {
-                    is_italic = true;
-                    break;
-                }
-                search_pos = found + 1;
-            }
-        }
-    }
+    const uint8_t formats = spans.formats_at_cursor(cursor_x);
+    is_bold = formats & FormatSpans::bit(Formatter::Type::BOLD);
+    is_italic = formats & FormatSpans::bit(Formatter::Type::ITALIC);
+    is_underline = formats & FormatSpans::bit(Formatter::Type::UNDERLINE);
+    is_strikethrough = formats & FormatSpans::bit(Formatter::Type::STRIKETHROUGH);
 }
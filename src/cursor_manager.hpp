@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
-#include <vector>
+#include <string_view>
+#include <text_buffer.hpp>
+#include <format_span_index.hpp>
 #include <functional>  // For std::function (like Func<> or Action<> delegates in C#)
 
 /// @brief Manages cursor movement and positioning
@@ -10,7 +12,7 @@ public:
     CursorManager();
     
     void move_left(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y,
         std::function<void()> update_selection_fn,
@@ -19,7 +21,7 @@ public:
     );
     
     void move_right(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y,
         std::function<void()> update_selection_fn,
@@ -28,7 +30,7 @@ public:
     );
     
     void move_up(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y,
         std::function<void()> update_selection_fn,
@@ -37,7 +39,7 @@ public:
     );
     
     void move_down(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y,
         std::function<void()> update_selection_fn,
@@ -46,7 +48,7 @@ public:
     );
     
     void move_word_left(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int cursor_y,
         std::function<void()> update_selection_fn,
@@ -55,7 +57,7 @@ public:
     );
     
     void move_word_right(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int cursor_y,
         std::function<void()> update_selection_fn,
@@ -65,7 +67,7 @@ public:
     
     // Home/End keys - move to start/end of line
     void move_home(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int cursor_y,
         std::function<void()> update_selection_fn,
@@ -74,7 +76,7 @@ public:
     );
     
     void move_end(
-        const std::vector<std::string>& buffer,
+        const TextBuffer& buffer,
         int& cursor_x,
         int cursor_y,
         std::function<void()> update_selection_fn,
@@ -85,23 +87,23 @@ public:
     void ensure_cursor_visible(int cursor_y, int& scroll_y, int screen_height);
     
     // Helper functions for word boundary detection
-    int find_word_start(const std::string& line, int x);
-    int find_word_end(const std::string& line, int x);
+    int find_word_start(std::string_view line, int x);
+    int find_word_end(std::string_view line, int x);
     
     /// @brief Check if cursor is currently inside formatting markers
-    /// @param line The current line text
+    /// @param spans Formatting of the current line
     /// @param cursor_x The cursor X position
     /// @return True if cursor is between opening and closing formatting markers
-    bool is_cursor_inside_formatting_markers(const std::string& line, int cursor_x);
+    bool is_cursor_inside_formatting_markers(const FormatSpans& spans, int cursor_x);
     
     /// @brief Get the type of formatting marker at cursor position
-    /// @param line The current line text
+    /// @param spans Formatting of the current line
     /// @param cursor_x The cursor X position
     /// @param is_bold Output: true if inside bold markers
     /// @param is_italic Output: true if inside italic markers
     /// @param is_underline Output: true if inside underline markers
     /// @param is_strikethrough Output: true if inside strikethrough markers
-    void get_formatting_at_cursor(const std::string& line, int cursor_x, 
+    void get_formatting_at_cursor(const FormatSpans& spans, int cursor_x, 
                                   bool& is_bold, bool& is_italic, 
                                   bool& is_underline, bool& is_strikethrough);
 
@@ -110,5 +112,5 @@ private:
     /// @param line The current line text
     /// @param cursor_x The cursor X position (will be modified to skip markers)
     /// @param direction -1 for left, +1 for right
-    void skip_formatting_markers(const std::string& line, int& cursor_x, int direction);
+    void skip_formatting_markers(std::string_view line, int& cursor_x, int direction);
 };
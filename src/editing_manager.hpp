@@ -1,6 +1,6 @@
 #pragma once
 #include <string>
-#include <vector>
+#include <text_buffer.hpp>
 
 /// @brief Manages text editing operations (insert, delete, newline)
 /// Like TextBox text manipulation methods in C#
@@ -12,7 +12,7 @@ public:
     // char c = single character (like C# char)
     // & parameters = modifies originals (like 'ref' in C#)
     void insert_char(
-        std::vector<std::string>& buffer,  // Modifies buffer
+        TextBuffer& buffer,                 // Modifies buffer
         int& cursor_x,                      // Modifies cursor position
         int cursor_y,                       // Readonly int (passed by value)
         char c                               // Character to insert
@@ -20,26 +20,26 @@ public:
     
     // Insert UTF-8 string at cursor position
     void insert_string(
-        std::vector<std::string>& buffer,  // Modifies buffer
+        TextBuffer& buffer,                 // Modifies buffer
         int& cursor_x,                      // Modifies cursor position
         int cursor_y,                       // Readonly int (passed by value)
         const std::string& str              // String to insert
     );
     
     void insert_newline(
-        std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y
     );
     
     void delete_char(
-        std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y
     );
     
     void delete_forward(
-        std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int cursor_x,
         int cursor_y
     );
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 #include <csignal>
 #include <cstdio>
 #include <unistd.h>
@@ -9,6 +10,8 @@
 #include <libgen.h>
 #include <cstring>
 #include <tuple>
+#include <chrono>
+#include <charconv>
 
 
 using namespace ftxui;
@@ -17,6 +20,9 @@ using namespace ftxui;
 // volatile sig_atomic_t = thread-safe atomic type for signal handlers
 static volatile sig_atomic_t ctrl_c_pressed = 0;
 
+// Screens of a paged file read ahead in the scroll direction
+static constexpr int PREFETCH_SCREENS = 4;
+
 //static void handle_sigint(int sig) {
 //    (void)sig;  // Unused parameter (suppress warning)
 //    ctrl_c_pressed = 1;
@@ -24,9 +30,17 @@ static volatile sig_atomic_t ctrl_c_pressed = 0;
 
 // ===== Constructor / Destructor =====
 // Constructor initializer list (more efficient than assigning in body)
-Editor::Editor(const std::string& fn, bool dbg) : filename(fn), debug_mode(dbg) {
+Editor::Editor(const std::string& fn, bool dbg, bool follow, size_t max_lines)
+    : filename(fn), debug_mode(dbg), follow_mode(follow), follow_max_lines(max_lines) {
     if (config_manager.load() != ConfigStatus::SUCCESS) { set_status(config_manager.last_error(), StatusBarType::ERROR); } // error but not a critical one.
     UIRenderer::color_mode_dark = config_manager.is_dark_mode(); // has default value
+    file_manager.set_save_durability(config_manager.save_durability());
+    undo_redo_manager.set_memory_budget(config_manager.undo_memory_bytes());
+    if (follow_mode) {
+        // The follower reads the file once run() starts it
+        set_status("Following " + filename + " (read-only)");
+        return;
+    }
     load_file();
 }
 
@@ -109,14 +123,77 @@ bool Editor::change_color_mode() {
 // ===== File Operations =====
 
 void Editor::load_file() {
-    FileOperationResult result = file_manager.load_file(filename, buffer);
+    // Nothing is read here, the file is indexed in the background and shows
+    // up screen by screen (see handle_event) - the UI comes up right away
+    FileOperationResult result = file_manager.load_file(filename, buffer, 0);
+    if (file_watcher) file_watcher->mark_synced();
+    file_rewritten = false;
+    // History refers to lines of the previous contents, it can't survive a reload
+    undo_redo_manager.clear();
     if(!result.success) {
         set_status(result.message, result.status_type);
+        return;
+    }
+    // The saved history of the file, if it is still the same - taken over
+    // once it is indexed
+    if (undo_redo_manager.open_history(filename)) restore_history();
+}
+
+void Editor::restore_history() {
+    if (buffer.indexing() || !undo_redo_manager.history_pending()) return;
+    const size_t restored = undo_redo_manager.restore_history(buffer);
+    if (restored > 0) {
+        set_status("Restored " + std::to_string(restored) + " undo step" + (restored == 1 ? "" : "s"));
+    }
+}
+
+void Editor::save_history() {
+    // Only a history of what is on disk can be restored
+    if (follow_mode || modified || save_job || buffer.indexing() || buffer.is_paged()) return;
+    undo_redo_manager.save_history(buffer, filename, cursor_x, cursor_y);
+}
+
+bool Editor::check_editable() {
+    if (follow_mode) {
+        set_status("Following the file - read-only", StatusBarType::WARNING);
+        return false;
     }
+    if (!buffer.indexing()) return true;
+    set_status("Still loading the file - read-only until it is complete", StatusBarType::WARNING);
+    return false;
+}
+
+bool Editor::check_not_saving() {
+    if (!save_job) return true;
+    set_status("Still saving the file...", StatusBarType::WARNING);
+    return false;
+}
+
+bool Editor::check_not_rewritten() {
+    if (!file_rewritten) return true;
+    // Reloading is the only way on, asked again
+    input_manager.start_reload_confirm();
+    set_status("File changed on disk, your unedited lines show its new text - can't save! Reload and discard your changes? (y/n)",
+               StatusBarType::ERROR);
+    return false;
 }
 
 void Editor::save_file() {
-    FileOperationResult result = file_manager.save_file(filename, buffer);
+    if (!check_editable() || !check_not_saving() || !check_not_rewritten()) return;
+
+    // Written out on a worker thread, editing goes on meanwhile (see poll_save)
+    save_edit_count = buffer.edit_count();
+    save_job = file_manager.start_save(filename, buffer, [this] { screen->PostEvent(Event::Custom); });
+    set_status("Saving...");
+}
+
+void Editor::poll_save(bool wait) {
+    if (!save_job) return;
+    if (wait) save_job->wait();
+    if (!save_job->done()) return;
+
+    FileOperationResult result = file_manager.finish_save(filename, *save_job, buffer);
+    save_job.reset();
 
     if (result.error_code == EACCES) {
         input_manager.start_privilege_confirm();
@@ -125,20 +202,170 @@ void Editor::save_file() {
     }
 
     set_status(result.message, result.status_type);
-    if (result.success)
+    if (!result.success) return;
+    if (file_watcher) file_watcher->mark_synced(); // Our own change, not one to reload
+    // Edits made during the save are not in the file
+    if (buffer.edit_count() == save_edit_count)
+        modified = false;
+}
+
+void Editor::watch_file() {
+    if (follow_mode) {
+        // Only the last follow_max_lines lines would be kept, no use reading further back
+        log_follower = std::make_unique<LogFollower>(filename, [this] { screen->PostEvent(Event::Custom); },
+                                                     follow_max_lines);
+        return;
+    }
+    file_watcher = std::make_unique<FileWatcher>(filename, [this] { screen->PostEvent(Event::Custom); });
+}
+
+void Editor::poll_follow() {
+    if (!log_follower) return;
+
+    LogFollower::Update update = log_follower->take();
+    if (update.truncated) set_status("File truncated, following it from the start", StatusBarType::WARNING);
+    if (update.rotated) set_status("File replaced (rotated), following the new one", StatusBarType::WARNING);
+    if (update.text.empty()) return;
+
+    // Scrolls along only while the cursor is on the last line, like tail
+    const bool at_end = cursor_y + 1 >= static_cast<int>(buffer.line_count());
+    if (!follow_started) {
+        // The first lines replace the empty document, without a copy
+        buffer.load(std::move(update.text));
+        follow_started = true;
+    } else {
+        buffer.append_lines(update.text);
+    }
+
+    if (follow_max_lines > 0 && buffer.line_count() > follow_max_lines) {
+        const size_t dropped = buffer.line_count() - follow_max_lines;
+        buffer.erase_lines(0, dropped);
+        cursor_y -= static_cast<int>(std::min<size_t>(dropped, cursor_y));
+        scroll_y -= static_cast<int>(std::min<size_t>(dropped, scroll_y));
+        selection_manager.clear_selection();
+
+        // Dropped lines keep their text in the buffer's storage until it is
+        // stored anew - once per window of lines, so memory stays within twice
+        // the window and the copy costs O(1) per line
+        follow_dropped += dropped;
+        if (follow_dropped >= follow_max_lines) {
+            buffer.compact();
+            follow_dropped = 0;
+        }
+    }
+
+    if (at_end) {
+        cursor_y = static_cast<int>(buffer.line_count()) - 1;
+        cursor_x = 0;
+    }
+}
+
+void Editor::poll_file_change() {
+    // Loading and saving change the buffer or the file themselves, a change
+    // is picked up once they are done (both post an event when they are)
+    if (!file_watcher || buffer.indexing() || save_job) return;
+    if (!file_watcher->take_change()) return;
+
+    if (modified) {
+        // Unedited lines are read from the file through the mapping, they
+        // show the new bytes now - the old text can't be kept and saved
+        file_rewritten = buffer.is_paged() || buffer.maps_file(filename);
+        input_manager.start_reload_confirm();
+        set_status(file_rewritten ? "File changed on disk, your unedited lines show its new text! Reload and discard your changes? (y/n)"
+                                  : "File changed on disk! Reload and discard your changes? (y/n)",
+                   StatusBarType::WARNING);
+        return;
+    }
+    reload_from_disk();
+}
+
+void Editor::keep_buffer_after_file_change() {
+    if (file_rewritten) {
+        set_status("Not reloaded - the buffer mixes your changes with the new file, saving asks to reload first",
+                   StatusBarType::WARNING);
+        return;
+    }
+    set_status("Kept your changes, saving will overwrite the file on disk", StatusBarType::NORMAL);
+}
+
+void Editor::reload_from_disk() {
+    if (!check_not_saving()) return;
+
+    // Rewritten in place under the mapping, the old contents are gone - and a
+    // paged file is too large to compare. Both are loaded anew.
+    if (buffer.is_paged() || buffer.maps_file(filename)) {
+        load_file();
         modified = false;
+        clamp_cursor_and_scroll();
+        set_status("File changed on disk, reloaded", StatusBarType::NORMAL);
+        return;
+    }
+
+    // Marked before reading, a write while reading shows up as another change
+    if (file_watcher) file_watcher->mark_synced();
+    std::string contents;
+    FileOperationResult result = file_manager.read_file(filename, contents);
+    if (!result.success) {
+        set_status(result.message, result.status_type);
+        return;
+    }
+
+    LineTable lines;
+    lines.push_lines(contents, std::numeric_limits<size_t>::max());
+    if (lines.empty()) lines.push_back(""); // The document always has a line
+
+    std::vector<LineDiff::Change> changes = buffer.diff(lines);
+    if (!changes.empty()) {
+        // One undo step takes the buffer back to before the reload
+        save_state();
+        typing_state_saved = false;
+        last_action = EditorAction::NONE;
+        buffer.patch(changes, lines);
+
+        // Cursor and view stay on the same text, lines above them may have come or gone
+        auto follow = [&changes](int y) {
+            size_t line = static_cast<size_t>(y);
+            size_t shifted = line;
+            for (const LineDiff::Change& change : changes) {
+                if (change.old_first + change.old_count <= line) {
+                    shifted = shifted + change.new_count - change.old_count;
+                } else if (change.old_first <= line) {
+                    // Inside a replaced range - stay at the same offset into it
+                    shifted = shifted - (line - change.old_first) + std::min(line - change.old_first, change.new_count);
+                }
+            }
+            return static_cast<int>(shifted);
+        };
+        cursor_y = follow(cursor_y);
+        scroll_y = follow(scroll_y);
+        clamp_cursor_and_scroll();
+    }
+
+    modified = false;
+    set_status("File changed on disk, reloaded (" + std::to_string(changes.size()) + " changed range" +
+               (changes.size() == 1 ? ")" : "s)"), StatusBarType::NORMAL);
 }
 
 void Editor::save_file_with_privilege() {
+    if (!check_editable() || !check_not_saving() || !check_not_rewritten()) return;
+
     FileOperationResult result = file_manager.save_file_with_privilege(filename, buffer);
 
     screen->Clear();
     set_status(result.message, result.status_type);
-    if (result.success)
+    if (result.success) {
         modified = false;
+        if (file_watcher) file_watcher->mark_synced();
+    }
 }
 
 void Editor::rename_file(const std::string& new_filename) {
+    if (!check_not_saving()) return;
+    if (follow_mode) {
+        set_status("Following the file - read-only", StatusBarType::WARNING);
+        return;
+    }
+
     // If the current file doesn't exist on disk yet (unsaved/new file),
     // just adopt the new name and save directly — there's nothing to rename.
     std::ifstream source_check(filename);
@@ -147,6 +374,7 @@ void Editor::rename_file(const std::string& new_filename) {
 
     if (!source_exists) {
         filename = new_filename;
+        watch_file();
         save_file();
         return;
     }
@@ -155,6 +383,7 @@ void Editor::rename_file(const std::string& new_filename) {
     set_status(result.message, result.status_type);
     if (result.success) {
         filename = new_filename;
+        watch_file();
     }
 }
 
@@ -174,6 +403,7 @@ void Editor::clear_selection() {
 
 void Editor::delete_selection() {
     if (!selection_manager.has_active_selection()) return;
+    if (!check_editable()) return;
 
     save_state();
     selection_manager.delete_selection(buffer, cursor_x, cursor_y);
@@ -184,8 +414,8 @@ void Editor::delete_selection() {
 void Editor::select_all() {
     if (buffer.empty()) return;
 
-    int end_y = buffer.size() - 1;
-    int end_x = buffer[end_y].size();
+    int end_y = buffer.line_count() - 1;
+    int end_x = buffer.line_length(end_y);
     selection_manager.select_all(end_x, end_y);
     set_status("Selected all");
 }
@@ -194,10 +424,6 @@ std::string Editor::get_selected_text() const {
     return selection_manager.get_selected_text(buffer);
 }
 
-bool Editor::is_char_selected(int x, int y) const {
-    return selection_manager.is_char_selected(x, y);
-}
-
 // ===== Clipboard Operations =====
 
 void Editor::copy_to_system_clipboard() {
@@ -215,6 +441,8 @@ void Editor::copy_to_system_clipboard() {
 }
 
 void Editor::paste_from_system_clipboard() {
+    if (!check_editable()) return;
+
     save_state();
     typing_state_saved = false;
     last_action = EditorAction::PASTE_SYSTEM;
@@ -235,7 +463,38 @@ void Editor::paste_from_system_clipboard() {
     }
 }
 
+void Editor::paste_text(const std::string& text) {
+    if (!check_editable()) return;
+
+    // Terminals send line breaks as "\r", some as "\r\n"
+    std::string pasted;
+    pasted.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\r') {
+            pasted += text[i];
+        } else if (i + 1 == text.size() || text[i + 1] != '\n') {
+            pasted += '\n';
+        }
+    }
+    if (pasted.empty()) return;
+
+    // One undo state and one buffer edit for the whole paste
+    save_state();
+    typing_state_saved = false;
+    last_action = EditorAction::PASTE_SYSTEM;
+
+    if (selection_manager.has_active_selection()) {
+        delete_selection();
+    }
+
+    int char_count = clipboard_manager.insert_multiline_text(pasted, buffer, cursor_x, cursor_y);
+    set_status("Pasted " + std::to_string(char_count) + " characters");
+    modified = true;
+}
+
 void Editor::cut_to_system_clipboard() {
+    if (!check_editable()) return;
+
     const std::string text = get_selected_text();
     if (text.empty()) {
         set_status("No text selected");
@@ -273,9 +532,11 @@ static const char* format_type_name(FormatType ft) {
 }
 
 void Editor::toggle_format(FormatType format_type) {
+    if (!check_editable()) return;
+
     // If there's an active selection, wrap/unwrap it with markers
     if (selection_manager.has_active_selection()) {
-        selection_manager.adjust_selection_for_formatting(buffer);
+        selection_manager.adjust_selection_for_formatting(buffer, format_spans);
         std::string selected_text = get_selected_text();
         if (!selected_text.empty()) {
             bool has_bold, has_italic, has_underline, has_strikethrough;
@@ -319,7 +580,7 @@ void Editor::toggle_format(FormatType format_type) {
 
     // No selection: act on formatting at cursor
     bool bold_at_cursor, italic_at_cursor, underline_at_cursor, strikethrough_at_cursor;
-    cursor_manager.get_formatting_at_cursor(buffer[cursor_y], cursor_x,
+    cursor_manager.get_formatting_at_cursor(format_spans.line(buffer, cursor_y), cursor_x,
                                            bold_at_cursor, italic_at_cursor,
                                            underline_at_cursor, strikethrough_at_cursor);
 
@@ -332,7 +593,7 @@ void Editor::toggle_format(FormatType format_type) {
     }
 
     if (is_active) {
-        const std::string& line = buffer[cursor_y];
+        std::string_view line = buffer.line(cursor_y);
         size_t closing_pos = std::string::npos;
         size_t marker_len = 0;
         switch (format_type) {
@@ -380,13 +641,12 @@ void Editor::toggle_format(FormatType format_type) {
 // ===== Editing Operations =====
 
 void Editor::insert_char(char c) {
+    if (!check_editable()) return;
     delete_selection_if_active();
 
-    // Check if we're inside existing formatting markers
-    bool inside_markers = cursor_manager.is_cursor_inside_formatting_markers(buffer[cursor_y], cursor_x);
-
     // Insert formatting markers if active and not already inside formatted text
-    if (format_manager.has_active_formatting() && !inside_markers) {
+    if (format_manager.has_active_formatting() &&
+        !cursor_manager.is_cursor_inside_formatting_markers(format_spans.line(buffer, cursor_y), cursor_x)) {
         // Insert both opening and closing markers, cursor stays between them
         format_manager.insert_formatting_markers(buffer, cursor_x, cursor_y);
         modified = true;
@@ -397,13 +657,12 @@ void Editor::insert_char(char c) {
 }
 
 void Editor::insert_string(const std::string& str) {
+    if (!check_editable()) return;
     delete_selection_if_active();
 
-    // Check if we're inside existing formatting markers
-    bool inside_markers = cursor_manager.is_cursor_inside_formatting_markers(buffer[cursor_y], cursor_x);
-
     // Insert formatting markers if active and not already inside formatted text
-    if (format_manager.has_active_formatting() && !inside_markers) {
+    if (format_manager.has_active_formatting() &&
+        !cursor_manager.is_cursor_inside_formatting_markers(format_spans.line(buffer, cursor_y), cursor_x)) {
         // Insert both opening and closing markers, cursor stays between them
         format_manager.insert_formatting_markers(buffer, cursor_x, cursor_y);
         modified = true;
@@ -414,6 +673,7 @@ void Editor::insert_string(const std::string& str) {
 }
 
 void Editor::insert_newline() {
+    if (!check_editable()) return;
     delete_selection_if_active();
 
     save_state();
@@ -425,43 +685,48 @@ void Editor::insert_newline() {
 
 // --- New helper methods to encapsulate input-related buffer edits ---
 void Editor::insert_line_above() {
+    if (!check_editable()) return;
     delete_selection_if_active();
     save_state();
     typing_state_saved = false;
     last_action = EditorAction::INSERT_LINE;
-    buffer.insert(buffer.begin() + cursor_y, "");
+    buffer.insert_line(cursor_y, "");
     cursor_x = 0;
     modified = true;
 }
 
 void Editor::insert_line_below() {
+    if (!check_editable()) return;
     delete_selection_if_active();
     save_state();
     typing_state_saved = false;
     last_action = EditorAction::INSERT_LINE;
-    buffer.insert(buffer.begin() + cursor_y + 1, "");
+    buffer.insert_line(cursor_y + 1, "");
     cursor_y++;
     cursor_x = 0;
     modified = true;
 }
 
 void Editor::insert_tab() {
+    if (!check_editable()) return;
     delete_selection_if_active();
     save_state();
     typing_state_saved = false;
     last_action = EditorAction::TAB;
-    buffer[cursor_y].insert(cursor_x, "\t");
+    buffer.insert_text(cursor_y, cursor_x, "\t");
     cursor_x++;
     modified = true;
 }
 
 void Editor::unindent_current_line() {
+    if (!check_editable()) return;
     delete_selection_if_active();
-    if (!buffer[cursor_y].empty() && buffer[cursor_y][0] == '\t') {
+    std::string_view line = buffer.line(cursor_y);
+    if (!line.empty() && line[0] == '\t') {
         save_state();
         typing_state_saved = false;
         last_action = EditorAction::UNTAB;
-        buffer[cursor_y].erase(0, 1);
+        buffer.erase_text(cursor_y, 0, 1);
         if (cursor_x > 0) cursor_x--;
         modified = true;
     }
@@ -473,6 +738,8 @@ void Editor::reset_status() {
 }
 
 void Editor::delete_char() {
+    if (!check_editable()) return;
+
     if (selection_manager.has_active_selection()) {
         delete_selection();
         return;
@@ -490,6 +757,8 @@ void Editor::delete_char() {
 }
 
 void Editor::delete_forward() {
+    if (!check_editable()) return;
+
     if (selection_manager.has_active_selection()) {
         delete_selection();
         return;
@@ -559,11 +828,11 @@ void Editor::move_cursor_end(bool select) {
 // ===== Helper Functions =====
 
 int Editor::find_word_start(int x, int y) {
-    return cursor_manager.find_word_start(buffer[y], x);
+    return cursor_manager.find_word_start(buffer.line(y), x);
 }
 
 int Editor::find_word_end(int x, int y) {
-    return cursor_manager.find_word_end(buffer[y], x);
+    return cursor_manager.find_word_end(buffer.line(y), x);
 }
 
 void Editor::ensure_cursor_visible(int screen_height) {
@@ -572,19 +841,19 @@ void Editor::ensure_cursor_visible(int screen_height) {
 
 void Editor::clamp_cursor_and_scroll() {
     // Ensure buffer is never empty
-    if (buffer.empty()) buffer.push_back("");
+    if (buffer.empty()) buffer.insert_line(0, "");
 
     // Clamp cursor_y
     if (cursor_y < 0) cursor_y = 0;
-    if (cursor_y >= (int)buffer.size()) cursor_y = (int)buffer.size() - 1;
+    if (cursor_y >= (int)buffer.line_count()) cursor_y = (int)buffer.line_count() - 1;
 
     // Clamp cursor_x
     if (cursor_x < 0) cursor_x = 0;
-    if (cursor_x > (int)buffer[cursor_y].length()) cursor_x = (int)buffer[cursor_y].length();
+    if (cursor_x > (int)buffer.line_length(cursor_y)) cursor_x = (int)buffer.line_length(cursor_y);
 
     // Clamp scroll_y
     if (scroll_y < 0) scroll_y = 0;
-    if (scroll_y >= (int)buffer.size()) scroll_y = std::max(0, (int)buffer.size() - 1);
+    if (scroll_y >= (int)buffer.line_count()) scroll_y = std::max(0, (int)buffer.line_count() - 1);
 }
 
 void Editor::set_status(const std::string& message, StatusBarType type) {
@@ -608,10 +877,13 @@ std::tuple<std::function<void()>, std::function<void()>> Editor::get_selection_c
 // ===== Undo/Redo =====
 
 void Editor::save_state() {
-    undo_redo_manager.save_state(buffer, cursor_x, cursor_y);
+    // A running save writes out text the add buffer must keep where it is
+    undo_redo_manager.save_state(buffer, cursor_x, cursor_y, !save_job);
 }
 
 void Editor::undo() {
+    if (!check_editable()) return;
+
     if (!undo_redo_manager.can_undo()) {
         set_status("Nothing to undo");
         return;
@@ -619,13 +891,19 @@ void Editor::undo() {
 
     typing_state_saved = false;
     last_action = EditorAction::UNDO;
-    undo_redo_manager.undo(buffer, cursor_x, cursor_y);
+    const size_t decompressions = undo_redo_manager.compression_stats().decompressions;
+    if (!undo_redo_manager.undo(buffer, cursor_x, cursor_y)) {
+        set_status("Undo history could not be read back from disk, it was dropped", StatusBarType::ERROR);
+        return;
+    }
     clamp_cursor_and_scroll();
     modified = true;
-    set_status("Undo");
+    set_status("Undo" + decompression_note(decompressions));
 }
 
 void Editor::redo() {
+    if (!check_editable()) return;
+
     if (!undo_redo_manager.can_redo()) {
         set_status("Nothing to redo");
         return;
@@ -633,10 +911,86 @@ void Editor::redo() {
 
     typing_state_saved = false;
     last_action = EditorAction::REDO;
-    undo_redo_manager.redo(buffer, cursor_x, cursor_y);
+    const size_t decompressions = undo_redo_manager.compression_stats().decompressions;
+    if (!undo_redo_manager.redo(buffer, cursor_x, cursor_y)) {
+        set_status("Redo history could not be read back from disk, it was dropped", StatusBarType::ERROR);
+        return;
+    }
     clamp_cursor_and_scroll();
     modified = true;
-    set_status("Redo");
+    set_status("Redo" + decompression_note(decompressions));
+}
+
+std::string Editor::decompression_note(size_t decompressions_before) const {
+    const UndoRedoManager::CompressionStats& stats = undo_redo_manager.compression_stats();
+    if (stats.decompressions == decompressions_before) return "";
+    return " (" + std::to_string(stats.last_decompressed_bytes / 1024) + " KB decompressed in " +
+           std::to_string(stats.last_decompress.count() / 1000) + " ms)";
+}
+
+std::string Editor::undo_state_summary() const {
+    const size_t checkpoint_kb = undo_redo_manager.checkpoint_bytes(buffer) / 1024;
+    return "now #" + std::to_string(undo_redo_manager.current_index()) + ", #" +
+           std::to_string(undo_redo_manager.root_index()) + "-#" + std::to_string(undo_redo_manager.newest_index()) +
+           ", " + std::to_string(undo_redo_manager.checkpoint_count()) + " checkpoints using " +
+           std::to_string(checkpoint_kb) + " KB" + compression_summary();
+}
+
+std::string Editor::compression_summary() const {
+    const UndoRedoManager::CompressionStats& stats = undo_redo_manager.compression_stats();
+    if (stats.entries == 0) return "";
+    // Saved is what compaction freed for them, less what they hold compressed
+    const size_t saved = stats.freed_bytes > stats.compressed_bytes ? stats.freed_bytes - stats.compressed_bytes : 0;
+    std::string summary = ", " + std::to_string(stats.entries) + " compressed saving " +
+                          std::to_string(saved / 1024) + " KB";
+    if (stats.decompressions > 0) {
+        summary += " (decompress max " + std::to_string(stats.max_decompress.count() / 1000) + " ms)";
+    }
+    return summary;
+}
+
+void Editor::jump_to_undo_state(const std::string& target) {
+    if (!check_editable()) return;
+
+    // "#n" or "n" is a node, "-10m" a time ago
+    std::string_view text = target;
+    if (!text.empty() && text.front() == '#') text.remove_prefix(1);
+    const bool ago = !text.empty() && text.front() == '-';
+    if (ago) text.remove_prefix(1);
+    size_t number = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+    std::string_view unit(end, text.data() + text.size() - end);
+    if (error != std::errc() || (ago ? unit.size() != 1 : !unit.empty())) {
+        set_status("Go to a state as #12, or as of a time ago as -30s, -10m or -2h", StatusBarType::ERROR);
+        return;
+    }
+
+    size_t index = number;
+    if (ago) {
+        std::chrono::seconds seconds(number);
+        if (unit == "m") seconds *= 60;
+        else if (unit == "h") seconds *= 3600;
+        else if (unit != "s") {
+            set_status("Unknown time unit '" + std::string(unit) + "', use s, m or h", StatusBarType::ERROR);
+            return;
+        }
+        index = undo_redo_manager.node_at(UndoRedoManager::Clock::now() - seconds);
+    }
+
+    if (!undo_redo_manager.has_node(index)) {
+        set_status("No undo state #" + std::to_string(index) + " (" + undo_state_summary() + ")", StatusBarType::ERROR);
+        return;
+    }
+
+    typing_state_saved = false;
+    last_action = EditorAction::NONE;
+    if (!undo_redo_manager.jump_to(buffer, index, cursor_x, cursor_y)) {
+        set_status("Undo history could not be read back from disk, it was dropped", StatusBarType::ERROR);
+        return;
+    }
+    clamp_cursor_and_scroll();
+    modified = true;
+    set_status("Undo state #" + std::to_string(index) + " (" + undo_state_summary() + ")");
 }
 
 // ===== UI Rendering =====
@@ -645,10 +999,11 @@ Element Editor::render() {
     clamp_cursor_and_scroll();
     int screen_height = Terminal::Size().dimy;
     ensure_cursor_visible(screen_height);
+    prefetch_ahead(screen_height);
 
     // Check if cursor is inside formatting markers
     bool bold_at_cursor, italic_at_cursor, underline_at_cursor, strikethrough_at_cursor;
-    cursor_manager.get_formatting_at_cursor(buffer[cursor_y], cursor_x,
+    cursor_manager.get_formatting_at_cursor(format_spans.line(buffer, cursor_y), cursor_x,
                                            bold_at_cursor, italic_at_cursor,
                                            underline_at_cursor, strikethrough_at_cursor);
 
@@ -659,12 +1014,26 @@ Element Editor::render() {
     bool show_strikethrough = format_manager.is_strikethrough() || strikethrough_at_cursor;
 
     // Use UIRenderer to handle all rendering
-    auto is_char_selected_fn = [this](int x, int y) {
-        return this->is_char_selected(x, y);
-    };
+    SelectionRange selection;
+    if (selection_manager.has_active_selection()) {
+        selection.active = true;
+        selection_manager.get_normalized_bounds(selection.start_x, selection.start_y, selection.end_x, selection.end_y);
+    }
+
+    // Background work shown in the status bar, a save before the loading
+    const char* progress_label = nullptr;
+    int progress_percent = 0;
+    if (save_job) {
+        progress_label = "Saving";
+        progress_percent = static_cast<int>(save_job->progress() * 100);
+    } else if (buffer.indexing()) {
+        progress_label = "Loading";
+        progress_percent = static_cast<int>(buffer.index_progress() * 100);
+    }
 
     RenderParams params{
         buffer,
+        format_spans,
         cursor_x, cursor_y,
         scroll_y,
         filename,
@@ -675,26 +1044,54 @@ Element Editor::render() {
         editor_mode,
         undo_redo_manager.can_undo(),
         undo_redo_manager.can_redo(),
+        progress_label,
+        progress_percent,
         show_bold,
         show_italic,
         show_underline,
         show_strikethrough,
-        is_char_selected_fn
+        selection,
+        debug_mode
     };
 
     return ui_renderer.render(params);
 }
 
+void Editor::prefetch_ahead(int screen_height) {
+    // Only a paged file has text that may not be in memory yet
+    if (!buffer.is_paged() || scroll_y == prefetch_scroll_y) return;
+
+    const int ahead = PREFETCH_SCREENS * screen_height;
+    if (scroll_y > prefetch_scroll_y) {
+        buffer.prefetch_lines(scroll_y + screen_height, ahead);
+    } else {
+        const int first = std::max(0, scroll_y - ahead);
+        buffer.prefetch_lines(first, scroll_y - first);
+    }
+    prefetch_scroll_y = scroll_y;
+}
+
 // ===== Event Handling =====
 
 bool Editor::handle_event(Event event) {
+    // Posted by the background indexer or save - pick up the new lines or
+    // the save result and redraw
+    if (event == Event::Custom) {
+        buffer.poll_index();
+        restore_history();
+        poll_save(false);
+        undo_redo_manager.poll_compression(buffer);
+        poll_file_change();
+        poll_follow();
+        return true;
+    }
     return input_manager.handle_event(event, *this, ctrl_c_pressed);
 }
 
 /// @brief Clear the UI and redraw, if the file isn't modified reload it from disk.
 void Editor::screen_reset() {
     screen->Clear();
-    if (!is_modified())
+    if (!is_modified() && !save_job && !follow_mode)
         load_file();
     set_status("UI Reset.", StatusBarType::NORMAL);
 }
@@ -713,6 +1110,34 @@ void Editor::run() {
         screen->TrackMouse(false); // at least for now
         screen->ForceHandleCtrlZ(false); // handle Ctrl+Z manually for undo
 
+        // Wake the loop whenever the background indexer has new lines. The
+        // guard unhooks it before screen_instance goes away, even on exceptions.
+        buffer.set_index_listener([this] { screen->PostEvent(Event::Custom); });
+        struct IndexListenerGuard {
+            TextBuffer& buffer;
+            ~IndexListenerGuard() { buffer.set_index_listener(nullptr); }
+        } index_listener_guard{buffer};
+        // Same for the undo history's background compression
+        undo_redo_manager.set_compression_listener([this] { screen->PostEvent(Event::Custom); });
+        struct CompressionListenerGuard {
+            UndoRedoManager& manager;
+            ~CompressionListenerGuard() { manager.set_compression_listener(nullptr); }
+        } compression_listener_guard{undo_redo_manager};
+        // A save still running on quit is finished while the screen exists
+        struct SaveGuard {
+            Editor& editor;
+            ~SaveGuard() { editor.poll_save(true); }
+        } save_guard{*this};
+        // Watch for outside changes, until before the screen goes away
+        watch_file();
+        struct WatchGuard {
+            Editor& editor;
+            ~WatchGuard() {
+                editor.file_watcher.reset();
+                editor.log_follower.reset();
+            }
+        } watch_guard{*this};
+
         // 4. Create the Component Tree
         auto main_component = Renderer([&] {
             return render();
@@ -721,6 +1146,13 @@ void Editor::run() {
         // We use CatchEvent to pass every key/sequence to InputManager
         main_component = CatchEvent(main_component, [&](Event event) { return handle_event(event); });
 
+        // Have the terminal mark pasted text (see InputManager), and stop it
+        // on the way out
+        std::cout << BracketedPaste::ENABLE << std::flush;
+        struct BracketedPasteGuard {
+            ~BracketedPasteGuard() { std::cout << BracketedPaste::DISABLE << std::flush; }
+        } bracketed_paste_guard;
+
         // Start the Main Loop (This blocks until the editor closes)
         screen->Loop(main_component);
     }
@@ -728,4 +1160,6 @@ void Editor::run() {
         std::cerr << "\r\n[!] Editor Crashed: " << e.what() << std::endl;
         throw;
     }
+    // Kept for the next time the file is opened
+    save_history();
 }
@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
+#include <cstdint>
 #include <functional>
 #include <tuple>
 
@@ -18,14 +20,20 @@
 #include "cursor_manager.hpp"
 #include "undo_redo_manager.hpp"
 #include "format_manager.hpp"
+#include "format_span_index.hpp"
 #include "file_manager.hpp"
 #include "input_manager.hpp"
 #include "config_manager.hpp"
+#include "file_watcher.hpp"
+#include "log_follower.hpp"
+#include "text_buffer.hpp"
 
 /// @brief Main text editor class - handles UI, input, and editing operations
 class Editor {
 public:
-    Editor(const std::string& filename, bool debug_mode = false);
+    /// @param follow Follow the file read-only as it grows (--follow)
+    /// @param follow_max_lines Lines kept while following, the oldest are dropped (0: all)
+    Editor(const std::string& filename, bool debug_mode = false, bool follow = false, size_t follow_max_lines = 0);
     ~Editor();
 
     /// @brief Start the editor main loop
@@ -33,10 +41,11 @@ public:
     std::string filename; // Includes File path
 
 private:
-    // Core data (std::vector = List<string>, std::string = string)
-    std::vector<std::string> buffer; // Text buffer - each line is one string
+    // Core data - piece table of lines, see text_buffer.hpp
+    TextBuffer buffer; // Text buffer - managers access lines through it
 
     bool modified = false; // Has unsaved changes?
+    bool file_rewritten = false; // Mapped file changed on disk under unsaved changes - not saved until reloaded
     bool status_shown = false; // Show status in UI?
     StatusBarType status_bar_type = StatusBarType::NORMAL; // Status bar type (normal, error, warning)
     std::string status_message = "";
@@ -49,6 +58,7 @@ private:
 
     // Viewport
     int scroll_y = 0;
+    int prefetch_scroll_y = -1; // scroll_y when a paged file was last prefetched
 
     // Screen reference for exiting
     ftxui::ScreenInteractive* screen = nullptr;
@@ -68,12 +78,48 @@ private:
     CursorManager cursor_manager;           // Cursor movement
     UndoRedoManager undo_redo_manager;      // History management
     FormatManager format_manager;           // Formatting state (bold, italic, etc.)
+    FormatSpanIndex format_spans;           // Formatting spans of lines, for the renderer, cursor and selection
     FileManager file_manager;               // File I/O operations
     InputManager input_manager;             // Keyboard/mouse input dispatch
     ConfigManager config_manager;           // Config persistence (theme mode)
 
+    // Save running in the background, declared after the buffer and
+    // file_manager so it is finished before they go away
+    std::unique_ptr<SaveJob> save_job;
+    uint64_t save_edit_count = 0;           // buffer.edit_count() when the save started
+
+    // Reports changes other programs make to the file, null outside run()
+    std::unique_ptr<FileWatcher> file_watcher;
+
+    // --follow: the file is read-only and grows as lines are appended to it.
+    // Takes the place of file_watcher, null outside run().
+    bool follow_mode = false;
+    size_t follow_max_lines = 0;            // Lines kept, the oldest are dropped (0: all)
+    size_t follow_dropped = 0;              // Lines dropped since the buffer was last compacted
+    bool follow_started = false;            // Has the buffer got the first lines of the file
+    std::unique_ptr<LogFollower> log_follower;
+
     // ===== File Operations =====
     void load_file();
+    /// @brief False (with a status message) while the file is still being loaded
+    bool check_editable();
+    /// @brief False (with a status message) while a save is running
+    bool check_not_saving();
+    /// @brief False (with a status message) if the buffer shows a mix of the old and the rewritten file
+    bool check_not_rewritten();
+    /// @brief Pick up the result of a finished background save
+    /// @param wait Wait for a save that is still running
+    void poll_save(bool wait);
+    /// @brief (Re)start watching `filename` for outside changes
+    void watch_file();
+    /// @brief Pick up a change of the file on disk: reload, or ask if there are unsaved changes
+    void poll_file_change();
+    /// @brief Append the lines the follower read, dropping the oldest past follow_max_lines
+    void poll_follow();
+    /// @brief Take over the file's saved undo history, once the file is indexed
+    void restore_history();
+    /// @brief Save the undo history for the next session, if the file on disk is what the buffer holds
+    void save_history();
 
 public:
     // ===== Undo grouping state (public so InputManager can access) =====
@@ -87,6 +133,10 @@ public:
     // ===== Public methods accessible by InputManager =====
     void save_file();
     void save_file_with_privilege();
+    /// @brief Make the buffer match the file on disk, replacing only the lines that differ
+    void reload_from_disk();
+    /// @brief The user declined reloading the changed file
+    void keep_buffer_after_file_change();
     void rename_file(const std::string& new_filename);
     void set_status(const std::string& message, StatusBarType type = StatusBarType::NORMAL);
     void screen_reset();
@@ -100,11 +150,11 @@ public:
     void select_all();
     void delete_selection_if_active();
     std::string get_selected_text() const;
-    bool is_char_selected(int x, int y) const;
 
     // Clipboard
     void copy_to_system_clipboard();
     void paste_from_system_clipboard();
+    void paste_text(const std::string& text);   // Pasted through the terminal
     void cut_to_system_clipboard();
 
     void insert_char(char c);
@@ -133,6 +183,14 @@ public:
     void save_state();
     void undo();
     void redo();
+    /// @brief Where the undo tree is, for the F3 prompt
+    std::string undo_state_summary() const;
+    /// @brief Memory saved by compressing cold undo entries, and the slowest decompression
+    std::string compression_summary() const;
+    /// @brief Size and time of the decompression an undo/redo did, if it did one
+    std::string decompression_note(size_t decompressions_before) const;
+    /// @brief Go to an undo state on any branch: "#n" / "n" (node number), or "-10m" (as of 10 minutes ago, s/m/h)
+    void jump_to_undo_state(const std::string& target);
 
     // Additional editor helper methods (refactor inputs)
     void insert_line_above();
@@ -155,6 +213,8 @@ private:
     int find_word_start(int x, int y);
     int find_word_end(int x, int y);
     void ensure_cursor_visible(int screen_height);
+    /// @brief Page in the text past the screen in the scroll direction (paged files only)
+    void prefetch_ahead(int screen_height);
     void clamp_cursor_and_scroll();
     std::tuple<std::function<void()>, std::function<void()>> get_selection_callbacks();
 
@@ -167,7 +227,7 @@ private:
     // Getters (note to self: C++ doesn't have properties like C#)
     // 'const &' returns reference without copying (not to self: like 'ref readonly' in C#)
     // Trailing 'const' means method doesn't modify object
-    const std::vector<std::string>& get_buffer() const { return buffer; }
+    const TextBuffer& get_buffer() const { return buffer; }
 
 public:
     bool is_modified() const { return modified; }
@@ -1,31 +1,171 @@
 #include <file_manager.hpp>
 #include <fstream>
+#include <iterator>
+#include <vector>
 #include <cerrno>
 #include <cstring>
 #include <sys/stat.h>
 #include <libgen.h>
 #include <cstdlib>
+#include <climits>
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <csignal>
+#include <cstdio>
+#include <sys/wait.h>
+#include <mapped_file.hpp>
+#include <batch_writer.hpp>
 
-FileOperationResult FileManager::load_file(const std::string& filename, std::vector<std::string>& buffer) {
-    buffer.clear();
+namespace {
 
-    std::ifstream ifs(filename);
-    if (!ifs) {
+/// @brief Write the document to fd, false (errno set) on failure
+bool write_lines(int fd, const SaveJob::Blocks& blocks, const SaveJob::Progress& progress) {
+    // Long runs of unedited file lines go straight from the original buffer
+    // to the file, everything is gathered into few writev() calls
+    BatchWriter writer(fd);
+    size_t reported = 0;
+    for (std::string_view block : blocks) {
+        if (!writer.add(block)) return false;
+        if (progress && writer.bytes_written() != reported) {
+            reported = writer.bytes_written();
+            progress(reported);
+        }
+    }
+    if (!writer.flush()) return false;
+    if (progress) progress(writer.bytes_written());
+    return true;
+}
+
+/// @brief Run `args` (looked up in PATH) with `blocks` on its stdin and stdout on /dev/null
+/// @param write_error errno of a failed write to the process, 0 if all of it went in
+/// @return Wait status of the process, -1 (errno set) if it couldn't be started
+int pipe_to_process(const std::vector<std::string>& args, const SaveJob::Blocks& blocks, int& write_error) {
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    write_error = 0;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+
+    // A process that quits early must not kill us with SIGPIPE, the write
+    // fails with EPIPE instead. The child gets the default action back.
+    struct sigaction ignore {}, previous {};
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, &previous);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &default_signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int spawn_error = posix_spawnp(&pid, argv[0], &actions, &attributes, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    close(fds[0]);
+
+    int status = -1;
+    if (spawn_error == 0) {
+        if (!write_lines(fds[1], blocks, nullptr)) write_error = errno;
+        close(fds[1]); // EOF for the process
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    } else {
+        close(fds[1]);
+    }
+
+    sigaction(SIGPIPE, &previous, nullptr);
+    errno = spawn_error;
+    return status;
+}
+
+void create_parent_directory(const std::string& filename) {
+    char* filename_copy = strdup(filename.c_str());
+    char* dir = dirname(filename_copy);
+    mkdir(dir, 0755);
+    free(filename_copy);
+}
+
+/// @brief Make a rename (or file creation) in the directory of `path` durable
+bool sync_directory(const std::string& path) {
+    std::string path_copy = path;
+    int fd = open(dirname(path_copy.data()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    int result = fsync(fd);
+    int err = errno;
+    close(fd);
+    errno = err;
+    return result == 0;
+}
+
+/// @brief Files from this size on are loaded paged - their full line table
+/// (a few dozen bytes per line) would take a large share of the memory
+size_t paged_load_threshold() {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) return size_t{4} << 30;
+    return static_cast<size_t>(pages) * static_cast<size_t>(page_size) / 8;
+}
+
+} // namespace
+
+FileOperationResult FileManager::load_file(const std::string& filename, TextBuffer& buffer, size_t first_lines) {
+    // Map the file (O(1), nothing is read yet) and build the line index in
+    // the background, apart from the first lines asked for
+    MappedFile mapped;
+    if (mapped.open(filename)) {
+        const bool paged = mapped.size() >= paged_load_threshold();
+        buffer.load(std::move(mapped), first_lines, paged);
+        return FileOperationResult(true);
+    }
+
+    // Not mappable (empty file, pipe, procfs...) - read it instead
+    std::string contents;
+    if (!read_file(filename, contents).success) {
         // File doesn't exist - start with empty buffer
-        buffer.push_back("");
+        buffer.clear();
         return FileOperationResult(false, "File not found, new file created: \"" + filename + "\"", 0, StatusBarType::WARNING); // Not an error, just a new file
     }
 
-    std::string line;
-    while (std::getline(ifs, line)) {
-        buffer.push_back(line);
-    }
+    // The contents become the read-only original buffer
+    buffer.load(std::move(contents));
+    return FileOperationResult(true);
+}
 
-    if (buffer.empty()) {
-        buffer.push_back("");
+FileOperationResult FileManager::read_file(const std::string& filename, std::string& contents) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        int err = errno;
+        return FileOperationResult(false, "Could not read file! (" + std::string(strerror(err)) + ")", err, StatusBarType::ERROR);
     }
 
+    // Read the whole file in one go
+    contents.clear();
+    ifs.seekg(0, std::ios::end);
+    std::streamoff size = ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    if (size > 0) {
+        // No zero-fill pass over the buffer, it is overwritten by the read anyway
+        contents.resize_and_overwrite(static_cast<size_t>(size), [&ifs](char* data, size_t length) {
+            ifs.read(data, static_cast<std::streamsize>(length));
+            return static_cast<size_t>(ifs.gcount());
+        });
+    } else {
+        // Size unknown (pipe, procfs...) - fall back to reading until EOF
+        ifs.clear();
+        contents.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
     return FileOperationResult(true);
 }
 
@@ -51,15 +191,102 @@ std::string FileManager::get_privilege_tool() {
     return tool;
 }
 
-FileOperationResult FileManager::save_file(const std::string& filename, const std::vector<std::string>& buffer) {
-    // Create directory if needed
-    char* filename_copy = strdup(filename.c_str());
-    char* dir = dirname(filename_copy);
-    mkdir(dir, 0755);
-    free(filename_copy);
+int FileManager::replace_file(const std::string& filename, const SaveJob::Blocks& blocks, const SaveJob::Progress& progress) {
+    // Follow a symlink, the link itself must stay
+    std::string target = filename;
+    char resolved[PATH_MAX];
+    if (realpath(filename.c_str(), resolved) != nullptr) {
+        target = resolved;
+    }
+
+    struct stat st;
+    bool exists = stat(target.c_str(), &st) == 0;
+    if (exists && st.st_nlink > 1) {
+        return -1; // Renaming would split the hard links apart
+    }
+    // A file we may not write is not replaced either - in place it fails with
+    // EACCES and the user is asked about saving with privileges
+    if (exists && access(target.c_str(), W_OK) != 0) {
+        return -1;
+    }
+
+    std::string temp_file = target + ".bznota-XXXXXX";
+    int fd = mkstemp(temp_file.data());
+    if (fd < 0) return -1;
+
+    // Give the new file the old one's permissions and owner - someone else's
+    // file we can't give back is written in place instead, it stays theirs
+    if (exists) {
+        fchmod(fd, st.st_mode & 07777);
+        if (fchown(fd, st.st_uid, st.st_gid) != 0 && st.st_uid != geteuid()) {
+            close(fd);
+            std::remove(temp_file.c_str());
+            return -1;
+        }
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    // Durable: the data is on disk before the rename makes it the file, and
+    // the rename itself is on disk before we report success
+    const bool durable = durability_ == SaveDurability::DURABLE;
+    int err = 0;
+    if (!write_lines(fd, blocks, progress)) err = errno;
+    if (err == 0 && durable && fsync(fd) != 0) err = errno;
+    if (close(fd) != 0 && err == 0) err = errno;
+    if (err == 0 && std::rename(temp_file.c_str(), target.c_str()) != 0) err = errno;
+    if (err != 0) {
+        std::remove(temp_file.c_str());
+        return err;
+    }
+    if (durable && !sync_directory(target)) return errno;
+    return 0;
+}
+
+FileOperationResult FileManager::save_file(const std::string& filename, TextBuffer& buffer) {
+    create_parent_directory(filename);
+
+    // Write a new file and rename it over the old one, the old contents stay
+    // readable for a buffer that still maps them
+    return save_result(filename, buffer, replace_file(filename, buffer.text_blocks(), nullptr));
+}
+
+std::unique_ptr<SaveJob> FileManager::start_save(const std::string& filename, TextBuffer& buffer, std::function<void()> listener) {
+    create_parent_directory(filename);
+
+    return std::make_unique<SaveJob>(buffer.text_blocks(),
+        [this, filename](const SaveJob::Blocks& blocks, const SaveJob::Progress& progress) {
+            return replace_file(filename, blocks, progress);
+        },
+        std::move(listener));
+}
+
+FileOperationResult FileManager::finish_save(const std::string& filename, const SaveJob& job, TextBuffer& buffer) {
+    return save_result(filename, buffer, job.result());
+}
 
-    std::ofstream ofs(filename);
-    if (!ofs) {
+FileOperationResult FileManager::save_result(const std::string& filename, TextBuffer& buffer, int replace_error) {
+    if (replace_error == 0) {
+        return FileOperationResult(true, "File saved successfully", 0, StatusBarType::SUCCESS);
+    }
+    if (replace_error > 0) {
+        return FileOperationResult(false, "I/O error while saving file! (" + std::string(strerror(replace_error)) + ")", replace_error, StatusBarType::ERROR);
+    }
+    return save_in_place(filename, buffer);
+}
+
+FileOperationResult FileManager::save_in_place(const std::string& filename, TextBuffer& buffer) {
+    // No new file possible next to it (directory not writable, hard links...) -
+    // overwrite in place, which pulls a mapped original into memory first.
+    // A paged file doesn't fit in memory, it can only be replaced.
+    if (buffer.is_paged()) {
+        return FileOperationResult(false, "Large file can't be overwritten in place, no temp file possible next to it!", 0, StatusBarType::ERROR);
+    }
+    buffer.detach_original();
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
         int err = errno;
         std::string error_msg;
         StatusBarType status_type = StatusBarType::ERROR;
@@ -83,68 +310,55 @@ FileOperationResult FileManager::save_file(const std::string& filename, const st
         return FileOperationResult(false, error_msg, err, status_type);
     }
 
-    // Write all lines to file
-    for (const auto& line : buffer) {
-        ofs << line << '\n';
-    }
-
-    // Check for I/O errors AFTER writing
-    if (!ofs.good()) {
-        return FileOperationResult(false, "I/O error while saving file!", 0, StatusBarType::ERROR);
+    // Write all lines to file, check for I/O errors AFTER writing
+    int err = 0;
+    if (!write_lines(fd, buffer.text_blocks(), nullptr)) err = errno;
+    if (err == 0 && durability_ == SaveDurability::DURABLE && fsync(fd) != 0) err = errno;
+    if (close(fd) != 0 && err == 0) err = errno;
+    if (err != 0) {
+        return FileOperationResult(false, "I/O error while saving file! (" + std::string(strerror(err)) + ")", err, StatusBarType::ERROR);
     }
 
     return FileOperationResult(true, "File saved successfully", 0, StatusBarType::SUCCESS);
 }
 
-std::string FileManager::shell_quote(const std::string& path) {
-    std::string result = "'";
-    for (char c : path) {
-        if (c == '\'') result += "'\\''"; // Close, escape, reopen
-        else result += c;
-    }
-    return result + "'";
-}
-
-FileOperationResult FileManager::save_file_with_privilege(const std::string& filename, const std::vector<std::string>& buffer, bool interactive) {
-    char pid_str[32];
-    snprintf(pid_str, sizeof(pid_str), "%d", static_cast<int>(getpid()));
-    std::string temp_file = "/tmp/bznota_priv_" + std::string(pid_str) + ".tmp";
-
-    {
-        std::ofstream temp_ofs(temp_file);
-        if (!temp_ofs) {
-            return FileOperationResult(false, "Failed to create temp file for privilege save!", 0, StatusBarType::ERROR);
-        }
-        for (const auto& line : buffer) {
-            temp_ofs << line << '\n';
-        }
+FileOperationResult FileManager::save_file_with_privilege(const std::string& filename, TextBuffer& buffer, bool interactive) {
+    // tee overwrites the file in place, which a paged buffer can't survive (see save_file)
+    if (buffer.is_paged()) {
+        return FileOperationResult(false, "Large file can't be overwritten in place with " + get_privilege_tool() + "!", 0, StatusBarType::ERROR);
     }
 
     std::string tool = get_privilege_tool();
 
-    std::string safe_file = shell_quote(filename);
-    std::string safe_temp = shell_quote(temp_file);
+    // tee overwrites the file in place, the buffer must not map it anymore
+    buffer.detach_original();
 
     // check for cached privilege, if cached bypass the interactive prompt
-    int result;
+    std::vector<std::string> args{tool};
     if (interactive && !privilege_is_cached()) {
-        std::string cmd = "printf '\\033[2J\\033[H'; printf '\\nRequesting privilege access to save: " +
-            filename + "\\n\\n'; " + tool + " tee " + safe_file + " > /dev/null < " + safe_temp;
-        result = system(cmd.c_str());
+        std::string banner = "\033[2J\033[H\nRequesting privilege access to save: " + filename + "\n\n";
+        std::fputs(banner.c_str(), stdout);
+        std::fflush(stdout);
     } else { // Only for sudo
-        std::string cmd = tool + " -n tee " + safe_file + " > /dev/null < " + safe_temp;
-        result = system(cmd.c_str());
+        args.push_back("-n");
     }
-    std::remove(temp_file.c_str());
+    args.insert(args.end(), {"tee", "--", filename});
 
-    if (result == -1) { // fail of shell execution, example: out of memory!
-        return FileOperationResult(false, "Failed to execute shell command", -1, StatusBarType::ERROR);
+    // The document goes straight into tee's stdin, no shell and no temp file
+    int write_error = 0;
+    int status = pipe_to_process(args, buffer.text_blocks(), write_error);
+
+    if (status == -1) { // Couldn't start it, example: out of memory!
+        return FileOperationResult(false, "Failed to run " + tool + "! (" + std::string(strerror(errno)) + ")", -1, StatusBarType::ERROR);
     }
 
-    int exit_code = WEXITSTATUS(result);
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
     if (exit_code != 0) {
         return FileOperationResult(false, tool + " save failed!", exit_code, StatusBarType::ERROR);
     }
+    if (write_error != 0) {
+        return FileOperationResult(false, "I/O error while saving file! (" + std::string(strerror(write_error)) + ")", write_error, StatusBarType::ERROR);
+    }
 
     return FileOperationResult(true, "File saved with " + tool, 0, StatusBarType::SUCCESS);
 }
@@ -1,7 +1,10 @@
 #pragma once
 #include <string>
-#include <vector>
 #include <shared_types.hpp>
+#include <text_buffer.hpp>
+#include <save_job.hpp>
+#include <memory>
+#include <functional>
 
 /// @brief Result structure for file operations
 struct FileOperationResult {
@@ -20,22 +23,55 @@ public:
     FileManager() = default;
     ~FileManager() = default;
 
+    /// @brief Whether saves fsync the file and its directory (see SaveDurability)
+    void set_save_durability(SaveDurability mode) { durability_ = mode; }
+
     /// @brief Load file contents into buffer
     /// @param filename Path to file to load
     /// @param buffer Output buffer to fill with file contents
+    /// @param first_lines Lines to index before returning, the rest of a large
+    ///                    file is indexed in the background (0: index nothing
+    ///                    up front - a file over 1 MB is all indexed there)
     /// @return Result indicating success or failure
-    [[nodiscard]] FileOperationResult load_file(const std::string& filename, std::vector<std::string>& buffer);
+    [[nodiscard]] FileOperationResult load_file(const std::string& filename, TextBuffer& buffer, size_t first_lines);
+
+    /// @brief Read a whole file into memory
+    /// @param contents Output, the raw file bytes
+    [[nodiscard]] FileOperationResult read_file(const std::string& filename, std::string& contents);
 
     /// @brief Save buffer contents to file
     /// @param filename Path to file to save
-    /// @param buffer Buffer containing lines to save
+    /// @param buffer Buffer containing lines to save (a mapped original may be copied into memory)
     /// @return Result indicating success or failure
-    [[nodiscard]] FileOperationResult save_file(const std::string& filename, const std::vector<std::string>& buffer);
+    [[nodiscard]] FileOperationResult save_file(const std::string& filename, TextBuffer& buffer);
+
+    /// @brief Start saving the buffer on a worker thread, it may be edited meanwhile
+    /// The file gets the buffer contents as of this call. Until the job is
+    /// finished the buffer must not be reloaded, cleared or detached.
+    /// @param listener Called on the worker thread as the save progresses (see SaveJob)
+    std::unique_ptr<SaveJob> start_save(const std::string& filename, TextBuffer& buffer, std::function<void()> listener);
+
+    /// @brief Result of a background save, once the job is done
+    /// If no temp file was possible the buffer (in its current state) is
+    /// saved in place right here, as save_file() would.
+    [[nodiscard]] FileOperationResult finish_save(const std::string& filename, const SaveJob& job, TextBuffer& buffer);
 
     [[nodiscard]] FileOperationResult rename_file(const std::string& old_filename, const std::string& new_filename);
 
-    [[nodiscard]] FileOperationResult save_file_with_privilege(const std::string& filename, const std::vector<std::string>& buffer, bool interactive = true);
+    [[nodiscard]] FileOperationResult save_file_with_privilege(const std::string& filename, TextBuffer& buffer, bool interactive = true);
     bool privilege_is_cached();
     static std::string get_privilege_tool();
-    std::string shell_quote(const std::string& path);
+
+private:
+    /// @brief Write the buffer to a new file and rename it over `filename`
+    /// @return 0 on success, -1 if no new file could be created (nothing was
+    ///         changed then), otherwise the errno of the failed write or rename
+    int replace_file(const std::string& filename, const SaveJob::Blocks& blocks, const SaveJob::Progress& progress);
+
+    /// @brief Turn replace_file()'s result into the save result, saving in place if it couldn't
+    FileOperationResult save_result(const std::string& filename, TextBuffer& buffer, int replace_error);
+    /// @brief Overwrite the file instead of replacing it
+    FileOperationResult save_in_place(const std::string& filename, TextBuffer& buffer);
+
+    SaveDurability durability_ = SaveDurability::DURABLE;
 };
@@ -0,0 +1,105 @@
+#include <file_watcher.hpp>
+#include <filesystem>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher(const std::string& filename, std::function<void()> listener)
+    : listener_(std::move(listener)) {
+    // Follow a symlink, it's the target that gets written
+    path_ = filename;
+    char resolved[PATH_MAX];
+    if (realpath(filename.c_str(), resolved) != nullptr) {
+        path_ = resolved;
+    }
+    const std::filesystem::path path(path_);
+    name_ = path.filename().string();
+    std::string directory = path.parent_path().string();
+    if (directory.empty()) directory = ".";
+
+    mark_synced();
+
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || wake_fd_ < 0) return;
+    // Written and closed, or renamed into place
+    if (inotify_add_watch(inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) return;
+
+    worker_ = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher() {
+    if (worker_.joinable()) {
+        const uint64_t wake = 1;
+        [[maybe_unused]] ssize_t written = write(wake_fd_, &wake, sizeof(wake));
+        worker_.join();
+    }
+    if (inotify_fd_ >= 0) close(inotify_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+}
+
+bool FileWatcher::Stamp::operator==(const Stamp& other) const {
+    return exists == other.exists && device == other.device && inode == other.inode && size == other.size &&
+           modified.tv_sec == other.modified.tv_sec && modified.tv_nsec == other.modified.tv_nsec;
+}
+
+FileWatcher::Stamp FileWatcher::stamp() const {
+    Stamp result;
+    struct stat st;
+    if (stat(path_.c_str(), &st) == 0) {
+        result.exists = true;
+        result.device = st.st_dev;
+        result.inode = st.st_ino;
+        result.size = st.st_size;
+        result.modified = st.st_mtim;
+    }
+    return result;
+}
+
+void FileWatcher::mark_synced() {
+    synced_ = stamp();
+}
+
+bool FileWatcher::take_change() {
+    if (!pending_.exchange(false)) return false;
+    // A deleted file leaves the buffer alone, it's saved back on the next save
+    const Stamp current = stamp();
+    return current.exists && !(current == synced_);
+}
+
+void FileWatcher::run() {
+    alignas(inotify_event) char events[4096];
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[1].revents != 0) return;
+
+        ssize_t length = read(inotify_fd_, events, sizeof(events));
+        if (length <= 0) continue;
+
+        // Events for the other files in the directory are skipped
+        bool changed = false;
+        for (ssize_t offset = 0; offset < length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(events + offset);
+            if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && name_ == event->name)) {
+                changed = true;
+            }
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        }
+
+        if (changed) {
+            pending_.store(true);
+            if (listener_) listener_();
+        }
+    }
+}
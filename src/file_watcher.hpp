@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <ctime>
+#include <sys/types.h>
+
+/// @brief Watches one file for changes made by other programs (inotify)
+///
+/// The directory is watched rather than the file, so a file that is replaced
+/// by a rename (the way most editors save, this one included) or created
+/// later is still seen. A worker thread waits for the events and calls the
+/// listener. What counts as a change is decided on the owner's thread: the
+/// file must differ (inode, size or modification time) from the version
+/// marked as synced, so the editor's own saves don't count.
+class FileWatcher {
+public:
+    /// @brief Start watching `filename`, which need not exist yet
+    /// @param listener Called on the worker thread when the file may have changed
+    FileWatcher(const std::string& filename, std::function<void()> listener);
+    /// @brief Stops the worker and waits for it
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /// @brief False if inotify isn't available, nothing is reported then
+    bool is_active() const { return worker_.joinable(); }
+
+    /// @brief Take the file as it is on disk now as the version the buffer matches
+    void mark_synced();
+
+    /// @brief Did the file change since mark_synced()? Takes the pending notification
+    bool take_change();
+
+private:
+    /// @brief What tells two versions of the file apart without reading it
+    struct Stamp {
+        bool exists = false;
+        dev_t device = 0;
+        ino_t inode = 0;
+        off_t size = 0;
+        timespec modified{};
+
+        bool operator==(const Stamp& other) const;
+    };
+
+    Stamp stamp() const;
+    void run();
+
+    std::string path_;                     // The file, symlinks resolved
+    std::string name_;                     // Its name in the watched directory
+    std::function<void()> listener_;
+    Stamp synced_;                         // Owner's thread only
+    int inotify_fd_ = -1;
+    int wake_fd_ = -1;                     // Written to stop the worker
+    std::atomic<bool> pending_{false};
+    std::thread worker_;                   // Last, starts after everything above exists
+};
@@ -47,29 +47,29 @@ std::string FormatManager::get_closing_markers() const {
     return markers;
 }
 
-void FormatManager::start_formatting_session(std::vector<std::string>& buffer, int& cursor_x, int cursor_y) {
+void FormatManager::start_formatting_session(TextBuffer& buffer, int& cursor_x, int cursor_y) {
     if (!has_active_formatting() || session_active) {
         return;
     }
 
     std::string markers = get_opening_markers();
-    buffer[cursor_y].insert(cursor_x, markers);
+    buffer.insert_text(cursor_y, cursor_x, markers);
     cursor_x += markers.length();
     session_active = true;
 }
 
-void FormatManager::end_formatting_session(std::vector<std::string>& buffer, int& cursor_x, int cursor_y) {
+void FormatManager::end_formatting_session(TextBuffer& buffer, int& cursor_x, int cursor_y) {
     if (!session_active) {
         return;
     }
 
     std::string markers = get_closing_markers();
-    buffer[cursor_y].insert(cursor_x, markers);
+    buffer.insert_text(cursor_y, cursor_x, markers);
     cursor_x += markers.length();
     session_active = false;
 }
 
-void FormatManager::insert_formatting_markers(std::vector<std::string>& buffer, int& cursor_x, int cursor_y) {
+void FormatManager::insert_formatting_markers(TextBuffer& buffer, int& cursor_x, int cursor_y) {
     if (!has_active_formatting()) {
         return;
     }
@@ -78,14 +78,14 @@ void FormatManager::insert_formatting_markers(std::vector<std::string>& buffer,
     std::string closing = get_closing_markers();
 
     // Insert both markers at cursor position
-    buffer[cursor_y].insert(cursor_x, opening + closing);
+    buffer.insert_text(cursor_y, cursor_x, opening + closing);
     // Move cursor to between the markers
     cursor_x += opening.length();
 }
 
-void FormatManager::split_formatting_at_cursor(std::vector<std::string>& buffer, int& cursor_x, int cursor_y, FormatType format_type) {
-    if (cursor_y >= (int)buffer.size()) return;
-    std::string& line = buffer[cursor_y];
+void FormatManager::split_formatting_at_cursor(TextBuffer& buffer, int& cursor_x, int cursor_y, FormatType format_type) {
+    if (cursor_y >= (int)buffer.line_count()) return;
+    std::string_view line = buffer.line(cursor_y);
     if (cursor_x < 0 || cursor_x > (int)line.length()) return;
 
     std::string opening_marker, closing_marker;
@@ -107,7 +107,7 @@ void FormatManager::split_formatting_at_cursor(std::vector<std::string>& buffer,
 
     // Insert closing marker before cursor and opening marker after cursor
     // Insert in reverse order to not mess up positions
-    line.insert(cursor_x, closing_marker + opening_marker);
+    buffer.insert_text(cursor_y, cursor_x, closing_marker + opening_marker);
     cursor_x += closing_marker.length();
 }
 
@@ -1,7 +1,7 @@
 #pragma once
 #include <string>
-#include <vector>
 #include <shared_types.hpp>
+#include <text_buffer.hpp>
 
 /// @brief Manages text formatting state (bold, italic, underline, strikethrough, bullets)
 class FormatManager {
@@ -96,7 +96,7 @@ public:
     /// @param cursor_x Cursor X position (will be modified)
     /// @param cursor_y Cursor Y position
     /// @param format_type "bold", "italic", "underline", or "strikethrough"
-    void split_formatting_at_cursor(std::vector<std::string>& buffer, int& cursor_x, int cursor_y, FormatType format_type);
+    void split_formatting_at_cursor(TextBuffer& buffer, int& cursor_x, int cursor_y, FormatType format_type);
 
     // ===== Session Management =====
 
@@ -104,19 +104,19 @@ public:
     /// @param buffer The text buffer
     /// @param cursor_x Cursor X position (will be modified)
     /// @param cursor_y Cursor Y position
-    void start_formatting_session(std::vector<std::string>& buffer, int& cursor_x, int cursor_y);
+    void start_formatting_session(TextBuffer& buffer, int& cursor_x, int cursor_y);
 
     /// @brief End the current formatting session (inserts closing markers)
     /// @param buffer The text buffer
     /// @param cursor_x Cursor X position (will be modified)
     /// @param cursor_y Cursor Y position
-    void end_formatting_session(std::vector<std::string>& buffer, int& cursor_x, int cursor_y);
+    void end_formatting_session(TextBuffer& buffer, int& cursor_x, int cursor_y);
 
     /// @brief Insert both opening and closing markers, keeping cursor between them
     /// @param buffer The text buffer
     /// @param cursor_x Cursor X position (will be modified)
     /// @param cursor_y Cursor Y position
-    void insert_formatting_markers(std::vector<std::string>& buffer, int& cursor_x, int cursor_y);
+    void insert_formatting_markers(TextBuffer& buffer, int& cursor_x, int cursor_y);
 
 private:
     /// @brief Get the opening markers for currently active formatting
@@ -0,0 +1,113 @@
+#include <format_span_index.hpp>
+#include <algorithm>
+
+namespace {
+
+/// @brief A format (0-3, Formatter::Type) or marker (MARKER) starting or ending at pos
+struct Event {
+    int pos;
+    int8_t kind;
+    int8_t delta;
+};
+constexpr int8_t MARKER = 4;
+
+/// @brief Steps where the count of any kind changes, the first at 0
+std::vector<FormatSpans::Step> build_steps(std::vector<Event>& events) {
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.pos < b.pos; });
+    std::vector<FormatSpans::Step> steps{FormatSpans::Step{}};
+    int counts[MARKER + 1] = {};
+    for (size_t i = 0; i < events.size();) {
+        const int pos = events[i].pos;
+        for (; i < events.size() && events[i].pos == pos; i++) {
+            counts[events[i].kind] += events[i].delta;
+        }
+        FormatSpans::Step step{pos, 0, counts[MARKER] > 0};
+        for (int8_t kind = 0; kind < MARKER; kind++) {
+            if (counts[kind] > 0) step.formats |= uint8_t(1) << kind;
+        }
+        if (step.formats == steps.back().formats && step.marker == steps.back().marker) continue;
+        if (steps.back().begin == pos) {
+            steps.back() = step;
+        } else {
+            steps.push_back(step);
+        }
+    }
+    return steps;
+}
+
+/// @brief Step holding position pos
+const FormatSpans::Step& step_at(const std::vector<FormatSpans::Step>& steps, int pos) {
+    auto after = std::upper_bound(steps.begin(), steps.end(), pos,
+                                  [](int value, const FormatSpans::Step& step) { return value < step.begin; });
+    return after == steps.begin() ? steps.front() : *(after - 1);
+}
+
+} // namespace
+
+FormatSpans::FormatSpans(std::string_view line) : spans_(parse_formatters(line)) {
+    std::vector<Event> events, cursor_events;
+    events.reserve(spans_.size() * 6);
+    cursor_events.reserve(spans_.size() * 2);
+    max_end_.reserve(spans_.size());
+    for (const Formatter& span : spans_) {
+        const int8_t kind = static_cast<int8_t>(span.type);
+        events.push_back({span.content_start, kind, 1});
+        events.push_back({span.content_end, kind, -1});
+        events.push_back({span.start_index, MARKER, 1});
+        events.push_back({span.content_start, MARKER, -1});
+        events.push_back({span.content_end, MARKER, 1});
+        events.push_back({span.end_index, MARKER, -1});
+        cursor_events.push_back({span.content_start, kind, 1});
+        cursor_events.push_back({span.content_end + 1, kind, -1});
+        max_end_.push_back(std::max(max_end_.empty() ? 0 : max_end_.back(), span.end_index));
+    }
+    steps_ = build_steps(events);
+    cursor_steps_ = build_steps(cursor_events);
+}
+
+const FormatSpans::Step& FormatSpans::at(int pos) const {
+    return step_at(steps_, pos);
+}
+
+uint8_t FormatSpans::formats_at_cursor(int x) const {
+    return step_at(cursor_steps_, x).formats;
+}
+
+void FormatSpans::expand_range(int& start, int& end) const {
+    // Spans overlapping [start, end) start before `end` and end after `start`:
+    // the first of them is past the spans that all end by `start`
+    const size_t first = std::upper_bound(max_end_.begin(), max_end_.end(), start) - max_end_.begin();
+    const int range_start = start, range_end = end;
+    for (size_t i = first; i < spans_.size() && spans_[i].start_index < range_end; i++) {
+        const Formatter& span = spans_[i];
+        if (!span.overlaps_range(range_start, range_end)) continue;
+        start = std::min(start, span.start_index);
+        end = std::max(end, span.end_index);
+    }
+}
+
+const FormatSpans& FormatSpanIndex::line(const TextBuffer& buffer, size_t y) {
+    if (buffer.edit_count() != edit_count_ || buffer.line_count() != line_count_) {
+        by_line_.clear();
+        edit_count_ = buffer.edit_count();
+        line_count_ = buffer.line_count();
+    }
+    auto found = by_line_.find(y);
+    if (found != by_line_.end()) return *found->second;
+
+    const FormatSpans& spans = line(buffer.line(y), buffer.line_info(y).hash);
+    by_line_.emplace(y, &spans);
+    return spans;
+}
+
+const FormatSpans& FormatSpanIndex::line(std::string_view text, uint64_t hash) {
+    auto found = by_hash_.find(hash);
+    if (found != by_hash_.end()) return found->second;
+
+    if (by_hash_.size() >= MAX_LINES) {
+        by_hash_.clear();
+        by_line_.clear();
+    }
+    builds_++;
+    return by_hash_.emplace(hash, FormatSpans(text)).first->second;
+}
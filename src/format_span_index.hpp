@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <formatter.hpp>
+#include <text_buffer.hpp>
+
+/// @brief Formatting spans of one line (parse_formatters()), with lookups by position
+///
+/// The spans are turned into steps: positions where the formatting changes,
+/// each with the formats from there to the next step. A lookup is a binary
+/// search over the steps, O(log k) for k spans, whatever the line length.
+class FormatSpans {
+public:
+    /// @brief Formatting of the bytes from `begin` up to the next step
+    struct Step {
+        int begin = 0;
+        uint8_t formats = 0;    // bit() of each format whose content holds them
+        bool marker = false;    // Part of an opening or closing marker
+    };
+
+    /// @brief Flag of a format in Step::formats
+    static constexpr uint8_t bit(Formatter::Type type) { return uint8_t(1) << static_cast<int>(type); }
+
+    explicit FormatSpans(std::string_view line);
+
+    /// @brief The spans, sorted by start
+    const std::vector<Formatter>& spans() const { return spans_; }
+    /// @brief Steps of the bytes of the line, in order - the first begins at 0
+    const std::vector<Step>& steps() const { return steps_; }
+
+    /// @brief Formatting of byte pos
+    const Step& at(int pos) const;
+    /// @brief Formats the cursor at column x is in - from the start to the end
+    /// of a span's content, both included (right after "**" is in bold text)
+    uint8_t formats_at_cursor(int x) const;
+    bool is_inside_formatting(int x) const { return formats_at_cursor(x) != 0; }
+
+    /// @brief Widen [start, end) to take in the whole of every span it overlaps, markers included
+    void expand_range(int& start, int& end) const;
+
+private:
+    std::vector<Formatter> spans_;
+    std::vector<Step> steps_;
+    std::vector<Step> cursor_steps_;    // The same for cursor columns, content ends included
+    std::vector<int> max_end_;          // Furthest end_index of spans_[0..i]
+};
+
+/// @brief Formatting spans of the lines of a document, shared by everything that needs them
+///
+/// The renderer, the cursor (formatting at the cursor, typing inside markers)
+/// and the selection all look up a line's spans here instead of each scanning
+/// the line again. A line is parsed once per text: spans are kept by the
+/// line's LineInfo hash, and lines asked for again before the next edit are
+/// found by number without hashing them (versioned by TextBuffer::edit_count()).
+class FormatSpanIndex {
+public:
+    /// @brief Spans of line y of `buffer` - valid until the next call
+    const FormatSpans& line(const TextBuffer& buffer, size_t y);
+    /// @brief Spans of a line of text, given its LineInfo::hash - valid until the next call
+    const FormatSpans& line(std::string_view text, uint64_t hash);
+
+    /// @brief Lines parsed so far - the others were found in the index
+    size_t builds() const { return builds_; }
+
+private:
+    // Spans of this many line texts at most, all are dropped past it
+    static constexpr size_t MAX_LINES = 4096;
+
+    // Trusted without comparing the text: a 64-bit collision between two
+    // texts of visible lines only shows as wrong formatting
+    std::unordered_map<uint64_t, FormatSpans> by_hash_;
+
+    // Lines asked for by number at the current version of the document
+    std::unordered_map<size_t, const FormatSpans*> by_line_;
+    uint64_t edit_count_ = 0;
+    size_t line_count_ = 0;     // poll_index() adds lines without an edit
+
+    size_t builds_ = 0;
+};
@@ -1,222 +1,157 @@
 #include <formatter.hpp>
-#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
 
-std::vector<Formatter> parse_formatters(const std::string& line) {
-    std::vector<Formatter> formatters;
+#if defined(__x86_64__) || defined(__i386__)
+#define FORMATTER_X86 1
+#include <immintrin.h>
+#endif
 
-    // Find all bold regions **...**
-    size_t pos = 0;
-    while (pos < line.length()) {
-        pos = line.find("**", pos);
-        if (pos == std::string::npos) break;
-
-        // Make sure ** is not part of *** or more stars
-        // Check if preceded by * (making it ***)
-        if (pos > 0 && line[pos - 1] == '*') {
-            pos++;
-            continue;
-        }
-        // Check if followed by * (making it ***)
-        if (pos + 2 < line.length() && line[pos + 2] == '*') {
-            pos++;
-            continue;
-        }
-
-        size_t close_pos = pos + 2;
-        while (close_pos < line.length()) {
-            close_pos = line.find("**", close_pos);
-            if (close_pos == std::string::npos) break;
-
-            // Make sure closing ** is not part of *** or more
-            bool valid_closing = true;
-            if (close_pos > 0 && line[close_pos - 1] == '*') {
-                valid_closing = false;
-            }
-            if (close_pos + 2 < line.length() && line[close_pos + 2] == '*') {
-                valid_closing = false;
-            }
+namespace {
 
-            if (valid_closing) {
-                formatters.emplace_back(
-                    Formatter::Type::BOLD,
-                    pos,                    // start_index
-                    close_pos + 2,         // end_index (after closing **)
-                    pos + 2,               // content_start
-                    close_pos,             // content_end
-                    "**",
-                    "**"
-                );
-                pos = close_pos + 2;
-                break;
-            } else {
-                close_pos++;
-            }
-        }
+constexpr bool is_marker_byte(char c) {
+    return c == '*' || c == '~' || c == '<';
+}
 
-        if (close_pos == std::string::npos) {
-            pos += 2;
-        }
+#ifdef FORMATTER_X86
+
+// Both compare 64 bytes per step against the three marker bytes and return
+// the first marker found, or where the bytes left are too few for a step
+
+__attribute__((target("sse2")))
+size_t skip_to_marker_sse2(const char* data, size_t size, size_t pos) {
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i tilde = _mm_set1_epi8('~');
+    const __m128i less = _mm_set1_epi8('<');
+    for (; pos + 64 <= size; pos += 64) {
+        uint64_t mask = 0;
+        for (int part = 0; part < 4; part++) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + part * 16));
+            const __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, star), _mm_cmpeq_epi8(bytes, tilde)),
+                                               _mm_cmpeq_epi8(bytes, less));
+            mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(found))) << (part * 16);
+        }
+        if (mask != 0) return pos + std::countr_zero(mask);
     }
+    return pos;
+}
 
-    // Find all underline regions <u>...</u>
-    pos = 0;
-    while (pos < line.length()) {
-        pos = line.find("<u>", pos);
-        if (pos == std::string::npos) break;
-
-        size_t close_pos = line.find("</u>", pos + 3);
-        if (close_pos != std::string::npos) {
-            formatters.emplace_back(
-                Formatter::Type::UNDERLINE,
-                pos,                    // start_index
-                close_pos + 4,         // end_index (after closing </u>)
-                pos + 3,               // content_start
-                close_pos,             // content_end
-                "<u>",
-                "</u>"
-            );
-            pos = close_pos + 4;
-        } else {
-            pos += 3;
-        }
+__attribute__((target("avx2")))
+size_t skip_to_marker_avx2(const char* data, size_t size, size_t pos) {
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i tilde = _mm256_set1_epi8('~');
+    const __m256i less = _mm256_set1_epi8('<');
+    for (; pos + 64 <= size; pos += 64) {
+        uint64_t mask = 0;
+        for (int part = 0; part < 2; part++) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + part * 32));
+            const __m256i found = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, star), _mm256_cmpeq_epi8(bytes, tilde)),
+                _mm256_cmpeq_epi8(bytes, less));
+            mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(found))) << (part * 32);
+        }
+        if (mask != 0) return pos + std::countr_zero(mask);
     }
+    return pos;
+}
 
-    // Find all strikethrough regions ~~...~~
-    pos = 0;
-    while (pos < line.length()) {
-        pos = line.find("~~", pos);
-        if (pos == std::string::npos) break;
-
-        // Make sure ~~ is not part of ~~~ or more tildes
-        if (pos > 0 && line[pos - 1] == '~') {
-            pos++;
-            continue;
-        }
-        if (pos + 2 < line.length() && line[pos + 2] == '~') {
-            pos++;
-            continue;
+#endif
+
+/// @brief Position of the next '*', '~' or '<' from pos on, or the line length
+size_t next_marker_byte(std::string_view line, size_t pos) {
+#ifdef FORMATTER_X86
+    // Long lines - short ones are left to the word loop below
+    if (line.size() - pos >= 64) {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        pos = avx2 ? skip_to_marker_avx2(line.data(), line.size(), pos)
+                   : skip_to_marker_sse2(line.data(), line.size(), pos);
+        if (pos + 64 <= line.size()) return pos;
+    }
+#endif
+    if constexpr (std::endian::native == std::endian::little) {
+        // Eight bytes per step: a byte equal to c is a zero byte of word ^ c,
+        // which this sets the high bit of (exactly, no false matches)
+        constexpr uint64_t ONES = 0x0101010101010101ULL;
+        constexpr uint64_t LOW_BITS = 0x7F7F7F7F7F7F7F7FULL;
+        auto zero_bytes = [](uint64_t word) { return ~(((word & LOW_BITS) + LOW_BITS) | word | LOW_BITS); };
+        for (; pos + sizeof(uint64_t) <= line.size(); pos += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, line.data() + pos, sizeof(word));
+            const uint64_t found = zero_bytes(word ^ (ONES * '*')) | zero_bytes(word ^ (ONES * '~')) |
+                                   zero_bytes(word ^ (ONES * '<'));
+            if (found != 0) return pos + std::countr_zero(found) / 8;
         }
+    }
+    while (pos < line.size() && !is_marker_byte(line[pos])) pos++;
+    return pos;
+}
 
-        size_t close_pos = pos + 2;
-        while (close_pos < line.length()) {
-            close_pos = line.find("~~", close_pos);
-            if (close_pos == std::string::npos) break;
+} // namespace
 
-            // Make sure closing ~~ is not part of ~~~ or more
-            bool valid_closing = true;
-            if (close_pos > 0 && line[close_pos - 1] == '~') {
-                valid_closing = false;
-            }
-            if (close_pos + 2 < line.length() && line[close_pos + 2] == '~') {
-                valid_closing = false;
-            }
-
-            if (valid_closing) {
-                formatters.emplace_back(
-                    Formatter::Type::STRIKETHROUGH,
-                    pos,                    // start_index
-                    close_pos + 2,         // end_index (after closing ~~)
-                    pos + 2,               // content_start
-                    close_pos,             // content_end
-                    "~~",
-                    "~~"
-                );
-                pos = close_pos + 2;
-                break;
-            } else {
-                close_pos++;
-            }
-        }
+std::vector<Formatter> parse_formatters(std::string_view line) {
+    std::vector<Formatter> formatters;
 
-        if (close_pos == std::string::npos) {
-            pos += 2;
+    // Fast path - most lines have no marker characters at all
+    size_t pos = next_marker_byte(line, 0);
+    if (pos == line.length()) return formatters;
+
+    // One pass over the markers. A marker is a run of exactly two '*' (bold)
+    // or '~' (strikethrough), a lone '*' (italic) - longer runs are none of
+    // them - or <u> and </u>. Each type pairs its markers up in order, the
+    // types don't affect each other, so spans of different types may nest or
+    // cross. A span goes into the list when it opens, so the list comes out
+    // sorted by start; an end index of -1 marks it open still.
+    constexpr size_t NONE = static_cast<size_t>(-1);
+    size_t open[4] = {NONE, NONE, NONE, NONE};   // Open span of each Formatter::Type
+
+    auto marker = [&](Formatter::Type type, size_t at, size_t length, const char* start_symbol,
+                      const char* end_symbol) {
+        size_t& index = open[static_cast<int>(type)];
+        if (index == NONE) {
+            index = formatters.size();
+            formatters.emplace_back(type, at, -1, at + length, -1, start_symbol, end_symbol);
+        } else {
+            formatters[index].end_index = at + length;
+            formatters[index].content_end = at;
+            index = NONE;
         }
-    }
+    };
 
-    // Find all italic regions *...*  (but not **)
-    pos = 0;
     while (pos < line.length()) {
-        pos = line.find('*', pos);
-        if (pos == std::string::npos) break;
-
-        // Skip if it's part of ** or ***
-        if (pos + 1 < line.length() && line[pos + 1] == '*') {
-            pos += 2;
-            continue;
-        }
-        if (pos > 0 && line[pos - 1] == '*') {
-            pos++;
-            continue;
-        }
-
-        // Find closing *
-        size_t close_pos = pos + 1;
-        while (close_pos < line.length()) {
-            close_pos = line.find('*', close_pos);
-            if (close_pos == std::string::npos) break;
-
-            // Make sure it's not part of **
-            bool valid_closing = true;
-            if (close_pos + 1 < line.length() && line[close_pos + 1] == '*') {
-                valid_closing = false;
-            }
-            if (close_pos > 0 && line[close_pos - 1] == '*') {
-                valid_closing = false;
-            }
-
-            if (valid_closing) {
-                // Found valid closing *
-                formatters.emplace_back(
-                    Formatter::Type::ITALIC,
-                    pos,                    // start_index
-                    close_pos + 1,         // end_index (after closing *)
-                    pos + 1,               // content_start
-                    close_pos,             // content_end
-                    "*",
-                    "*"
-                );
-                pos = close_pos + 1;
-                break;
+        const char c = line[pos];
+        if (c == '<') {
+            const std::string_view rest = line.substr(pos);
+            if (rest.starts_with("<u>")) {
+                // Another <u> before the </u> is content
+                if (open[static_cast<int>(Formatter::Type::UNDERLINE)] == NONE) {
+                    marker(Formatter::Type::UNDERLINE, pos, 3, "<u>", "</u>");
+                }
+                pos += 3;
+            } else if (rest.starts_with("</u>")) {
+                if (open[static_cast<int>(Formatter::Type::UNDERLINE)] != NONE) {
+                    marker(Formatter::Type::UNDERLINE, pos, 4, "<u>", "</u>");
+                }
+                pos += 4;
             } else {
-                close_pos++;
+                pos++;
+            }
+        } else {
+            const size_t run_start = pos;
+            while (pos < line.length() && line[pos] == c) pos++;
+            const size_t run = pos - run_start;
+            if (c == '*' && run == 1) {
+                marker(Formatter::Type::ITALIC, run_start, 1, "*", "*");
+            } else if (c == '*' && run == 2) {
+                marker(Formatter::Type::BOLD, run_start, 2, "**", "**");
+            } else if (c == '~' && run == 2) {
+                marker(Formatter::Type::STRIKETHROUGH, run_start, 2, "~~", "~~");
             }
         }
-
-        if (close_pos == std::string::npos) {
-            pos++;
-        }
+        pos = next_marker_byte(line, pos);
     }
 
-    // Sort formatters by start position
-    std::sort(formatters.begin(), formatters.end(),
-        [](const Formatter& a, const Formatter& b) {
-            return a.start_index < b.start_index;
-        });
-
+    // Markers never closed are plain text
+    std::erase_if(formatters, [](const Formatter& formatter) { return formatter.end_index < 0; });
     return formatters;
 }
-
-void adjust_selection_bounds(const std::string& line, int& start, int& end) {
-    if (start < 0 || end < 0 || start >= (int)line.length()) return;
-
-    // Parse all formatters in the line
-    std::vector<Formatter> formatters = parse_formatters(line);
-
-    // Find all formatters that overlap with the selection
-    std::vector<const Formatter*> overlapping;
-    for (const auto& fmt : formatters) {
-        if (fmt.overlaps_range(start, end)) {
-            overlapping.push_back(&fmt);
-        }
-    }
-
-    // Expand selection to include all overlapping formatters completely
-    for (const auto* fmt : overlapping) {
-        if (fmt->start_index < start) {
-            start = fmt->start_index;
-        }
-        if (fmt->end_index > end) {
-            end = fmt->end_index;
-        }
-    }
-}
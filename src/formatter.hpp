@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
 /// @brief Represents a single formatting region with its markers and positions
@@ -42,12 +43,9 @@ struct Formatter {
 };
 
 /// @brief Parse formatting markers from a line of text
+///
+/// One pass over the line (see bench/format_bench), a line without '*', '~'
+/// or '<' is skipped over 64 bytes at a time.
 /// @param line The line to parse
-/// @return Vector of Formatter objects representing all formatting regions
-std::vector<Formatter> parse_formatters(const std::string& line);
-
-/// @brief Adjust selection bounds to include complete formatting regions
-/// @param line The line containing the selection
-/// @param start Selection start position (will be modified)
-/// @param end Selection end position (will be modified)
-void adjust_selection_bounds(const std::string& line, int& start, int& end);
+/// @return Vector of Formatter objects representing all formatting regions, sorted by start
+std::vector<Formatter> parse_formatters(std::string_view line);
@@ -0,0 +1,88 @@
+#include <gap_buffer.hpp>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+void GapBuffer::assign(std::string_view text) {
+    data_.assign(text);
+    data_.resize(text.size() + MIN_GAP);
+    gap_start_ = text.size();
+    gap_end_ = data_.size();
+    view_valid_ = false;
+}
+
+void GapBuffer::clear() {
+    data_.clear();
+    gap_start_ = 0;
+    gap_end_ = 0;
+    view_.clear();
+    view_valid_ = false;
+}
+
+void GapBuffer::move_gap(size_t pos) {
+    if (pos < gap_start_) {
+        // Shift [pos, gap_start) to the far side of the gap
+        const size_t count = gap_start_ - pos;
+        std::memmove(&data_[gap_end_ - count], &data_[pos], count);
+        gap_start_ -= count;
+        gap_end_ -= count;
+    } else if (pos > gap_start_) {
+        // Shift the bytes right after the gap down to its start
+        const size_t count = pos - gap_start_;
+        std::memmove(&data_[gap_start_], &data_[gap_end_], count);
+        gap_start_ += count;
+        gap_end_ += count;
+    }
+}
+
+void GapBuffer::reserve_gap(size_t length) {
+    if (gap_end_ - gap_start_ >= length) return;
+
+    // Grow geometrically so a run of inserts stays amortized O(1)
+    const size_t tail = data_.size() - gap_end_;
+    const size_t new_size = std::max(data_.size() * 2, size() + length + MIN_GAP);
+    data_.resize(new_size);
+    if (tail > 0) {
+        std::memmove(&data_[new_size - tail], &data_[gap_end_], tail);
+    }
+    gap_end_ = new_size - tail;
+}
+
+void GapBuffer::insert(size_t pos, std::string_view text) {
+    // The text may point into data_ itself, copy it before data_ can move
+    std::less<const char*> before;
+    if (!text.empty() && !before(text.data(), data_.data()) && before(text.data(), data_.data() + data_.size())) {
+        insert(pos, std::string(text));
+        return;
+    }
+
+    move_gap(pos);
+    reserve_gap(text.size());
+    std::memcpy(&data_[gap_start_], text.data(), text.size());
+    gap_start_ += text.size();
+    view_valid_ = false;
+}
+
+void GapBuffer::erase(size_t pos, size_t length) {
+    length = std::min(length, size() - pos);
+    move_gap(pos);
+    gap_end_ += length;
+    view_valid_ = false;
+}
+
+std::string_view GapBuffer::text() {
+    const size_t tail = data_.size() - gap_end_;
+    if (tail == 0) return std::string_view(data_.data(), gap_start_);
+    if (view_valid_) return view_;
+
+    // Closing the gap moves the tail now and again at the next edit there,
+    // a copy costs the whole line once per edit - whichever is less
+    if (2 * tail <= size()) {
+        move_gap(size());
+        return std::string_view(data_.data(), gap_start_);
+    }
+    view_.assign(data_, 0, gap_start_);
+    view_.append(data_, gap_end_, tail);
+    view_valid_ = true;
+    return view_;
+}
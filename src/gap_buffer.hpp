@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+/// @brief Byte buffer with a movable gap, used for the line currently being typed on
+///
+/// Text before and after the gap is stored contiguously, inserting or erasing at
+/// the gap is O(1) amortized. Edits elsewhere first move the gap there, which only
+/// copies the bytes in between - so typing in the middle of a 1 MB line no longer
+/// moves the whole tail on every key.
+///
+/// Reading the contents as one view doesn't move the gap back and forth: the
+/// first read after an edit copies it out, later ones reuse the copy until the
+/// next edit (unless the gap is at the end, or so close that closing it is cheaper).
+class GapBuffer {
+public:
+    /// @brief Replace the contents, the gap is placed at the end
+    void assign(std::string_view text);
+    void clear();
+
+    size_t size() const { return data_.size() - (gap_end_ - gap_start_); }
+
+    /// @brief Byte at logical position pos, does not move the gap
+    char at(size_t pos) const { return pos < gap_start_ ? data_[pos] : data_[pos + gap_end_ - gap_start_]; }
+
+    void insert(size_t pos, std::string_view text);
+    void erase(size_t pos, size_t length);
+
+    /// @brief Contiguous view of the contents
+    /// Valid until the next insert/erase.
+    std::string_view text();
+
+private:
+    /// @brief Move the gap so it starts at logical position pos
+    void move_gap(size_t pos);
+
+    /// @brief Make sure the gap can take `length` more bytes
+    void reserve_gap(size_t length);
+
+    static constexpr size_t MIN_GAP = 64;
+
+    std::string data_;
+    size_t gap_start_ = 0;
+    size_t gap_end_ = 0;
+
+    std::string view_;          // Copy of the contents for text(), while view_valid_
+    bool view_valid_ = false;
+};
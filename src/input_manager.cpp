@@ -39,6 +39,17 @@ bool InputManager::handle_event(Event event, Editor& editor, volatile sig_atomic
     // Currently ignore all mouse events
     if (event.is_mouse()) return true;
 
+    // Terminal paste (bracketed paste mode): the text arrives as ordinary key
+    // events between ESC[200~ and ESC[201~, it's gathered and inserted at once
+    if (is_pasting) return handle_paste_input(event, editor);
+    // (the prompts below take a paste as typed keys)
+    if (event.input() == BracketedPaste::BEGIN && !is_renaming && !is_jumping && !is_privilege_confirm &&
+        !is_reload_confirm) {
+        is_pasting = true;
+        paste_input.clear();
+        return true;
+    }
+
     // Reset status bar variables on every event
     editor.reset_status();
 
@@ -67,9 +78,15 @@ bool InputManager::handle_event(Event event, Editor& editor, volatile sig_atomic
     // Handle rename mode input
     if (is_renaming) return handle_rename_input(event, editor);
 
+    // Handle go-to-undo-state input
+    if (is_jumping) return handle_jump_input(event, editor);
+
     // Handle privilege confirm mode
     if (is_privilege_confirm) return handle_privilege_confirm_input(event, editor);
 
+    // Handle reload confirm mode
+    if (is_reload_confirm) return handle_reload_confirm_input(event, editor);
+
     // Handle function keys
     if (handle_fn_keys(event, editor)) return true;
 
@@ -136,7 +153,7 @@ bool InputManager::handle_fn_keys(ftxui::Event event, Editor& editor) {
     // F1: Help
     if (event == Event::F1) {
         //older version: "Fn Help: F1-Help, F2-Rename, F7-Editor Mode, F8-Dark/Light Mode", editor modes disabled
-        editor.set_status("Fn Help: F1-Help, F2-Rename, F8-Dark/Light Mode", StatusBarType::NORMAL);
+        editor.set_status("Fn Help: F1-Help, F2-Rename, F3-Go to undo state, F8-Dark/Light Mode", StatusBarType::NORMAL);
         return true;
     }
     // F2: Start rename mode
@@ -153,10 +170,19 @@ bool InputManager::handle_fn_keys(ftxui::Event event, Editor& editor) {
         rename_input = basename;
         editor.set_status("Rename file to: " + rename_input + " (Enter to confirm, Esc to cancel)", StatusBarType::WARNING);
         return true;
+    }
+    // F3: Go to an undo state
+    else if (event == Event::F3) {
+        is_jumping = true;
+        jump_input.clear();
+        editor.set_status("Go to undo state (" + editor.undo_state_summary() + "), #n or -10m: ", StatusBarType::WARNING);
+        return true;
     } else if (event == Event::F5) {
         // 1. Reset all 'locked' UI states
         is_renaming = false;
         rename_input = "";
+        is_jumping = false;
+        jump_input = "";
         is_confirming_overwrite = false;
         pending_rename_target = "";
 
@@ -288,6 +314,58 @@ bool InputManager::handle_rename_input(ftxui::Event event, Editor& editor) {
     return true;
 }
 
+bool InputManager::handle_jump_input(ftxui::Event event, Editor& editor) {
+    auto show_prompt = [&] {
+        editor.set_status("Go to undo state (" + editor.undo_state_summary() + "), #n or -10m: " + jump_input,
+                          StatusBarType::WARNING);
+    };
+
+    if (event == Event::Return) {
+        is_jumping = false;
+        editor.jump_to_undo_state(jump_input);
+        jump_input.clear();
+        return true;
+    }
+
+    if (event == Event::Escape) {
+        is_jumping = false;
+        jump_input.clear();
+        editor.set_status("Cancelled", StatusBarType::NORMAL);
+        return true;
+    }
+
+    if (event == Event::Backspace) {
+        if (!jump_input.empty()) jump_input.pop_back();
+        show_prompt();
+        return true;
+    }
+
+    if (event.is_character()) {
+        jump_input += event.input();
+        show_prompt();
+    }
+
+    // Ignore other keys while the prompt is open
+    return true;
+}
+
+bool InputManager::handle_paste_input(ftxui::Event event, Editor& editor) {
+    if (event.input() == BracketedPaste::END) {
+        is_pasting = false;
+        editor.paste_text(paste_input);
+        paste_input.clear();
+        return true;
+    }
+
+    // Line breaks come as Return ("\r"), tabs as Tab - other keys and escape
+    // sequences aren't text
+    const std::string& input = event.input();
+    if (event.is_character() || input == "\r" || input == "\n" || input == "\t") {
+        paste_input += input;
+    }
+    return true;
+}
+
 bool InputManager::handle_privilege_confirm_input(ftxui::Event event, Editor& editor) {
     if (event.is_character()) {
         std::string input = event.input();
@@ -311,6 +389,29 @@ bool InputManager::handle_privilege_confirm_input(ftxui::Event event, Editor& ed
     return true;
 }
 
+bool InputManager::handle_reload_confirm_input(ftxui::Event event, Editor& editor) {
+    if (event.is_character()) {
+        std::string input = event.input();
+        if (input == "y" || input == "Y") {
+            is_reload_confirm = false;
+            editor.reload_from_disk();
+            return true;
+        } else if (input == "n" || input == "N") {
+            is_reload_confirm = false;
+            editor.keep_buffer_after_file_change();
+            return true;
+        }
+    }
+
+    if (event == Event::Escape) {
+        is_reload_confirm = false;
+        editor.keep_buffer_after_file_change();
+        return true;
+    }
+
+    return true;
+}
+
 bool InputManager::handle_navigation_sequences(
     const std::string& input,
     Editor& editor,
@@ -24,6 +24,14 @@ namespace CtrlKey {
     constexpr unsigned char Z = 26;
 }
 
+/// @brief Bracketed paste mode: the terminal puts BEGIN and END around pasted text
+namespace BracketedPaste {
+    constexpr const char* ENABLE = "\x1b[?2004h";
+    constexpr const char* DISABLE = "\x1b[?2004l";
+    constexpr const char* BEGIN = "\x1b[200~";
+    constexpr const char* END = "\x1b[201~";
+}
+
 /// @brief Manages keyboard/mouse input events and dispatches to editor actions
 /// Similar to file_manager/undo_redo_manager pattern - takes editor state as parameters
 class InputManager {
@@ -48,12 +56,20 @@ public:
     /// @brief Enter privilege confirmation mode (called by Editor when save fails with EACCES)
     void start_privilege_confirm() { is_privilege_confirm = true; }
 
+    /// @brief Enter reload confirmation mode (called by Editor when a modified file changed on disk)
+    void start_reload_confirm() { is_reload_confirm = true; }
+
 private:
     bool is_renaming = false; // State for F2 rename operation
     std::string rename_input; // Buffer for F2 rename input
     bool is_confirming_overwrite = false; // State for overwrite confirmation
     std::string pending_rename_target; // Full path of pending rename target
     bool is_privilege_confirm = false; // State for privilege save confirmation
+    bool is_reload_confirm = false; // State for reload-from-disk confirmation
+    bool is_jumping = false; // State for F3 go-to-undo-state prompt
+    std::string jump_input; // Buffer for F3 input
+    bool is_pasting = false; // Between the terminal's bracketed paste markers
+    std::string paste_input; // Text pasted so far
 
     /// @brief Handle Ctrl+key combinations (Ctrl+C, Ctrl+V, Ctrl+S, etc.)
     bool handle_ctrl_keys(unsigned char ch, Editor& editor);
@@ -70,9 +86,18 @@ private:
     /// @brief Handle text input during rename mode (F2)
     bool handle_rename_input(ftxui::Event event, Editor& editor);
 
+    /// @brief Handle text input of the go-to-undo-state prompt (F3)
+    bool handle_jump_input(ftxui::Event event, Editor& editor);
+
+    /// @brief Collect the events of a bracketed paste, insert the text when it ends
+    bool handle_paste_input(ftxui::Event event, Editor& editor);
+
     /// @brief Handle privilege save confirmation (y/n)
     bool handle_privilege_confirm_input(ftxui::Event event, Editor& editor);
 
+    /// @brief Handle reload-from-disk confirmation (y/n)
+    bool handle_reload_confirm_input(ftxui::Event event, Editor& editor);
+
     /// @brief Helper: Show debug info for key sequences
     void show_debug_info(const std::string& input, Editor& editor);
 
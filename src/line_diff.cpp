@@ -0,0 +1,118 @@
+#include <line_diff.hpp>
+#include <algorithm>
+#include <cstddef>
+
+namespace LineDiff {
+
+namespace {
+
+/// @brief One line removed from or inserted into the old text, at old line x / new line y
+struct Edit {
+    bool insert;
+    size_t x;
+    size_t y;
+};
+
+/// @brief Edits turning old [0, n) into new [0, m), false if that takes more than max_edits
+bool shortest_edits(size_t n, size_t m, const std::function<bool(size_t, size_t)>& equal,
+                    size_t max_edits, std::vector<Edit>& edits) {
+    // v[k] is the furthest x reached on diagonal k = x - y, stored at k + offset.
+    // After each round d the diagonals [-d, d] are kept for the way back.
+    const size_t limit = std::min(n + m, max_edits);
+    const ptrdiff_t offset = static_cast<ptrdiff_t>(limit) + 1;
+    std::vector<ptrdiff_t> v(2 * limit + 3, 0);
+    std::vector<std::vector<ptrdiff_t>> trace;
+
+    const ptrdiff_t end_x = static_cast<ptrdiff_t>(n);
+    const ptrdiff_t end_y = static_cast<ptrdiff_t>(m);
+    ptrdiff_t rounds = -1;
+    for (ptrdiff_t d = 0; d <= static_cast<ptrdiff_t>(limit) && rounds < 0; d++) {
+        for (ptrdiff_t k = -d; k <= d; k += 2) {
+            // Step down (insert) from diagonal k + 1 or right (remove) from k - 1
+            ptrdiff_t x;
+            if (k == -d || (k != d && v[k - 1 + offset] < v[k + 1 + offset])) {
+                x = v[k + 1 + offset];
+            } else {
+                x = v[k - 1 + offset] + 1;
+            }
+            ptrdiff_t y = x - k;
+            while (x < end_x && y < end_y && equal(static_cast<size_t>(x), static_cast<size_t>(y))) {
+                x++;
+                y++;
+            }
+            v[k + offset] = x;
+            if (x >= end_x && y >= end_y) {
+                rounds = d;
+            }
+        }
+        trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+    }
+    if (rounds < 0) return false;
+
+    // Walk back from the end, one edit per round
+    ptrdiff_t x = end_x;
+    ptrdiff_t y = end_y;
+    for (ptrdiff_t d = rounds; d > 0; d--) {
+        const std::vector<ptrdiff_t>& previous = trace[d - 1];   // Diagonals [-(d - 1), d - 1]
+        auto at = [&](ptrdiff_t k) { return previous[k + d - 1]; };
+        const ptrdiff_t k = x - y;
+        const bool down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        const ptrdiff_t previous_k = down ? k + 1 : k - 1;
+        const ptrdiff_t previous_x = at(previous_k);
+        const ptrdiff_t previous_y = previous_x - previous_k;
+        // The common lines (the snake) back to the edit need no entry
+        edits.push_back({down, static_cast<size_t>(previous_x), static_cast<size_t>(previous_y)});
+        x = previous_x;
+        y = previous_y;
+    }
+    std::reverse(edits.begin(), edits.end());
+    return true;
+}
+
+} // namespace
+
+std::vector<Change> diff(size_t old_count, size_t new_count,
+                         const std::function<bool(size_t, size_t)>& equal,
+                         size_t max_edits) {
+    // Common start and end first, a typical outside change touches a few
+    // lines somewhere in the middle
+    size_t prefix = 0;
+    while (prefix < old_count && prefix < new_count && equal(prefix, prefix)) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < old_count - prefix && suffix < new_count - prefix &&
+           equal(old_count - 1 - suffix, new_count - 1 - suffix)) {
+        suffix++;
+    }
+
+    const size_t n = old_count - prefix - suffix;
+    const size_t m = new_count - prefix - suffix;
+    std::vector<Change> changes;
+    if (n == 0 && m == 0) return changes;
+
+    std::vector<Edit> edits;
+    auto shifted_equal = [&](size_t x, size_t y) { return equal(prefix + x, prefix + y); };
+    if (n == 0 || m == 0 || !shortest_edits(n, m, shifted_equal, max_edits, edits)) {
+        changes.push_back({prefix, n, prefix, m});
+        return changes;
+    }
+
+    // Consecutive edits with no common line in between form one change
+    for (const Edit& edit : edits) {
+        const size_t x = prefix + edit.x;
+        const size_t y = prefix + edit.y;
+        if (changes.empty() || changes.back().old_first + changes.back().old_count != x ||
+            changes.back().new_first + changes.back().new_count != y) {
+            changes.push_back({x, 0, y, 0});
+        }
+        if (edit.insert) {
+            changes.back().new_count++;
+        } else {
+            changes.back().old_count++;
+        }
+    }
+    return changes;
+}
+
+} // namespace LineDiff
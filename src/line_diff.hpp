@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+/// @brief Line-level diff of two texts, used to patch a buffer to match its file on disk
+namespace LineDiff {
+    /// @brief Old lines [old_first, old_first + old_count) became new lines [new_first, new_first + new_count)
+    struct Change {
+        size_t old_first;
+        size_t old_count;
+        size_t new_first;
+        size_t new_count;
+    };
+
+    // Edits searched for before the rest is given up on as one change, the
+    // search takes O(lines * edits) time and O(edits^2) memory
+    constexpr size_t MAX_EDITS = 1024;
+
+    /// @brief Shortest list of changes turning `old_count` lines into `new_count` lines (Myers' algorithm)
+    ///
+    /// Lines the texts start and end with are skipped first, only the middle
+    /// is searched. If more than `max_edits` lines were inserted or removed in
+    /// there, the middle is reported as one change.
+    /// @param equal Whether old line i and new line j are the same
+    /// @return Changes in line order, non-overlapping
+    std::vector<Change> diff(size_t old_count, size_t new_count,
+                             const std::function<bool(size_t, size_t)>& equal,
+                             size_t max_edits = MAX_EDITS);
+}
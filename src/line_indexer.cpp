@@ -0,0 +1,55 @@
+#include <line_indexer.hpp>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+LineIndexer::LineIndexer(std::string_view text, bool paged) : text_(text), paged_(paged) {
+    worker_ = std::thread([this] { run(); });
+}
+
+LineIndexer::~LineIndexer() {
+    stop_.store(true, std::memory_order_relaxed);
+    worker_.join();
+}
+
+void LineIndexer::set_listener(std::function<void()> listener) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    listener_ = std::move(listener);
+    if (listener_ && (!batches_.empty() || finished_)) {
+        listener_();
+    }
+}
+
+std::vector<LineIndexer::Batch> LineIndexer::take_batches(bool& done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done = finished_;
+    return std::exchange(batches_, {});
+}
+
+void LineIndexer::run() {
+    size_t start = 0;
+    size_t batch_bytes = FIRST_BATCH_BYTES;
+    while (start < text_.size() && !stop_.load(std::memory_order_relaxed)) {
+        // Split a block of whole lines, cut after the first '\n' at or past the block size
+        size_t cut = text_.find('\n', std::min(text_.size(), start + batch_bytes) - 1);
+        batch_bytes = std::min(batch_bytes * 2, BATCH_BYTES);
+        cut = cut == std::string_view::npos ? text_.size() : cut + 1;
+        const std::string_view block = text_.substr(start, cut - start);
+
+        Batch batch;
+        if (paged_) {
+            batch.pages.push_lines(block, std::numeric_limits<size_t>::max());
+        } else {
+            batch.lines.push_lines(block, std::numeric_limits<size_t>::max());
+        }
+        start = cut;
+        indexed_bytes_.store(start, std::memory_order_relaxed);
+
+        // The listener is called under the lock, so set_listener() can't
+        // return while a call to the previous one is still running
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches_.push_back(std::move(batch));
+        finished_ = start >= text_.size();
+        if (listener_) listener_();
+    }
+}
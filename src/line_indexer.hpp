@@ -0,0 +1,69 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <line_table.hpp>
+#include <paged_line_index.hpp>
+
+/// @brief Splits text into lines on a worker thread
+///
+/// The worker builds a LineTable per block of text (line metadata included),
+/// or a PagedLineIndex for a paged file, and queues it. The owner collects the queued tables with take_batches() on
+/// its own thread, so the tables it hands out to readers are never touched by
+/// the worker. A listener is called from the worker whenever a batch is queued.
+///
+/// The text must stay valid and unchanged until the indexer is destroyed.
+class LineIndexer {
+public:
+    /// @brief Lines of one block of the text, only the table for the chosen mode is filled
+    struct Batch {
+        LineTable lines;
+        PagedLineIndex pages;
+    };
+
+    /// @brief Start indexing `text` - not empty, starting at the start of a line
+    /// @param paged Build PagedLineIndex batches instead of LineTable's
+    LineIndexer(std::string_view text, bool paged);
+    /// @brief Stops the worker and waits for it
+    ~LineIndexer();
+
+    LineIndexer(const LineIndexer&) = delete;
+    LineIndexer& operator=(const LineIndexer&) = delete;
+
+    /// @brief Set the callback run (on the worker thread) after each batch
+    /// Called right away if batches are already waiting. Once this returns the
+    /// previous listener is not called anymore.
+    void set_listener(std::function<void()> listener);
+
+    /// @brief Take the batches indexed so far, in text order
+    /// @param done Set when the whole text has been indexed and taken
+    std::vector<Batch> take_batches(bool& done);
+
+    /// @brief Bytes of the text indexed so far, for progress display
+    size_t indexed_bytes() const { return indexed_bytes_.load(std::memory_order_relaxed); }
+    size_t total_bytes() const { return text_.size(); }
+
+private:
+    // Text per batch, doubling from the first to the last size: the first
+    // lines show up quickly even from a slow disk, later batches are large
+    // enough to keep the hand-over cheap and still small enough for the
+    // document to grow visibly while a multi-GB file is indexed
+    static constexpr size_t FIRST_BATCH_BYTES = 64 * 1024;
+    static constexpr size_t BATCH_BYTES = 32 * 1024 * 1024;
+
+    void run();
+
+    std::string_view text_;
+    bool paged_;
+    std::mutex mutex_;
+    std::vector<Batch> batches_;           // Guarded by mutex_
+    std::function<void()> listener_;       // Guarded by mutex_
+    bool finished_ = false;                // Guarded by mutex_
+    std::atomic<bool> stop_{false};
+    std::atomic<size_t> indexed_bytes_{0};
+    std::thread worker_;                   // Last, starts after everything above exists
+};
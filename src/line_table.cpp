@@ -0,0 +1,147 @@
+#include <line_table.hpp>
+#include <newline_scanner.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+
+LineInfo LineInfo::describe(std::string_view text) {
+    // One pass, eight bytes per step: OR of all bytes for the ASCII check and
+    // a multiply/rotate hash of the words. The hash only has to tell lines
+    // apart quickly, equal hashes are still confirmed bytewise.
+    constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+    constexpr uint64_t HASH_MULTIPLIER = 0x517CC1B727220A95ULL;
+    uint64_t high_bits = 0;
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ text.size();
+
+    auto add_word = [&](uint64_t word) {
+        high_bits |= word;
+        hash = (std::rotl(hash, 5) ^ word) * HASH_MULTIPLIER;
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, text.data() + i, 8);
+        add_word(word);
+    }
+    if (i < text.size()) {
+        // Zero padding can't collide, the length is part of the seed
+        uint64_t word = 0;
+        std::memcpy(&word, text.data() + i, text.size() - i);
+        add_word(word);
+    }
+
+    LineInfo info;
+    info.hash = hash ^ (hash >> 29);
+    info.ascii = (high_bits & HIGH_BITS) == 0;
+    return info;
+}
+
+void LineScan::scan(std::string_view text, size_t begin, size_t end) {
+    // From the first line starting in the part to the end of the last one
+    if (begin > 0) {
+        const size_t newline = text.find('\n', begin - 1);
+        if (newline == std::string_view::npos || newline + 1 >= end) return;
+        begin = newline + 1;
+    }
+    const size_t newline = end < text.size() ? text.find('\n', end - 1) : std::string_view::npos;
+    end = newline == std::string_view::npos ? text.size() : newline + 1;
+
+    NewlineScanner::split_lines(text.substr(begin, end - begin), std::numeric_limits<size_t>::max(),
+                                [this](std::string_view line) {
+        const LineInfo info = LineInfo::describe(line);
+        if (ascii_bits.size() * 64 == hashes.size()) ascii_bits.push_back(0);
+        if (info.ascii) ascii_bits.back() |= uint64_t{1} << (hashes.size() % 64);
+        lengths.push_back(line.length());
+        hashes.push_back(info.hash);
+    });
+}
+
+void LineTable::clear() {
+    data_.clear();
+    prefix_.assign(1, 0);
+    hashes_.clear();
+    ascii_bits_.clear();
+}
+
+void LineTable::reserve(size_t count) {
+    data_.reserve(count);
+    prefix_.reserve(count + 1);
+    hashes_.reserve(count);
+    ascii_bits_.reserve((count + 63) / 64);
+}
+
+void LineTable::push_back(std::string_view text) {
+    const LineInfo info = LineInfo::describe(text);
+    data_.push_back(text.data());
+    prefix_.push_back(prefix_.back() + text.length());
+    hashes_.push_back(info.hash);
+    if (ascii_bits_.size() * 64 < data_.size()) {
+        ascii_bits_.push_back(0);
+    }
+    set_ascii(data_.size() - 1, info.ascii);
+}
+
+size_t LineTable::push_lines(std::string_view text, size_t max_lines) {
+    return NewlineScanner::split_lines(text, max_lines, [this](std::string_view line) { push_back(line); });
+}
+
+void LineTable::push_scanned(std::string_view text, const std::vector<LineScan>& scans) {
+    size_t count = size();
+    for (const LineScan& scan : scans) count += scan.lengths.size();
+    if (count > data_.capacity()) reserve(std::max(count, 2 * data_.capacity()));
+
+    // Lines follow each other, one '\n' apart
+    const char* line = text.data();
+    for (const LineScan& scan : scans) {
+        const size_t first = size();
+        for (size_t length : scan.lengths) {
+            data_.push_back(line);
+            prefix_.push_back(prefix_.back() + length);
+            line += length + 1;
+        }
+        hashes_.insert(hashes_.end(), scan.hashes.begin(), scan.hashes.end());
+        ascii_bits_.resize((data_.size() + 63) / 64, 0);
+        for (size_t i = 0; i < scan.lengths.size(); i++) set_ascii(first + i, scan.is_ascii(i));
+    }
+}
+
+void LineTable::append(const LineTable& other) {
+    const size_t base = data_.size();
+    const size_t base_length = prefix_.back();
+
+    data_.insert(data_.end(), other.data_.begin(), other.data_.end());
+    for (size_t i = 1; i < other.prefix_.size(); i++) {
+        prefix_.push_back(base_length + other.prefix_[i]);
+    }
+    hashes_.insert(hashes_.end(), other.hashes_.begin(), other.hashes_.end());
+    ascii_bits_.resize((data_.size() + 63) / 64, 0);
+    for (size_t i = 0; i < other.size(); i++) {
+        set_ascii(base + i, other.is_ascii(i));
+    }
+}
+
+void LineTable::update_last(std::string_view text) {
+    const LineInfo info = LineInfo::describe(text);
+    const size_t index = data_.size() - 1;
+    data_[index] = text.data();
+    prefix_[index + 1] = prefix_[index] + text.length();
+    hashes_[index] = info.hash;
+    set_ascii(index, info.ascii);
+}
+
+void LineTable::rebase(const char* from, const char* to) {
+    for (const char*& data : data_) {
+        data = to + (data - from);
+    }
+}
+
+void LineTable::set_ascii(size_t i, bool ascii) {
+    const uint64_t bit = uint64_t{1} << (i % 64);
+    if (ascii) {
+        ascii_bits_[i / 64] |= bit;
+    } else {
+        ascii_bits_[i / 64] &= ~bit;
+    }
+}
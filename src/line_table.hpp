@@ -0,0 +1,84 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/// @brief Facts about one line, derived from its bytes once when it is stored
+struct LineInfo {
+    uint64_t hash = 0;   // 64-bit content hash
+    bool ascii = true;   // Pure ASCII - byte offsets and columns are the same
+
+    static LineInfo describe(std::string_view text);
+};
+
+/// @brief Lines of part of a text, split and described apart from any table -
+/// on several threads at once, LineTable::push_scanned() takes them in order
+struct LineScan {
+    std::vector<size_t> lengths;
+    std::vector<uint64_t> hashes;
+    std::vector<uint64_t> ascii_bits;    // 64 lines per word
+
+    /// @brief The lines of `text` that start in [begin, end), the last may end past it
+    void scan(std::string_view text, size_t begin, size_t end);
+    bool is_ascii(size_t i) const { return (ascii_bits[i / 64] >> (i % 64)) & 1; }
+};
+
+/// @brief Line table of one backing buffer of TextBuffer
+///
+/// Stored as parallel arrays (structure of arrays), so lookups that only need
+/// lengths or only hashes walk one dense array. Lengths are kept as prefix
+/// sums, the size of any run of lines is one subtraction. The ASCII flags are
+/// packed 64 lines per word.
+///
+/// The table only points at the text, which lives in the backing buffer. Lines
+/// never change once stored (except the newest one, see update_last()), so the
+/// metadata stays valid.
+class LineTable {
+public:
+    /// @brief Bytes a line takes in the table (its ASCII bit aside)
+    static constexpr size_t ROW_BYTES = sizeof(const char*) + sizeof(size_t) + sizeof(uint64_t);
+
+    LineTable() { clear(); }
+
+    size_t size() const { return data_.size(); }
+    bool empty() const { return data_.empty(); }
+    void clear();
+    void reserve(size_t count);
+
+    /// @brief Append a line, `text` must stay valid as long as the table refers to it
+    void push_back(std::string_view text);
+
+    /// @brief Split `text` on '\n' and append up to `max_lines` of its lines
+    /// Same rules as std::getline, a trailing '\n' does not start a new line.
+    /// @return Bytes consumed, the next line (if any) starts there
+    size_t push_lines(std::string_view text, size_t max_lines);
+    /// @brief Append the lines `scans` found in `text`, which together cover it
+    void push_scanned(std::string_view text, const std::vector<LineScan>& scans);
+
+    /// @brief Append all lines of another table
+    void append(const LineTable& other);
+
+    /// @brief Point the newest line at new text and recompute its metadata
+    void update_last(std::string_view text);
+
+    /// @brief Re-point every line after its text was copied from `from` to `to`
+    void rebase(const char* from, const char* to);
+
+    std::string_view text(size_t i) const { return std::string_view(data_[i], length(i)); }
+    size_t length(size_t i) const { return prefix_[i + 1] - prefix_[i]; }
+    /// @brief Total length of lines [first, first + count)
+    size_t run_length(size_t first, size_t count) const { return prefix_[first + count] - prefix_[first]; }
+    uint64_t hash(size_t i) const { return hashes_[i]; }
+    bool is_ascii(size_t i) const { return (ascii_bits_[i / 64] >> (i % 64)) & 1; }
+
+    LineInfo info(size_t i) const { return LineInfo{hashes_[i], is_ascii(i)}; }
+
+private:
+    void set_ascii(size_t i, bool ascii);
+
+    std::vector<const char*> data_;
+    std::vector<size_t> prefix_;       // prefix_[i] = total length of lines [0, i)
+    std::vector<uint64_t> hashes_;
+    std::vector<uint64_t> ascii_bits_;
+};
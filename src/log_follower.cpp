@@ -0,0 +1,179 @@
+#include <log_follower.hpp>
+#include <filesystem>
+#include <memory>
+#include <utility>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LogFollower::LogFollower(const std::string& filename, std::function<void()> listener, size_t tail_lines)
+    : listener_(std::move(listener)), tail_lines_(tail_lines) {
+    // Follow a symlink, it's the target that gets written
+    path_ = filename;
+    char resolved[PATH_MAX];
+    if (realpath(filename.c_str(), resolved) != nullptr) {
+        path_ = resolved;
+    }
+    std::string directory = std::filesystem::path(path_).parent_path().string();
+    if (directory.empty()) directory = ".";
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) return;
+    // Without inotify the size is still polled
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ >= 0 &&
+        inotify_add_watch(inotify_fd_, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0) {
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+
+    worker_ = std::thread(&LogFollower::run, this);
+}
+
+LogFollower::~LogFollower() {
+    if (worker_.joinable()) {
+        const uint64_t wake = 1;
+        [[maybe_unused]] ssize_t written = write(wake_fd_, &wake, sizeof(wake));
+        worker_.join();
+    }
+    if (fd_ >= 0) close(fd_);
+    if (inotify_fd_ >= 0) close(inotify_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+}
+
+LogFollower::Update LogFollower::take() {
+    Update update;
+    std::lock_guard<std::mutex> lock(mutex_);
+    notified_.store(false);
+    update.truncated = std::exchange(truncated_, false);
+    update.rotated = std::exchange(rotated_, false);
+
+    // Everything up to the last newline, the partial line after it stays
+    const size_t last_newline = queued_.rfind('\n');
+    if (last_newline == std::string::npos) return update;
+    if (last_newline + 1 == queued_.size()) {
+        update.text = std::move(queued_);
+        queued_.clear();
+    } else {
+        update.text.assign(queued_, 0, last_newline + 1);
+        queued_.erase(0, last_newline + 1);
+    }
+    return update;
+}
+
+void LogFollower::notify() {
+    if (!notified_.exchange(true) && listener_) listener_();
+}
+
+bool LogFollower::open_file() {
+    if (fd_ >= 0) return true;
+
+    fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return false;
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    device_ = st.st_dev;
+    inode_ = st.st_ino;
+    offset_ = 0;
+    // Only the file there at the start is read from its tail, a rotated-in one is new
+    if (tail_lines_ > 0) {
+        offset_ = tail_offset(st.st_size, tail_lines_);
+        tail_lines_ = 0;
+    }
+    return true;
+}
+
+off_t LogFollower::tail_offset(off_t size, size_t lines) const {
+    // Backwards from the end, the last byte is skipped: it is either the last
+    // line's '\n' or part of that line
+    char block[64 * 1024];
+    size_t found = 0;
+    off_t end = size - 1;
+    while (end > 0) {
+        const off_t start = end > static_cast<off_t>(sizeof(block)) ? end - static_cast<off_t>(sizeof(block)) : 0;
+        const ssize_t length = pread(fd_, block, static_cast<size_t>(end - start), start);
+        if (length <= 0) return 0;
+        for (ssize_t i = length - 1; i >= 0; i--) {
+            if (block[i] == '\n' && ++found == lines) return start + i + 1;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+void LogFollower::restart(bool& flag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A line cut off by the truncation or rotation won't be continued
+    if (!queued_.empty() && queued_.back() != '\n') queued_ += '\n';
+    flag = true;
+}
+
+void LogFollower::read_appended(char* chunk) {
+    if (!open_file()) return;
+
+    bool changed = false;
+    while (true) {
+        {
+            // The owner is behind, read on once it took some
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queued_.size() >= MAX_QUEUED_BYTES) break;
+        }
+
+        struct stat st;
+        if (fstat(fd_, &st) == 0 && st.st_size < offset_) {
+            offset_ = 0;
+            restart(truncated_);
+            changed = true;
+        }
+
+        const ssize_t length = pread(fd_, chunk, READ_BYTES, offset_);
+        if (length > 0) {
+            offset_ += length;
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_.append(chunk, static_cast<size_t>(length));
+            changed = true;
+            continue;
+        }
+        if (length < 0 && errno == EINTR) continue;
+
+        // At the end of the file - is it still the one at the path?
+        struct stat current;
+        if (stat(path_.c_str(), &current) != 0 || (current.st_dev == device_ && current.st_ino == inode_)) break;
+        close(fd_);
+        fd_ = -1;
+        restart(rotated_);
+        changed = true;
+        if (!open_file()) break;
+    }
+
+    if (changed) notify();
+}
+
+void LogFollower::run() {
+    auto chunk = std::make_unique<char[]>(READ_BYTES);
+    alignas(inotify_event) char events[4096];
+    pollfd fds[2] = {{wake_fd_, POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+    const nfds_t watched = inotify_fd_ >= 0 ? 2 : 1;
+
+    while (true) {
+        read_appended(chunk.get());
+
+        if (poll(fds, watched, POLL_INTERVAL_MS) < 0 && errno != EINTR) return;
+        if (fds[0].revents != 0) return;
+        if (watched > 1 && fds[1].revents != 0) {
+            // Which file of the directory it was doesn't matter, the size tells
+            while (read(inotify_fd_, events, sizeof(events)) > 0) {}
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <sys/types.h>
+
+/// @brief Reads what gets appended to a file, like `tail -F` (--follow mode)
+///
+/// A worker thread keeps the file open read-only and reads only the bytes
+/// past what it has read before. It wakes on inotify events for the file's
+/// directory and, as a fallback for file systems without them, every
+/// POLL_INTERVAL_MS to compare the size. The bytes are queued until the owner
+/// takes them, whole lines at a time.
+///
+/// A file that shrinks was truncated, it is read again from its start. A
+/// different file at the path (log rotation) is read from its start too, once
+/// the old one has been read to its end. A file that doesn't exist yet is
+/// waited for.
+class LogFollower {
+public:
+    /// @brief What was appended since the last take()
+    struct Update {
+        std::string text;        // Whole lines, each one '\n'-terminated
+        bool truncated = false;  // The file shrank and is read from its start again
+        bool rotated = false;    // Another file took the path and is read from its start
+    };
+
+    /// @brief Start following `filename`
+    /// @param listener Called on the worker thread when there is something to take()
+    /// @param tail_lines Start this many lines before the end (0: at the start)
+    LogFollower(const std::string& filename, std::function<void()> listener, size_t tail_lines);
+    /// @brief Stops the worker and waits for it
+    ~LogFollower();
+
+    LogFollower(const LogFollower&) = delete;
+    LogFollower& operator=(const LogFollower&) = delete;
+
+    /// @brief Take the lines read so far, a partial last line stays queued
+    Update take();
+
+private:
+    // Read size, and queued bytes past which the worker stops reading until
+    // the owner catches up
+    static constexpr size_t READ_BYTES = 1024 * 1024;
+    static constexpr size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+    static constexpr int POLL_INTERVAL_MS = 250;
+
+    void run();
+    /// @brief Open path_ if not open yet, false if it isn't there
+    bool open_file();
+    /// @brief Read everything appended since the last call, following truncation and rotation
+    /// @param chunk Scratch space of READ_BYTES
+    void read_appended(char* chunk);
+    /// @brief Start over at the start of the file: the last line read so far is ended
+    void restart(bool& flag);
+    /// @brief Call the listener, unless it was called and nothing was taken since
+    void notify();
+    /// @brief Offset of the start of the last `lines` lines of the open file
+    off_t tail_offset(off_t size, size_t lines) const;
+
+    std::string path_;
+    std::function<void()> listener_;
+    size_t tail_lines_;
+    int fd_ = -1;                          // The file being read, worker only ...
+    off_t offset_ = 0;                     // ... like the bytes of it read so far ...
+    dev_t device_ = 0;                     // ... and its identity
+    ino_t inode_ = 0;
+    int inotify_fd_ = -1;
+    int wake_fd_ = -1;                     // Written to stop the worker
+
+    std::mutex mutex_;
+    std::string queued_;                   // Guarded by mutex_
+    bool truncated_ = false;               // Guarded by mutex_
+    bool rotated_ = false;                 // Guarded by mutex_
+    std::atomic<bool> notified_{false};    // Listener called, nothing taken since
+    std::thread worker_;                   // Last, starts after everything above exists
+};
@@ -0,0 +1,289 @@
+#include <lz_codec.hpp>
+#include <algorithm>
+#include <barrier>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+// The last match starts this far before the end of a block and ends at least
+// LAST_LITERALS before it - the decoder's fast paths can run past a sequence
+constexpr size_t MATCH_LIMIT = 12;
+constexpr size_t LAST_LITERALS = 5;
+constexpr int HASH_BITS = 14;               // 64 KB of table, stays in L2
+constexpr size_t HEADER_SIZE = sizeof(uint64_t);
+constexpr size_t BLOCK_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+uint32_t load32(const char* at) {
+    uint32_t value;
+    std::memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/// @brief Length of the common prefix of `a` and `b`, at most `max` bytes
+size_t common_length(const char* a, const char* b, size_t max) {
+    size_t length = 0;
+    if constexpr (std::endian::native == std::endian::little) {
+        while (length + sizeof(uint64_t) <= max) {
+            uint64_t x, y;
+            std::memcpy(&x, a + length, sizeof(x));
+            std::memcpy(&y, b + length, sizeof(y));
+            if (x != y) return length + std::countr_zero(x ^ y) / 8;
+            length += sizeof(uint64_t);
+        }
+    }
+    while (length < max && a[length] == b[length]) length++;
+    return length;
+}
+
+/// @brief 15 in the token, then the rest in bytes of 255 and a last one below
+char* put_length(char* out, size_t length) {
+    for (length -= 15; length >= 255; length -= 255) *out++ = static_cast<char>(255);
+    *out++ = static_cast<char>(length);
+    return out;
+}
+
+char* put_sequence(char* out, const char* literals, size_t literal_length, size_t offset, size_t match_length) {
+    char* token = out++;
+    uint8_t nibbles = static_cast<uint8_t>(std::min<size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15) out = put_length(out, literal_length);
+    std::memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length > 0) {
+        *out++ = static_cast<char>(offset & 0xff);
+        *out++ = static_cast<char>(offset >> 8);
+        const size_t extra = match_length - MIN_MATCH;
+        nibbles |= static_cast<uint8_t>(std::min<size_t>(extra, 15));
+        if (extra >= 15) out = put_length(out, extra);
+    }
+    *token = static_cast<char>(nibbles);
+    return out;
+}
+
+/// @brief Compress one block to `out`, which has room for the worst case
+/// @return End of the compressed data
+char* compress_block(const char* src, size_t size, uint32_t* table, char* out) {
+    size_t anchor = 0;
+    if (size > MATCH_LIMIT) {
+        std::fill(table, table + (size_t(1) << HASH_BITS), 0);
+        const size_t limit = size - MATCH_LIMIT;
+        size_t at = 0;
+        size_t misses = 0;
+        while (at < limit) {
+            const uint32_t sequence = load32(src + at);
+            uint32_t& slot = table[hash(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(at);
+            if (candidate >= at || at - candidate > MAX_OFFSET || load32(src + candidate) != sequence) {
+                // Incompressible stretches are skipped faster and faster
+                at += 1 + (misses++ >> 5);
+                continue;
+            }
+            misses = 0;
+
+            // Back over literals that match too, then forward
+            while (at > anchor && candidate > 0 && src[at - 1] == src[candidate - 1]) {
+                at--;
+                candidate--;
+            }
+            const size_t length = MIN_MATCH + common_length(src + at + MIN_MATCH, src + candidate + MIN_MATCH,
+                                                            size - LAST_LITERALS - at - MIN_MATCH);
+            out = put_sequence(out, src + anchor, at - anchor, at - candidate, length);
+            at += length;
+            anchor = at;
+            // The tail of the match is a likely start of the next one
+            if (at < limit) table[hash(load32(src + at - 2))] = static_cast<uint32_t>(at - 2);
+        }
+    }
+    return put_sequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+/// @brief Length continued in bytes after a nibble of 15, false if it runs past `end`
+bool take_length(const char*& in, const char* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in >= end) return false;
+        byte = static_cast<uint8_t>(*in++);
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool decompress_block(const char* in, const char* in_end, char* out, char* out_end) {
+    char* const out_begin = out;
+    while (in < in_end) {
+        const uint8_t token = static_cast<uint8_t>(*in++);
+
+        // Fast path for the usual short sequence, no length bytes: copies of
+        // a fixed 16/32 bytes, the next sequence writes over the excess
+        const size_t short_literals = token >> 4;
+        if (short_literals < 15 && (token & 15) < 15 && in_end - in >= 16 + 2 && out_end - out >= 14 + 32) {
+            std::memcpy(out, in, 16);
+            in += short_literals;
+            out += short_literals;
+            const size_t offset = static_cast<uint8_t>(in[0]) | static_cast<size_t>(static_cast<uint8_t>(in[1])) << 8;
+            if (offset >= 16 && offset <= static_cast<size_t>(out - out_begin)) {
+                in += 2;
+                const char* match = out - offset;
+                std::memcpy(out, match, 16);
+                std::memcpy(out + 16, match + 16, 16);
+                out += (token & 15) + MIN_MATCH;
+                continue;
+            }
+            // Close or bad offset - the match through the general path
+            in -= short_literals;
+            out -= short_literals;
+        }
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !take_length(in, in_end, literal_length)) return false;
+        if (literal_length > static_cast<size_t>(in_end - in) || literal_length > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        // Short runs (the usual case) copied as a whole 16 bytes where there's room
+        if (literal_length <= 16 && in_end - in >= 16 && out_end - out >= 16) {
+            std::memcpy(out, in, 16);
+        } else {
+            std::memcpy(out, in, literal_length);
+        }
+        in += literal_length;
+        out += literal_length;
+        if (in == in_end) break;   // The last sequence has no match
+
+        if (in_end - in < 2) return false;
+        const size_t offset = static_cast<uint8_t>(in[0]) | static_cast<size_t>(static_cast<uint8_t>(in[1])) << 8;
+        in += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !take_length(in, in_end, match_length)) return false;
+        match_length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(out - out_begin) ||
+            match_length > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+
+        const char* match = out - offset;
+        char* const match_end = out + match_length;
+        if (offset >= 8 && out_end - match_end >= 8) {
+            // 8 bytes at a time never read what this copy writes, may overshoot by 7
+            do {
+                std::memcpy(out, match, 8);
+                out += 8;
+                match += 8;
+            } while (out < match_end);
+        } else {
+            // Close repeats (runs of one character) - the copy reads its own output
+            while (out < match_end) *out++ = *match++;
+        }
+        out = match_end;
+    }
+    return out == out_end;
+}
+
+} // namespace
+
+namespace LzCodec {
+
+bool compress(std::string_view input, std::string& output, const std::atomic<bool>* cancel) {
+    const uint64_t total = input.size();
+    output.append(reinterpret_cast<const char*>(&total), sizeof(total));
+
+    auto table = std::make_unique<uint32_t[]>(size_t(1) << HASH_BITS);
+    for (size_t at = 0; at < input.size(); at += BLOCK_SIZE) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return false;
+        const size_t size = std::min(BLOCK_SIZE, input.size() - at);
+        const size_t start = output.size();
+        // Worst case: all literals, a length byte per 255 of them and a token
+        output.resize(start + BLOCK_HEADER_SIZE + size + size / 255 + 16);
+        char* data = output.data() + start + BLOCK_HEADER_SIZE;
+        size_t compressed = compress_block(input.data() + at, size, table.get(), data) - data;
+        if (compressed >= size) {
+            std::memcpy(data, input.data() + at, size);
+            compressed = size;
+        }
+        const uint32_t sizes[2] = {static_cast<uint32_t>(compressed), static_cast<uint32_t>(size)};
+        std::memcpy(output.data() + start, sizes, sizeof(sizes));
+        output.resize(start + BLOCK_HEADER_SIZE + compressed);
+    }
+    return true;
+}
+
+size_t decompressed_size(std::string_view input) {
+    uint64_t total = 0;
+    if (input.size() < HEADER_SIZE) return 0;
+    std::memcpy(&total, input.data(), sizeof(total));
+    return total;
+}
+
+bool decompress(std::string_view input, char* output, unsigned threads, const Then& then) {
+    if (input.size() < HEADER_SIZE) return false;
+    const size_t total = decompressed_size(input);
+
+    // The headers first - every block's place in the input and the output is known then
+    struct Block {
+        size_t in, out, compressed, size;
+    };
+    std::vector<Block> blocks;
+    blocks.reserve(total / BLOCK_SIZE + 1);
+    size_t in = HEADER_SIZE;
+    size_t out = 0;
+    while (in < input.size()) {
+        uint32_t sizes[2];
+        if (input.size() - in < sizeof(sizes)) return false;
+        std::memcpy(sizes, input.data() + in, sizeof(sizes));
+        in += sizeof(sizes);
+        const size_t compressed = sizes[0], size = sizes[1];
+        if (compressed > input.size() - in || size > total - out || size > BLOCK_SIZE) return false;
+        blocks.push_back(Block{in, out, compressed, size});
+        in += compressed;
+        out += size;
+    }
+    if (out != total) return false;
+
+    auto run = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            const Block& block = blocks[i];
+            const char* data = input.data() + block.in;
+            if (block.compressed == block.size) {
+                std::memcpy(output + block.out, data, block.size);
+            } else if (!decompress_block(data, data + block.compressed, output + block.out,
+                                         output + block.out + block.size)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Contiguous shares, this thread takes the first. Each works on its own
+    // bytes of the output again once all of them are there.
+    const size_t shares = std::min<size_t>(threads, blocks.size());
+    auto share = [&](size_t index, std::barrier<>* all_done) {
+        const size_t first = index * blocks.size() / shares, last = (index + 1) * blocks.size() / shares;
+        const bool done = run(first, last);
+        if (all_done) all_done->arrive_and_wait();
+        if (then) then(index, blocks[first].out, blocks[last - 1].out + blocks[last - 1].size);
+        return done;
+    };
+    if (shares == 0) return true;
+    if (shares == 1) return share(0, nullptr);
+    std::barrier<> all_done(static_cast<std::ptrdiff_t>(shares));
+    std::vector<std::thread> workers;
+    std::unique_ptr<bool[]> ok = std::make_unique<bool[]>(shares);
+    for (size_t index = 1; index < shares; index++) {
+        workers.emplace_back([&, index] { ok[index] = share(index, &all_done); });
+    }
+    ok[0] = share(0, &all_done);
+    for (std::thread& worker : workers) worker.join();
+    return std::all_of(ok.get(), ok.get() + shares, [](bool done) { return done; });
+}
+
+} // namespace LzCodec
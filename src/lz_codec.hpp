@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+
+/// @brief Small LZ77 codec for text kept in memory (cold undo entries)
+///
+/// The LZ4 idea in a few hundred lines: a sequence is a run of literals and a
+/// match within the last 64 KB, found through a hash table of 4-byte
+/// prefixes, with no entropy coding after. Compression is a few hundred MB/s
+/// and decompression runs at memory speed, text shrinks to a third to a half.
+///
+/// Layout: the uncompressed size (uint64, native byte order), then blocks of
+/// up to BLOCK_SIZE input bytes, each a uint32 compressed size and a uint32
+/// uncompressed size followed by the data - stored as is when it didn't
+/// shrink (both sizes equal). Blocks are independent, the matches don't
+/// reach across them.
+namespace LzCodec {
+    constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+    /// @brief Append the compressed form of `input` to `output`
+    /// @param cancel Checked between blocks, compression stops when it is set
+    /// @return False if cancelled
+    bool compress(std::string_view input, std::string& output, const std::atomic<bool>* cancel = nullptr);
+
+    /// @brief Size `input` decompresses to, 0 if it is too short to tell
+    size_t decompressed_size(std::string_view input);
+
+    /// @brief Work on part of the output: the bytes [begin, end), part 0 to the thread count
+    using Then = std::function<void(size_t part, size_t begin, size_t end)>;
+
+    /// @brief Decompress `input` into the decompressed_size() bytes at `output`
+    /// @param threads Blocks are shared out over up to this many threads (this one included)
+    /// @param then Called by each thread with the part it decompressed, once
+    ///             the whole output is there (it may read past its part)
+    /// @return False if the data is damaged (the output is undefined then)
+    bool decompress(std::string_view input, char* output, unsigned threads = 1, const Then& then = {});
+}
@@ -3,6 +3,8 @@
 #include <fstream>
 #include <iostream>
 #include <print>
+#include <charconv>
+#include <cstring>
 
 using namespace std::literals;
 
@@ -13,9 +15,11 @@ const std::string license_path = "LICENSE";
 /// @param program_name The name of the program (typically argv[0])
 void print_usage(std::string_view program_name)
 {
-    std::println("Usage: {} [-d] <filename>", program_name);
+    std::println("Usage: {} [-d] [-f [--max-lines <n>]] <filename>", program_name);
     std::println("Options:");
     std::println("  -d,--debug      Enable debug mode (show key sequences)");
+    std::println("  -f,--follow     Follow the file read-only as lines are appended (like tail -F)");
+    std::println("  --max-lines <n> With --follow, keep only the last n lines");
     std::println("  -v,--version    Show version information");
     std::println("  --about         About BZ-Nota");
     std::println("  -l,--license    Show license information");
@@ -58,6 +62,8 @@ void open_url(std::string_view url) {
 int main(int argc, char* argv[]) {
     // Parse command-line arguments
     bool debug_mode = false;
+    bool follow = false;
+    size_t follow_max_lines = 0;
     std::string filename;
 
     for (int i = 1; i < argc; i++) {
@@ -67,6 +73,18 @@ int main(int argc, char* argv[]) {
             return 0;
         } else if (arg == "-d" || arg == "--debug") {
             debug_mode = true;
+        } else if (arg == "-f" || arg == "--follow") {
+            follow = true;
+        } else if (arg == "--max-lines") {
+            size_t count = 0;
+            const char* value = i + 1 < argc ? argv[++i] : "";
+            const char* value_end = value + std::strlen(value);
+            auto [end, error] = std::from_chars(value, value_end, count);
+            if (error != std::errc() || end != value_end || count == 0) {
+                std::println(std::cerr, "Error: --max-lines needs a positive number of lines");
+                return 1;
+            }
+            follow_max_lines = count;
         } else if (arg == "-v" || arg == "--version") {
             std::println("{} {}", BZ_NOTA_APP_NAME, BZ_NOTA_VERSION);
             return 0;
@@ -126,7 +144,7 @@ int main(int argc, char* argv[]) {
     }
 
     try {
-        Editor editor(filename, debug_mode);
+        Editor editor(filename, debug_mode, follow, follow_max_lines);
         editor.run();
     } catch (const std::exception& e) {
         std::println("Error: {}", e.what());
@@ -0,0 +1,168 @@
+#include <mapped_file.hpp>
+#include <utility>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Mappings the SIGBUS handler may patch up: pages [begin, end). A slot is
+// claimed by setting begin, then end, and released in the same order - the
+// handler only ever reads them. Mappings past the last slot go unprotected.
+struct MappingSlot {
+    std::atomic<uintptr_t> begin{0};
+    std::atomic<uintptr_t> end{0};
+};
+constexpr size_t MAX_MAPPINGS = 16;
+MappingSlot mapping_slots[MAX_MAPPINGS];
+
+uintptr_t page_size = 0;
+struct sigaction previous_sigbus {};
+
+void on_sigbus(int signal, siginfo_t* info, void* context) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(info->si_addr);
+    for (const MappingSlot& slot : mapping_slots) {
+        const uintptr_t begin = slot.begin.load(std::memory_order_acquire);
+        const uintptr_t end = slot.end.load(std::memory_order_acquire);
+        if (begin == 0 || address < begin || address >= end) continue;
+
+        // The file got shorter: the rest of the mapping becomes zeros, the read is retried
+        const uintptr_t page = address & ~(page_size - 1);
+        if (mmap(reinterpret_cast<void*>(page), end - page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+                 0) != MAP_FAILED) {
+            return;
+        }
+        break;
+    }
+
+    // Not a mapped file - whatever was there before
+    if (previous_sigbus.sa_flags & SA_SIGINFO) {
+        previous_sigbus.sa_sigaction(signal, info, context);
+    } else if (previous_sigbus.sa_handler != SIG_DFL && previous_sigbus.sa_handler != SIG_IGN) {
+        previous_sigbus.sa_handler(signal);
+    } else {
+        // Delivered once the handler returns, and ends the process this time
+        ::signal(SIGBUS, SIG_DFL);
+        raise(SIGBUS);
+    }
+}
+
+bool install_sigbus_handler() {
+    page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    struct sigaction action {};
+    action.sa_sigaction = on_sigbus;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGBUS, &action, &previous_sigbus) == 0;
+}
+
+void protect(const char* data, size_t size) {
+    static const bool installed = install_sigbus_handler();
+    if (!installed) return;
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+    for (MappingSlot& slot : mapping_slots) {
+        uintptr_t free = 0;
+        if (slot.begin.compare_exchange_strong(free, begin, std::memory_order_acq_rel)) {
+            slot.end.store((begin + size + page_size - 1) & ~(page_size - 1), std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void unprotect(const char* data) {
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+    for (MappingSlot& slot : mapping_slots) {
+        if (slot.begin.load(std::memory_order_acquire) != begin) continue;
+        slot.begin.store(0, std::memory_order_release);
+        slot.end.store(0, std::memory_order_release);
+        return;
+    }
+}
+
+} // namespace
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+      device_(other.device_), inode_(other.inode_) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        device_ = other.device_;
+        inode_ = other.inode_;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        errno = err;
+        return false;
+    }
+    // Pipes, devices and procfs files report no (or a wrong) size, empty files can't be mapped
+    if (!S_ISREG(st.st_mode) || st.st_size <= 0) {
+        ::close(fd);
+        errno = EINVAL;
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    ::close(fd); // The mapping keeps its own reference to the file
+    if (data == MAP_FAILED) {
+        errno = err;
+        return false;
+    }
+
+    data_ = static_cast<const char*>(data);
+    size_ = size;
+    device_ = st.st_dev;
+    inode_ = st.st_ino;
+    protect(data_, size_);
+    return true;
+}
+
+bool MappedFile::maps(const std::string& filename) const {
+    struct stat st;
+    return is_open() && stat(filename.c_str(), &st) == 0 && st.st_dev == device_ && st.st_ino == inode_;
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr) {
+        unprotect(data_);
+        munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+void MappedFile::prefetch(std::string_view range) const {
+    if (data_ == nullptr || range.empty()) return;
+
+    // madvise wants a page-aligned start
+    static const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(range.data()) & ~(page_size - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(range.data() + range.size());
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+void MappedFile::set_sequential(bool sequential) const {
+    if (data_ == nullptr) return;
+    madvise(const_cast<char*>(data_), size_, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <sys/types.h>
+
+/// @brief Read-only memory mapping of a whole file
+///
+/// Mapping is O(1) in the file size, the kernel reads pages in on first access
+/// and may drop them again under memory pressure. The file should not be
+/// truncated or rewritten in place while it is mapped - FileManager saves by
+/// renaming a new file over it, the mapping keeps the old contents.
+///
+/// Another program may still do it (`> file`). Reading a page past the new end
+/// of the file would raise SIGBUS, wherever the read happens - so while any
+/// file is mapped a SIGBUS handler is installed, which replaces the mapping
+/// from that page on with zeros and lets the read go on. The contents are
+/// wrong then, until the file is loaded anew (see TextBuffer::maps_file()).
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// @brief Map a regular, non-empty file
+    /// @return False (errno set) if the file can't be opened or mapped
+    bool open(const std::string& filename);
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+    /// @brief Is the file now at `filename` the one that is mapped (same inode)?
+    /// If so and it changed, it was rewritten in place under the mapping.
+    bool maps(const std::string& filename) const;
+
+    /// @brief Start reading a range of the mapping in the background (a hint, never blocks)
+    void prefetch(std::string_view range) const;
+    /// @brief Hint a front-to-back pass: read ahead aggressively, drop pages once passed
+    void set_sequential(bool sequential) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    dev_t device_ = 0;
+    ino_t inode_ = 0;
+};
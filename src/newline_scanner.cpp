@@ -0,0 +1,205 @@
+#include <newline_scanner.hpp>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEWLINE_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using NewlineScanner::Isa;
+
+void find_scalar(const char* data, size_t size, std::vector<uint32_t>& positions) {
+    // memchr is the best portable option, libc vectorizes it where it can
+    const char* pos = data;
+    const char* end = data + size;
+    while (pos < end) {
+        const void* found = std::memchr(pos, '\n', end - pos);
+        if (found == nullptr) break;
+        pos = static_cast<const char*>(found);
+        positions.push_back(static_cast<uint32_t>(pos - data));
+        pos++;
+    }
+}
+
+size_t count_scalar(const char* data, size_t size) {
+    size_t count = 0;
+    const char* pos = data;
+    const char* end = data + size;
+    while (pos < end) {
+        const void* found = std::memchr(pos, '\n', end - pos);
+        if (found == nullptr) break;
+        pos = static_cast<const char*>(found) + 1;
+        count++;
+    }
+    return count;
+}
+
+/// @brief Positions of the set bits of a match mask, `base` is the offset of bit 0
+inline void push_mask(uint64_t mask, size_t base, std::vector<uint32_t>& positions) {
+    while (mask != 0) {
+        positions.push_back(static_cast<uint32_t>(base + std::countr_zero(mask)));
+        mask &= mask - 1;
+    }
+}
+
+#ifdef NEWLINE_SCANNER_X86
+
+// Both build a 64-bit match mask per 64 bytes, the tail goes to the scalar code
+
+__attribute__((target("sse2")))
+void find_sse2(const char* data, size_t size, std::vector<uint32_t>& positions) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t mask = 0;
+        for (int part = 0; part < 4; part++) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + part * 16));
+            const uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+            mask |= static_cast<uint64_t>(bits) << (part * 16);
+        }
+        push_mask(mask, i, positions);
+    }
+
+    const size_t tail_start = positions.size();
+    find_scalar(data + i, size - i, positions);
+    for (size_t k = tail_start; k < positions.size(); k++) positions[k] += static_cast<uint32_t>(i);
+}
+
+// The counts add up the 0xFF match bytes in byte lanes (255 steps at most
+// before they could wrap), then sum the lanes with SAD against zero
+
+__attribute__((target("sse2")))
+size_t count_sse2(const char* data, size_t size) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 16 <= size) {
+        __m128i lanes = zero;
+        const size_t steps = std::min<size_t>(255, (size - i) / 16);
+        for (size_t step = 0; step < steps; step++, i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(bytes, newline));
+        }
+        const __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+    }
+    return count + count_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+void find_avx2(const char* data, size_t size, std::vector<uint32_t>& positions) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        const uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline))) |
+                              static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)))) << 32;
+        push_mask(mask, i, positions);
+    }
+
+    const size_t tail_start = positions.size();
+    find_scalar(data + i, size - i, positions);
+    for (size_t k = tail_start; k < positions.size(); k++) positions[k] += static_cast<uint32_t>(i);
+}
+
+__attribute__((target("avx2")))
+size_t count_avx2(const char* data, size_t size) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 32 <= size) {
+        __m256i lanes = zero;
+        const size_t steps = std::min<size_t>(255, (size - i) / 32);
+        for (size_t step = 0; step < steps; step++, i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(bytes, newline));
+        }
+        const __m256i sums = _mm256_sad_epu8(lanes, zero);
+        count += static_cast<size_t>(_mm256_extract_epi64(sums, 0)) + static_cast<size_t>(_mm256_extract_epi64(sums, 1)) +
+                 static_cast<size_t>(_mm256_extract_epi64(sums, 2)) + static_cast<size_t>(_mm256_extract_epi64(sums, 3));
+    }
+    return count + count_scalar(data + i, size - i);
+}
+
+#endif
+
+bool isa_supported(Isa isa) {
+    switch (isa) {
+        case Isa::SCALAR: return true;
+#ifdef NEWLINE_SCANNER_X86
+        case Isa::SSE2:   return __builtin_cpu_supports("sse2");
+        case Isa::AVX2:   return __builtin_cpu_supports("avx2");
+#else
+        case Isa::SSE2:
+        case Isa::AVX2:   return false;
+#endif
+    }
+    return false;
+}
+
+Isa best_isa() {
+#ifdef NEWLINE_SCANNER_X86
+    __builtin_cpu_init();
+#endif
+    if (isa_supported(Isa::AVX2)) return Isa::AVX2;
+    if (isa_supported(Isa::SSE2)) return Isa::SSE2;
+    return Isa::SCALAR;
+}
+
+std::atomic<Isa>& current_isa() {
+    static std::atomic<Isa> isa{best_isa()};
+    return isa;
+}
+
+} // namespace
+
+namespace NewlineScanner {
+
+void find_newlines(std::string_view text, std::vector<uint32_t>& positions) {
+    switch (current_isa().load(std::memory_order_relaxed)) {
+#ifdef NEWLINE_SCANNER_X86
+        case Isa::AVX2: return find_avx2(text.data(), text.size(), positions);
+        case Isa::SSE2: return find_sse2(text.data(), text.size(), positions);
+#endif
+        default:        return find_scalar(text.data(), text.size(), positions);
+    }
+}
+
+size_t count_newlines(std::string_view text) {
+    switch (current_isa().load(std::memory_order_relaxed)) {
+#ifdef NEWLINE_SCANNER_X86
+        case Isa::AVX2: return count_avx2(text.data(), text.size());
+        case Isa::SSE2: return count_sse2(text.data(), text.size());
+#endif
+        default:        return count_scalar(text.data(), text.size());
+    }
+}
+
+Isa active_isa() {
+    return current_isa().load(std::memory_order_relaxed);
+}
+
+bool set_isa(Isa isa) {
+    if (!isa_supported(isa)) return false;
+    current_isa().store(isa, std::memory_order_relaxed);
+    return true;
+}
+
+const char* isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::SCALAR: return "scalar";
+        case Isa::SSE2:   return "SSE2";
+        case Isa::AVX2:   return "AVX2";
+    }
+    return "";
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+/// @brief Vectorized search for '\n' - the core of line splitting on load
+///
+/// Text is compared 32 (AVX2) or 16 (SSE2) bytes at a time and the match
+/// masks are turned into positions, so splitting costs one pass over the text
+/// instead of a memchr() call per line. The implementation is picked at
+/// startup from what the CPU supports, with a portable scalar fallback.
+///
+/// Only '\n' ends a line. In "\r\n" files the '\r' stays part of the line
+/// text, so a file is saved back with the line endings it was loaded with.
+namespace NewlineScanner {
+    enum class Isa {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    /// @brief Append the offsets of all '\n' in `text` (at most 4 GB) to `positions`
+    void find_newlines(std::string_view text, std::vector<uint32_t>& positions);
+
+    /// @brief Number of '\n' in `text`
+    size_t count_newlines(std::string_view text);
+
+    /// @brief Implementation in use
+    Isa active_isa();
+    /// @brief Switch implementation (benchmarks), false if the CPU doesn't support it
+    /// Takes effect for calls that start afterwards, also on other threads.
+    bool set_isa(Isa isa);
+    const char* isa_name(Isa isa);
+
+    /// @brief Text scanned per find_newlines() call while splitting - stays in L2 for the next pass
+    constexpr size_t SCAN_CHUNK = 64 * 1024;
+
+    /// @brief Split `text` on '\n' and call `emit` with each of up to `max_lines` lines
+    /// Same rules as std::getline: a trailing '\n' does not start a new line.
+    /// @return Bytes consumed, the next line (if any) starts there
+    template <class Emit>
+    size_t split_lines(std::string_view text, size_t max_lines, Emit&& emit) {
+        std::vector<uint32_t> newlines;
+        newlines.reserve(1024);
+
+        size_t start = 0;    // Start of the current line
+        size_t scanned = 0;  // Everything before this has been searched
+        size_t lines = 0;
+        while (lines < max_lines && start < text.size()) {
+            if (scanned == text.size()) {
+                // No '\n' after the last line
+                emit(text.substr(start));
+                return text.size();
+            }
+
+            const size_t chunk_size = std::min(SCAN_CHUNK, text.size() - scanned);
+            newlines.clear();
+            find_newlines(text.substr(scanned, chunk_size), newlines);
+            for (uint32_t position : newlines) {
+                const size_t newline = scanned + position;
+                emit(text.substr(start, newline - start));
+                start = newline + 1;
+                if (++lines == max_lines) return start;
+            }
+            scanned += chunk_size;
+        }
+        return start;
+    }
+}
@@ -0,0 +1,128 @@
+#include <paged_line_index.hpp>
+#include <newline_scanner.hpp>
+#include <algorithm>
+#include <cstring>
+
+void PagedLineIndex::clear() {
+    blocks_.clear();
+    lines_ = 0;
+    end_ = nullptr;
+    terminated_ = true;
+    forget_scans();
+}
+
+void PagedLineIndex::forget_scans() {
+    for (ScannedBlock& scanned : scanned_) {
+        scanned.block = NO_BLOCK;
+    }
+}
+
+size_t PagedLineIndex::push_lines(std::string_view text, size_t max_lines) {
+    // The last block may grow, its cached scan would be stale
+    forget_scans();
+
+    const size_t consumed = NewlineScanner::split_lines(text, max_lines, [this](std::string_view line) {
+        if (blocks_.empty() || lines_ - blocks_.back().first_line == BLOCK_LINES) {
+            blocks_.push_back({lines_, line.data()});
+        }
+        lines_++;
+    });
+    if (consumed > 0) {
+        end_ = text.data() + consumed;
+        // Consumed text ends with the '\n' of its last line, unless the text ran out first
+        terminated_ = text[consumed - 1] == '\n';
+    }
+    return consumed;
+}
+
+void PagedLineIndex::append(const PagedLineIndex& other) {
+    if (other.empty()) return;
+
+    forget_scans();
+    for (const Block& block : other.blocks_) {
+        blocks_.push_back({lines_ + block.first_line, block.data});
+    }
+    lines_ += other.lines_;
+    end_ = other.end_;
+    terminated_ = other.terminated_;
+}
+
+void PagedLineIndex::rebase(const char* from, const char* to) {
+    for (Block& block : blocks_) {
+        block.data = to + (block.data - from);
+    }
+    if (end_ != nullptr) {
+        end_ = to + (end_ - from);
+    }
+}
+
+size_t PagedLineIndex::block_of(size_t line) const {
+    auto it = std::upper_bound(blocks_.begin(), blocks_.end(), line,
+                               [](size_t y, const Block& block) { return y < block.first_line; });
+    return static_cast<size_t>(it - blocks_.begin()) - 1;
+}
+
+const char* PagedLineIndex::block_end(size_t block) const {
+    return block + 1 < blocks_.size() ? blocks_[block + 1].data : end_;
+}
+
+const std::vector<size_t>& PagedLineIndex::scan(size_t block) const {
+    ScannedBlock* slot = &scanned_[0];
+    for (ScannedBlock& scanned : scanned_) {
+        if (scanned.block == block) {
+            scanned.last_use = ++use_clock_;
+            return scanned.starts;
+        }
+        if (scanned.last_use < slot->last_use) slot = &scanned;
+    }
+
+    // Not cached - scan it into the least recently used slot
+    const Block& info = blocks_[block];
+    const char* end = block_end(block);
+    const size_t count = (block + 1 < blocks_.size() ? blocks_[block + 1].first_line : lines_) - info.first_line;
+
+    slot->block = block;
+    slot->last_use = ++use_clock_;
+    slot->starts.clear();
+    slot->starts.reserve(count + 1);
+    slot->starts.push_back(0);
+    const char* pos = info.data;
+    for (size_t k = 1; k < count; k++) {
+        pos = static_cast<const char*>(std::memchr(pos, '\n', end - pos)) + 1;
+        slot->starts.push_back(pos - info.data);
+    }
+    // Only the very last line of the text can lack its '\n'
+    const bool unterminated = block + 1 == blocks_.size() && !terminated_;
+    slot->starts.push_back(static_cast<size_t>(end - info.data) + (unterminated ? 1 : 0));
+    return slot->starts;
+}
+
+std::string_view PagedLineIndex::text(size_t i) const {
+    const size_t block = block_of(i);
+    const std::vector<size_t>& starts = scan(block);
+    const size_t k = i - blocks_[block].first_line;
+    return std::string_view(blocks_[block].data + starts[k], starts[k + 1] - starts[k] - 1);
+}
+
+size_t PagedLineIndex::line_offset(size_t i) const {
+    if (i == lines_) {
+        return static_cast<size_t>(end_ - blocks_[0].data) + (terminated_ ? 0 : 1);
+    }
+    const size_t block = block_of(i);
+    const size_t k = i - blocks_[block].first_line;
+    const size_t in_block = k == 0 ? 0 : scan(block)[k];
+    return static_cast<size_t>(blocks_[block].data - blocks_[0].data) + in_block;
+}
+
+size_t PagedLineIndex::run_length(size_t first, size_t count) const {
+    if (count == 0) return 0;
+    // Every line of the run is followed by exactly one '\n' (real or virtual)
+    return line_offset(first + count) - line_offset(first) - count;
+}
+
+std::string_view PagedLineIndex::block_range(size_t first, size_t count) const {
+    if (count == 0) return std::string_view();
+    const char* begin = blocks_[block_of(first)].data;
+    const char* end = block_end(block_of(first + count - 1));
+    return std::string_view(begin, end - begin);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <line_table.hpp>
+
+/// @brief Sparse line index for files too large to keep a LineTable for
+///
+/// A LineTable costs a few dozen bytes per line, for a file of tens of GB that
+/// alone doesn't fit in memory. This index only keeps where every
+/// BLOCK_LINES-th line starts. Lines inside a block are found by scanning the
+/// block, the most recently scanned blocks are cached. Line metadata is not
+/// stored but derived from the text on every call.
+///
+/// Like LineTable it only points at the text, which must outlive the index.
+/// All lines of one index must come from the same contiguous buffer.
+class PagedLineIndex {
+public:
+    size_t size() const { return lines_; }
+    bool empty() const { return lines_ == 0; }
+    void clear();
+
+    /// @brief Split `text` on '\n' and append up to `max_lines` of its lines
+    /// Same rules as LineTable::push_lines().
+    /// @return Bytes consumed, the next line (if any) starts there
+    size_t push_lines(std::string_view text, size_t max_lines);
+
+    /// @brief Append all lines of another index, which must continue this one's text
+    void append(const PagedLineIndex& other);
+
+    /// @brief Re-point every line after the text was copied from `from` to `to`
+    void rebase(const char* from, const char* to);
+
+    std::string_view text(size_t i) const;
+    size_t length(size_t i) const { return text(i).length(); }
+    /// @brief Total length of lines [first, first + count), newlines excluded
+    size_t run_length(size_t first, size_t count) const;
+    LineInfo info(size_t i) const { return LineInfo::describe(text(i)); }
+
+    /// @brief Text of lines [first, first + count), newlines included, widened
+    /// to whole blocks - found without scanning, for prefetching
+    std::string_view block_range(size_t first, size_t count) const;
+
+private:
+    static constexpr size_t BLOCK_LINES = 256;
+    static constexpr size_t CACHED_BLOCKS = 16;
+    static constexpr size_t NO_BLOCK = static_cast<size_t>(-1);
+
+    struct Block {
+        size_t first_line;
+        const char* data;       // Start of the block's first line
+    };
+
+    /// @brief Line starts of one block relative to its data, plus one entry
+    /// past its last line as if that line ended with '\n'
+    struct ScannedBlock {
+        size_t block = NO_BLOCK;
+        uint64_t last_use = 0;
+        std::vector<size_t> starts;
+    };
+
+    size_t block_of(size_t line) const;
+    const char* block_end(size_t block) const;
+    const std::vector<size_t>& scan(size_t block) const;
+    /// @brief Offset of the start of line i from the start of the text
+    size_t line_offset(size_t i) const;
+    void forget_scans();
+
+    std::vector<Block> blocks_;
+    size_t lines_ = 0;
+    const char* end_ = nullptr;         // Just past the last line (and its '\n')
+    bool terminated_ = true;            // Last line ends with '\n'
+
+    mutable ScannedBlock scanned_[CACHED_BLOCKS];
+    mutable uint64_t use_clock_ = 0;
+};
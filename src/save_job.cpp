@@ -0,0 +1,41 @@
+#include <save_job.hpp>
+#include <algorithm>
+
+SaveJob::SaveJob(Blocks blocks, SaveFunction save, std::function<void()> listener)
+    : blocks_(std::move(blocks)), save_(std::move(save)), listener_(std::move(listener)) {
+    for (std::string_view block : blocks_) {
+        total_bytes_ += block.size();
+    }
+    worker_ = std::thread(&SaveJob::run, this);
+}
+
+SaveJob::~SaveJob() {
+    wait();
+}
+
+void SaveJob::wait() {
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+float SaveJob::progress() const {
+    if (total_bytes_ == 0) return done() ? 1.0f : 0.0f;
+    return static_cast<float>(written_.load(std::memory_order_relaxed)) / static_cast<float>(total_bytes_);
+}
+
+void SaveJob::run() {
+    // Wake the owner once per percent, not for every batch written
+    const size_t step = std::max<size_t>(total_bytes_ / 100, 1);
+    size_t next_report = step;
+    result_ = save_(blocks_, [this, step, &next_report](size_t written) {
+        written_.store(written, std::memory_order_relaxed);
+        if (written >= next_report) {
+            next_report = written + step;
+            if (listener_) listener_();
+        }
+    });
+
+    done_.store(true, std::memory_order_release);
+    if (listener_) listener_();
+}
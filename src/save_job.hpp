@@ -0,0 +1,52 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+/// @brief Writes a document out on a worker thread
+///
+/// The document comes as text blocks (see TextBuffer::text_blocks()), which
+/// stay unchanged while the editor goes on editing the buffer. A listener is
+/// called from the worker as the save progresses and once it is done.
+class SaveJob {
+public:
+    using Blocks = std::vector<std::string_view>;
+    /// @brief Report the bytes written so far
+    using Progress = std::function<void(size_t written)>;
+    /// @brief Write the blocks somewhere, returns 0 or an error code for the owner
+    using SaveFunction = std::function<int(const Blocks& blocks, const Progress& progress)>;
+
+    /// @brief Start running `save` on `blocks`
+    /// @param listener Called on the worker thread whenever progress() moved
+    ///                 by a percent, and once done() (the last call)
+    SaveJob(Blocks blocks, SaveFunction save, std::function<void()> listener);
+    /// @brief Waits for the save - it is never cut short, that would leave a half-written file
+    ~SaveJob();
+
+    SaveJob(const SaveJob&) = delete;
+    SaveJob& operator=(const SaveJob&) = delete;
+
+    /// @brief Block until the save is done
+    void wait();
+
+    bool done() const { return done_.load(std::memory_order_acquire); }
+    /// @brief Return value of the save function, valid once done()
+    int result() const { return result_; }
+    /// @brief Share of the document written so far, 0.0 to 1.0
+    float progress() const;
+
+private:
+    void run();
+
+    Blocks blocks_;
+    size_t total_bytes_ = 0;
+    SaveFunction save_;
+    std::function<void()> listener_;
+    int result_ = 0;                       // Written by the worker before done_ is set
+    std::atomic<size_t> written_{0};
+    std::atomic<bool> done_{false};
+    std::thread worker_;                   // Last, starts after everything above exists
+};
@@ -1,5 +1,4 @@
 #include <selection_manager.hpp>
-#include <formatter.hpp>
 #include <algorithm>  // For std::min, std::max, std::swap
 
 SelectionManager::SelectionManager() {}
@@ -43,7 +42,7 @@ void SelectionManager::select_all(int end_x, int end_y) {
 }
 
 void SelectionManager::delete_selection(
-    std::vector<std::string>& buffer,
+    TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y
 ) {
@@ -54,16 +53,16 @@ void SelectionManager::delete_selection(
 
     if (start_y == end_y) {
         // Single line deletion
-        buffer[start_y].erase(start_x, end_x - start_x);
+        buffer.erase_text(start_y, start_x, end_x - start_x);
         cursor_x = start_x;
         cursor_y = start_y;
     } else {
-        // Multi-line deletion - string concatenation using +
-        std::string remaining = buffer[start_y].substr(0, start_x) +
-                               buffer[end_y].substr(end_x);
-        buffer[start_y] = remaining;
-        // vector.erase with iterators
-        buffer.erase(buffer.begin() + start_y + 1, buffer.begin() + end_y + 1);
+        // Multi-line deletion - keep the head of the first line and the tail of the last
+        std::string remaining(buffer.line(start_y).substr(0, start_x));
+        remaining += buffer.line(end_y).substr(end_x);
+        buffer.set_line(start_y, remaining);
+        // Drops whole pieces, the lines below the selection are not moved
+        buffer.erase_lines(start_y + 1, end_y - start_y);
         cursor_x = start_x;
         cursor_y = start_y;
     }
@@ -71,7 +70,7 @@ void SelectionManager::delete_selection(
     clear_selection();
 }
 
-std::string SelectionManager::get_selected_text(const std::vector<std::string>& buffer) const {
+std::string SelectionManager::get_selected_text(const TextBuffer& buffer) const {
     if (!has_selection) return "";
 
     int start_x, start_y, end_x, end_y;
@@ -79,14 +78,19 @@ std::string SelectionManager::get_selected_text(const std::vector<std::string>&
 
     if (start_y == end_y) {
         // Single line
-        return buffer[start_y].substr(start_x, end_x - start_x);
+        return std::string(buffer.line(start_y).substr(start_x, end_x - start_x));
     } else {
-        // Multi-line
-        std::string result = buffer[start_y].substr(start_x) + "\n";
+        // Multi-line - walk the lines in order instead of looking each one up
+        auto it = buffer.iterator_at(start_y);
+        std::string result((*it).substr(start_x));
+        result += '\n';
         for (int y = start_y + 1; y < end_y; y++) {
-            result += buffer[y] + "\n";
+            ++it;
+            result += *it;
+            result += '\n';
         }
-        result += buffer[end_y].substr(0, end_x);
+        ++it;
+        result += (*it).substr(0, end_x);
         return result;
     }
 }
@@ -117,19 +121,18 @@ void SelectionManager::get_bounds(int& start_x, int& start_y, int& end_x, int& e
     end_y = selection_end_y;
 }
 
-void SelectionManager::adjust_selection_for_formatting(const std::vector<std::string>& buffer) {
+void SelectionManager::adjust_selection_for_formatting(const TextBuffer& buffer, FormatSpanIndex& format_spans) {
     if (!has_selection) return;
 
     int start_x, start_y, end_x, end_y;
     get_normalized_bounds(start_x, start_y, end_x, end_y);
 
     // Only adjust single-line selections for now
-    if (start_y != end_y || start_y >= (int)buffer.size()) return;
+    if (start_y != end_y || start_y >= (int)buffer.line_count()) return;
 
-    const std::string& line = buffer[start_y];
-
-    // Use the object-oriented formatter approach
-    adjust_selection_bounds(line, start_x, end_x);
+    // Take in the whole of every span the selection overlaps
+    if (start_x < 0 || end_x < 0 || start_x >= (int)buffer.line_length(start_y)) return;
+    format_spans.line(buffer, start_y).expand_range(start_x, end_x);
 
     // Update the selection bounds preserving original direction
     if (selection_start_y == start_y &&
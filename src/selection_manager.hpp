@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
-#include <vector>
+#include <text_buffer.hpp>
+#include <format_span_index.hpp>
 
 /// @brief Manages text selection operations
 /// Similar to TextSelection class in WPF, but more manual
@@ -19,13 +20,13 @@ public:
 
     // '&' means pass by reference (modifies original, like 'ref' in C#)
     void delete_selection(
-        std::vector<std::string>& buffer,  // Modifies buffer
+        TextBuffer& buffer,                 // Modifies buffer
         int& cursor_x,                      // Modifies cursor position
         int& cursor_y
     );
 
     // 'const &' means readonly reference (like 'in' parameter in C#)
-    std::string get_selected_text(const std::vector<std::string>& buffer) const;
+    std::string get_selected_text(const TextBuffer& buffer) const;
 
     // Get selection bounds - all parameters passed by reference to modify them
     void get_bounds(int& start_x, int& start_y, int& end_x, int& end_y) const;
@@ -34,7 +35,7 @@ public:
     void get_normalized_bounds(int& start_x, int& start_y, int& end_x, int& end_y) const;
 
     // Adjust selection to include any opening formatting markers before the start position
-    void adjust_selection_for_formatting(const std::vector<std::string>& buffer);
+    void adjust_selection_for_formatting(const TextBuffer& buffer, FormatSpanIndex& format_spans);
 
 private:
     // Private fields (like C# private fields)
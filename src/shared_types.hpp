@@ -3,6 +3,9 @@
 #include <vector>
 #include <functional>
 
+class TextBuffer;
+class FormatSpanIndex;
+
 /// @brief Status type used for UI status bars and file operation results
 enum class StatusBarType {
     NORMAL,
@@ -35,9 +38,31 @@ enum class EditorMode {
     Count // keep at end to get count via std::to_underlying
 };
 
+/// @brief Selected text in document order, end exclusive
+struct SelectionRange {
+    bool active = false;
+    int start_x = 0;
+    int start_y = 0;
+    int end_x = 0;
+    int end_y = 0;
+
+    /// @brief Selected columns [begin, end) of line y, an empty range if none are
+    void in_line(int y, int line_length, int& begin, int& end) const {
+        begin = end = 0;
+        if (!active || y < start_y || y > end_y) return;
+        const int first = y == start_y ? start_x : 0;
+        const int last = y == end_y ? end_x : line_length;
+        if (first < last) {
+            begin = first;
+            end = last;
+        }
+    }
+};
+
 /// @brief Parameters for rendering the editor UI
 struct RenderParams {
-    const std::vector<std::string>& buffer;
+    const TextBuffer& buffer;
+    FormatSpanIndex& format_spans;
     int cursor_x;
     int cursor_y;
     int scroll_y;
@@ -49,11 +74,14 @@ struct RenderParams {
     EditorMode editor_mode;
     bool can_undo;
     bool can_redo;
+    const char* progress_label; // Work going on in the background ("Loading", "Saving"), null if none
+    int progress_percent;       // ... and how far along it is
     bool bold_active;
     bool italic_active;
     bool underline_active;
     bool strikethrough_active;
-    std::function<bool(int, int)> is_char_selected_fn;
+    SelectionRange selection;
+    bool debug_mode;            // Show the line cache counters in the status bar
 };
 
 /// @brief format type to be used for toggling formatting and checking active formatting at cursor
@@ -64,6 +92,12 @@ enum class FormatType {
     STRIKETHROUGH
 };
 
+/// @brief How hard a save waits for the data to reach the disk
+enum class SaveDurability {
+    FAST,    // Write and rename, the kernel flushes when it likes
+    DURABLE  // fsync the file before the rename and the directory after it
+};
+
 /// @brief Config operation status codes
 enum class ConfigStatus {
     SUCCESS = 1,
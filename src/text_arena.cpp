@@ -0,0 +1,66 @@
+#include <text_arena.hpp>
+#include <cstring>
+
+char* TextArena::allocate(size_t size) {
+    if (size > CHUNK_SIZE / 4) {
+        // Long line - dedicated chunk, the current chunk keeps its free space
+        chunks_.push_back(std::make_unique_for_overwrite<char[]>(size));
+        capacity_ += size;
+        last_limit_ = chunks_.back().get() + size;
+        last_in_chunk_ = false;
+        return chunks_.back().get();
+    }
+
+    if (static_cast<size_t>(chunk_end_ - cursor_) < size) {
+        chunks_.push_back(std::make_unique_for_overwrite<char[]>(CHUNK_SIZE));
+        capacity_ += CHUNK_SIZE;
+        cursor_ = chunks_.back().get();
+        chunk_end_ = cursor_ + CHUNK_SIZE;
+    }
+
+    char* data = cursor_;
+    cursor_ += size;
+    last_limit_ = chunk_end_;
+    last_in_chunk_ = true;
+    return data;
+}
+
+const char* TextArena::store(std::string_view text) {
+    char* data = allocate(text.size());
+    if (!text.empty()) {
+        std::memcpy(data, text.data(), text.size());
+    }
+    last_ = data;
+    return data;
+}
+
+char* TextArena::store_uninitialized(size_t size) {
+    char* data = allocate(size);
+    last_ = data;
+    return data;
+}
+
+const char* TextArena::replace_last(std::string_view text) {
+    if (last_ == nullptr || static_cast<size_t>(last_limit_ - last_) < text.size()) {
+        return store(text);
+    }
+
+    if (!text.empty()) {
+        std::memmove(last_, text.data(), text.size());
+    }
+    // Give back (or take) the free space behind it in the shared chunk
+    if (last_in_chunk_) {
+        cursor_ = last_ + text.size();
+    }
+    return last_;
+}
+
+void TextArena::clear() {
+    chunks_.clear();
+    cursor_ = nullptr;
+    chunk_end_ = nullptr;
+    last_ = nullptr;
+    last_limit_ = nullptr;
+    last_in_chunk_ = false;
+    capacity_ = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+/// @brief Monotonic arena for the text of edited lines
+///
+/// Text is copied into 64 KB chunks (long lines get a chunk of their own) and
+/// never moves or gets freed individually, so stored lines keep their address
+/// and the arena never copies its contents to grow. Everything is released at
+/// once by clear() or the destructor.
+class TextArena {
+public:
+    /// @brief Copy text into the arena, returns its (stable) address
+    const char* store(std::string_view text);
+    /// @brief Like store(), for `size` bytes the caller writes at the address right away
+    char* store_uninitialized(size_t size);
+
+    /// @brief Replace the text of the most recent store() call
+    ///
+    /// Rewritten in place while it still fits behind the old text, otherwise
+    /// stored anew. `text` may point into the old text.
+    const char* replace_last(std::string_view text);
+
+    void clear();
+
+    /// @brief Bytes reserved from the system, for diagnostics
+    size_t capacity() const { return capacity_; }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    char* allocate(size_t size);
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* cursor_ = nullptr;       // Free space in the current chunk
+    char* chunk_end_ = nullptr;
+    char* last_ = nullptr;         // Text of the last store() ...
+    char* last_limit_ = nullptr;   // ... and how far it may grow in place
+    bool last_in_chunk_ = false;   // Last text sits in the current shared chunk
+    size_t capacity_ = 0;
+};
@@ -0,0 +1,1046 @@
+#include <text_buffer.hpp>
+#include <line_indexer.hpp>
+#include <newline_scanner.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_set>
+#include <utility>
+
+/// @brief B-tree node. Leaves hold pieces, internal nodes hold children of equal height.
+struct TextBuffer::Node {
+    bool leaf = true;
+    size_t lines = 0;                // Lines below this node
+    size_t bytes = 0;                // Bytes below this node, newlines excluded
+    std::vector<Piece> pieces;       // Leaf only
+    std::vector<NodePtr> children;   // Internal only
+
+    size_t item_count() const { return leaf ? pieces.size() : children.size(); }
+};
+
+namespace {
+
+using Piece = TextBuffer::Piece;
+
+// Ensure a piece boundary at local line y of a leaf, returns the index of the piece starting there
+size_t split_pieces_at(std::vector<Piece>& pieces, size_t y) {
+    size_t start = 0;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (y == start) return i;
+        if (y < start + pieces[i].count) {
+            size_t offset = y - start;
+            Piece tail{pieces[i].source, pieces[i].first + offset, pieces[i].count - offset};
+            pieces[i].count = offset;
+            pieces.insert(pieces.begin() + i + 1, tail);
+            return i + 1;
+        }
+        start += pieces[i].count;
+    }
+    return pieces.size();
+}
+
+// Merge piece i with its successor when they continue the same source run
+void merge_pieces(std::vector<Piece>& pieces, size_t i) {
+    if (i + 1 >= pieces.size()) return;
+
+    Piece& current = pieces[i];
+    const Piece& next = pieces[i + 1];
+    if (current.source == next.source && current.first + current.count == next.first) {
+        current.count += next.count;
+        pieces.erase(pieces.begin() + i + 1);
+    }
+}
+
+} // namespace
+
+TextBuffer::TextBuffer() {
+    clear();
+}
+
+TextBuffer::~TextBuffer() {
+    // Stop the indexer before the text it reads goes away
+    indexer_.reset();
+}
+
+// ===== LineIterator =====
+
+TextBuffer::LineIterator::LineIterator(const TextBuffer* buffer, const Node* root, bool live, size_t y)
+    : buffer_(buffer), root_(root), live_(live) {
+    seek(y);
+}
+
+void TextBuffer::LineIterator::seek(size_t y) {
+    line_ = y;
+    leaf_ = y < root_->lines ? TextBuffer::locate(root_, y, piece_, offset_) : nullptr;
+}
+
+std::string_view TextBuffer::LineIterator::operator*() const {
+    if (on_active_line()) {
+        return buffer_->active_.text();
+    }
+    const Piece& piece = leaf_->pieces[piece_];
+    return buffer_->span_text(piece.source, piece.first + offset_);
+}
+
+TextBuffer::LineRef TextBuffer::LineIterator::ref() const {
+    const Piece& piece = leaf_->pieces[piece_];
+    return LineRef{piece.source, piece.first + offset_};
+}
+
+LineInfo TextBuffer::LineIterator::info() const {
+    if (on_active_line()) {
+        return LineInfo::describe(buffer_->active_.text());
+    }
+    const Piece& piece = leaf_->pieces[piece_];
+    return buffer_->span_info(piece.source, piece.first + offset_);
+}
+
+bool TextBuffer::LineIterator::same_text_as(const LineIterator& other) const {
+    if (!on_active_line() && !other.on_active_line()) {
+        const Piece& piece = leaf_->pieces[piece_];
+        const Piece& other_piece = other.leaf_->pieces[other.piece_];
+        const size_t index = piece.first + offset_;
+        const size_t other_index = other_piece.first + other.offset_;
+
+        if (piece.source == other_piece.source && index == other_index) return true;
+        if (buffer_->span_info(piece.source, index).hash != buffer_->span_info(other_piece.source, other_index).hash) {
+            return false;
+        }
+    }
+    return **this == *other;
+}
+
+TextBuffer::LineIterator& TextBuffer::LineIterator::operator++() {
+    line_++;
+    if (++offset_ == leaf_->pieces[piece_].count) {
+        offset_ = 0;
+        if (++piece_ == leaf_->pieces.size()) {
+            // Crossed into the next leaf
+            seek(line_);
+        }
+    }
+    return *this;
+}
+
+TextBuffer::LineIterator& TextBuffer::LineIterator::operator--() {
+    if (leaf_ && offset_ > 0) {
+        offset_--;
+        line_--;
+    } else if (leaf_ && piece_ > 0) {
+        piece_--;
+        offset_ = leaf_->pieces[piece_].count - 1;
+        line_--;
+    } else {
+        seek(line_ - 1);
+    }
+    return *this;
+}
+
+// ===== Loading =====
+
+void TextBuffer::load(std::string contents) {
+    release();
+    original_ = std::move(contents);
+
+    // Loaded lines are views into original_, sized up front so the line table
+    // is allocated once instead of growing through millions of push_backs
+    const std::string_view text(original_);
+    original_lines_.reserve(NewlineScanner::count_newlines(text) + 1);
+    original_lines_.push_lines(text, std::numeric_limits<size_t>::max());
+
+    reset_document();
+}
+
+void TextBuffer::load(MappedFile file, size_t first_lines, bool paged) {
+    release();
+    mapped_ = std::move(file);
+    paged_ = paged;
+
+    auto push_lines = [this](std::string_view text, size_t max_lines) {
+        return paged_ ? original_pages_.push_lines(text, max_lines) : original_lines_.push_lines(text, max_lines);
+    };
+
+    // The first lines are split right here, the rest on the indexer thread
+    const std::string_view text = mapped_.view();
+    size_t indexed = push_lines(text, first_lines);
+    if (text.size() - indexed <= SYNC_INDEX_BYTES) {
+        push_lines(text.substr(indexed), std::numeric_limits<size_t>::max());
+    } else {
+        if (paged_) {
+            // One pass over a file that doesn't fit in memory, don't let it push out everything else
+            mapped_.set_sequential(true);
+        }
+        indexer_ = std::make_unique<LineIndexer>(text.substr(indexed), paged_);
+        indexer_->set_listener(index_listener_);
+    }
+
+    reset_document();
+}
+
+void TextBuffer::release() {
+    edit_count_++;
+    changed_.reset();
+    indexer_.reset();
+    original_lines_.clear();
+    original_pages_.clear();
+    paged_ = false;
+    add_.clear();
+    add_lines_.clear();
+    sealed_spans_ = 0;
+    active_.clear();
+    active_line_ = NO_ACTIVE_LINE;
+    original_.clear();
+    mapped_.close();
+}
+
+void TextBuffer::reset_document() {
+    root_ = std::make_shared<Node>();
+    if (original_size() == 0) {
+        // Empty file - the document still needs one (empty) line
+        root_->pieces.push_back({Source::ADD, append_line(""), 1});
+    } else {
+        root_->pieces.push_back({Source::ORIGINAL, 0, original_size()});
+    }
+    refresh(*root_);
+    total_lines_ = root_->lines;
+}
+
+void TextBuffer::clear() {
+    load(std::string());
+}
+
+// ===== Background indexing =====
+
+bool TextBuffer::poll_index() {
+    if (!indexer_) return false;
+
+    bool done = false;
+    const size_t first = original_size();
+    for (const LineIndexer::Batch& batch : indexer_->take_batches(done)) {
+        if (paged_) {
+            original_pages_.append(batch.pages);
+        } else {
+            original_lines_.append(batch.lines);
+        }
+    }
+    if (done) {
+        indexer_.reset();
+        mapped_.set_sequential(false);
+    }
+
+    const size_t count = original_size() - first;
+    if (count == 0) return false;
+    // Until the first lines arrive the document is reset_document()'s empty
+    // placeholder line, which they replace
+    const size_t replaced = first == 0 ? total_lines_ : 0;
+    splice(total_lines_ - replaced, replaced, {Piece{Source::ORIGINAL, first, count}});
+    return true;
+}
+
+float TextBuffer::index_progress() const {
+    if (!indexer_) return 1.0f;
+    // The indexer got the part of the file load() didn't split itself
+    const size_t indexed = mapped_.size() - indexer_->total_bytes() + indexer_->indexed_bytes();
+    return static_cast<float>(indexed) / static_cast<float>(mapped_.size());
+}
+
+void TextBuffer::set_index_listener(std::function<void()> listener) {
+    index_listener_ = std::move(listener);
+    if (indexer_) {
+        indexer_->set_listener(index_listener_);
+    }
+}
+
+void TextBuffer::detach_original() {
+    if (!mapped_.is_open()) return;
+
+    original_.assign(mapped_.view());
+    original_lines_.rebase(mapped_.data(), original_.data());
+    original_pages_.rebase(mapped_.data(), original_.data());
+    mapped_.close();
+}
+
+size_t TextBuffer::byte_count() const {
+    if (total_lines_ == 0) return 0;
+    size_t bytes = root_->bytes + total_lines_ - 1;
+    if (active_line_ != NO_ACTIVE_LINE) {
+        bytes = bytes - active_base_length_ + active_.size();
+    }
+    return bytes;
+}
+
+// ===== Line access =====
+
+std::string_view TextBuffer::span_text(Source source, size_t index) const {
+    if (paged_ && source == Source::ORIGINAL) return original_pages_.text(index);
+    return table(source).text(index);
+}
+
+LineInfo TextBuffer::span_info(Source source, size_t index) const {
+    if (paged_ && source == Source::ORIGINAL) return original_pages_.info(index);
+    return table(source).info(index);
+}
+
+size_t TextBuffer::piece_bytes(const Piece& piece, size_t count) const {
+    if (paged_ && piece.source == Source::ORIGINAL) return original_pages_.run_length(piece.first, count);
+    return table(piece.source).run_length(piece.first, count);
+}
+
+const TextBuffer::Node* TextBuffer::locate(const Node* root, size_t y, size_t& piece, size_t& offset) {
+    const Node* node = root;
+    while (!node->leaf) {
+        for (const NodePtr& child : node->children) {
+            if (y < child->lines) {
+                node = child.get();
+                break;
+            }
+            y -= child->lines;
+        }
+    }
+
+    piece = 0;
+    while (y >= node->pieces[piece].count) {
+        y -= node->pieces[piece].count;
+        piece++;
+    }
+    offset = y;
+    return node;
+}
+
+std::string_view TextBuffer::line(size_t y) const {
+    if (y == active_line_) return active_.text();
+
+    size_t piece, offset;
+    const Node* leaf = locate(root_.get(), y, piece, offset);
+    return span_text(leaf->pieces[piece].source, leaf->pieces[piece].first + offset);
+}
+
+size_t TextBuffer::line_length(size_t y) const {
+    if (y == active_line_) return active_.size();
+    return line(y).length();
+}
+
+char TextBuffer::byte_at(size_t y, size_t x) const {
+    if (y == active_line_) return active_.at(x);
+    return line(y)[x];
+}
+
+LineInfo TextBuffer::line_info(size_t y) const {
+    return iterator_at(y).info();
+}
+
+uint64_t TextBuffer::content_hash() const {
+    // The position counts too, so reordered lines hash differently
+    uint64_t hash = total_lines_;
+    for (auto it = begin(); it != end(); ++it) {
+        hash = (hash ^ it.info().hash) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// ===== Output =====
+
+bool TextBuffer::write_to(const std::function<bool(std::string_view)>& sink) const {
+    size_t y = 0;
+    return write_node(*root_, y, sink);
+}
+
+bool TextBuffer::write_node(const Node& node, size_t& y, const std::function<bool(std::string_view)>& sink) const {
+    if (!node.leaf) {
+        for (const NodePtr& child : node.children) {
+            if (!write_node(*child, y, sink)) return false;
+        }
+        return true;
+    }
+
+    for (const Piece& piece : node.pieces) {
+        size_t first = 0;
+        while (first < piece.count) {
+            // The active line's text is in the gap buffer, not where the piece points
+            size_t count = piece.count - first;
+            if (active_line_ >= y + first && active_line_ < y + piece.count) {
+                count = active_line_ - y - first;
+            }
+
+            if (count == 0) {
+                if (!sink(active_.text()) || !sink("\n")) return false;
+                first++;
+            } else if (piece.source == Source::ORIGINAL) {
+                // Consecutive file lines are contiguous in the original
+                // buffer, '\n' separators included
+                const Piece run{piece.source, piece.first + first, count};
+                const char* start = span_text(run.source, run.first).data();
+                if (!sink(std::string_view(start, piece_bytes(run) + count - 1)) || !sink("\n")) return false;
+                first += count;
+            } else {
+                for (size_t i = first; i < first + count; i++) {
+                    if (!sink(span_text(piece.source, piece.first + i)) || !sink("\n")) return false;
+                }
+                first += count;
+            }
+        }
+        y += piece.count;
+    }
+    return true;
+}
+
+std::vector<std::string_view> TextBuffer::text_blocks() {
+    // Sealed like a snapshot, no line the blocks point at is rewritten in place anymore
+    flush_active_line();
+    sealed_spans_ = add_lines_.size();
+
+    std::vector<std::string_view> blocks;
+    write_to([&blocks](std::string_view text) {
+        blocks.push_back(text);
+        return true;
+    });
+    return blocks;
+}
+
+void TextBuffer::prefetch_lines(size_t first, size_t count) const {
+    if (!paged_) return;
+
+    const size_t end = std::min(first + count, total_lines_);
+    size_t y = first;
+    while (y < end) {
+        size_t piece_index, offset;
+        const Node* leaf = locate(root_.get(), y, piece_index, offset);
+        const Piece& piece = leaf->pieces[piece_index];
+        const size_t lines = std::min(piece.count - offset, end - y);
+        if (piece.source == Source::ORIGINAL) {
+            mapped_.prefetch(original_pages_.block_range(piece.first + offset, lines));
+        }
+        y += lines;
+    }
+}
+
+TextBuffer::LineIterator TextBuffer::iterator_at(size_t y) const {
+    return LineIterator(this, root_.get(), true, y);
+}
+
+TextBuffer::LineIterator TextBuffer::iterator_at(const Snapshot& snapshot, size_t y) const {
+    return LineIterator(this, snapshot.root.get(), false, y);
+}
+
+// ===== Tree maintenance =====
+
+TextBuffer::Node& TextBuffer::mutable_node(NodePtr& node) {
+    if (node.use_count() > 1) {
+        node = std::make_shared<Node>(*node);
+    }
+    return *node;
+}
+
+void TextBuffer::refresh(Node& node) const {
+    node.lines = 0;
+    node.bytes = 0;
+    if (node.leaf) {
+        for (const Piece& piece : node.pieces) {
+            node.lines += piece.count;
+            node.bytes += piece_bytes(piece);
+        }
+    } else {
+        for (const NodePtr& child : node.children) {
+            node.lines += child->lines;
+            node.bytes += child->bytes;
+        }
+    }
+}
+
+void TextBuffer::rebalance(Node& node) const {
+    auto& children = node.children;
+    size_t i = 0;
+    while (i < children.size()) {
+        const size_t size = children[i]->item_count();
+
+        if (size == 0) {
+            children.erase(children.begin() + i);
+            continue;
+        }
+
+        if (size > MAX_NODE_ITEMS) {
+            // Split into halves (or thirds, ...) so each part is at least half full
+            const size_t parts = (size + MAX_NODE_ITEMS / 2 - 1) / (MAX_NODE_ITEMS / 2);
+            const Node& full = *children[i];
+            std::vector<NodePtr> split;
+            for (size_t part = 0; part < parts; part++) {
+                const size_t from = size * part / parts;
+                const size_t to = size * (part + 1) / parts;
+                auto sibling = std::make_shared<Node>();
+                sibling->leaf = full.leaf;
+                if (full.leaf) {
+                    sibling->pieces.assign(full.pieces.begin() + from, full.pieces.begin() + to);
+                } else {
+                    sibling->children.assign(full.children.begin() + from, full.children.begin() + to);
+                }
+                refresh(*sibling);
+                split.push_back(std::move(sibling));
+            }
+            children.erase(children.begin() + i);
+            children.insert(children.begin() + i, split.begin(), split.end());
+            i += split.size();
+            continue;
+        }
+
+        if (size < MIN_NODE_ITEMS && children.size() > 1) {
+            // Fold into a neighbour, the result is checked again on the next pass
+            const size_t left = i + 1 < children.size() ? i : i - 1;
+            Node& target = mutable_node(children[left]);
+            const Node& source = *children[left + 1];
+            if (target.leaf) {
+                const size_t seam = target.pieces.size();
+                target.pieces.insert(target.pieces.end(), source.pieces.begin(), source.pieces.end());
+                if (seam > 0) merge_pieces(target.pieces, seam - 1);
+            } else {
+                target.children.insert(target.children.end(), source.children.begin(), source.children.end());
+            }
+            refresh(target);
+            children.erase(children.begin() + left + 1);
+            i = left;
+            if (target.item_count() <= MAX_NODE_ITEMS && target.item_count() >= MIN_NODE_ITEMS) i++;
+            continue;
+        }
+
+        i++;
+    }
+}
+
+void TextBuffer::fix_root() {
+    while (root_->item_count() > MAX_NODE_ITEMS) {
+        auto parent = std::make_shared<Node>();
+        parent->leaf = false;
+        parent->children.push_back(std::move(root_));
+        rebalance(*parent);
+        refresh(*parent);
+        root_ = std::move(parent);
+    }
+    while (!root_->leaf && root_->children.size() == 1) {
+        NodePtr only = root_->children.front();
+        root_ = std::move(only);
+    }
+    if (!root_->leaf && root_->children.empty()) {
+        root_ = std::make_shared<Node>();
+    }
+    total_lines_ = root_->lines;
+}
+
+void TextBuffer::erase_range(NodePtr& node, size_t first, size_t count) {
+    Node& current = mutable_node(node);
+
+    if (current.leaf) {
+        size_t begin = split_pieces_at(current.pieces, first);
+        size_t end = split_pieces_at(current.pieces, first + count);
+        current.pieces.erase(current.pieces.begin() + begin, current.pieces.begin() + end);
+        if (begin > 0) merge_pieces(current.pieces, begin - 1);
+        refresh(current);
+        return;
+    }
+
+    const size_t last = first + count;
+    size_t start = 0;
+    for (size_t i = 0; i < current.children.size() && start < last; i++) {
+        const size_t child_lines = current.children[i]->lines;
+        const size_t from = std::max(first, start);
+        const size_t to = std::min(last, start + child_lines);
+        if (from < to) {
+            if (from == start && to == start + child_lines) {
+                // Whole subtree goes, rebalance() drops the empty node
+                current.children[i] = std::make_shared<Node>();
+            } else {
+                erase_range(current.children[i], from - start, to - from);
+            }
+        }
+        start += child_lines;
+    }
+
+    rebalance(current);
+    refresh(current);
+}
+
+void TextBuffer::insert_pieces(NodePtr& node, size_t y, const std::vector<Piece>& pieces) {
+    Node& current = mutable_node(node);
+
+    if (current.leaf) {
+        size_t at = split_pieces_at(current.pieces, y);
+        current.pieces.insert(current.pieces.begin() + at, pieces.begin(), pieces.end());
+        // Glue the seams back together (later seam first so `at` stays valid)
+        merge_pieces(current.pieces, at + pieces.size() - 1);
+        if (at > 0) merge_pieces(current.pieces, at - 1);
+        refresh(current);
+        return;
+    }
+
+    // Appending at a child boundary extends the earlier child
+    size_t start = 0;
+    size_t i = 0;
+    while (i + 1 < current.children.size() && y > start + current.children[i]->lines) {
+        start += current.children[i]->lines;
+        i++;
+    }
+    insert_pieces(current.children[i], y - start, pieces);
+
+    rebalance(current);
+    refresh(current);
+}
+
+void TextBuffer::splice(size_t first, size_t count, const std::vector<Piece>& replacement) {
+    // Line numbers are about to shift, the active line has to be in the tree
+    // first - unless it is one of the replaced lines, callers already copied it
+    if (active_line_ >= first && active_line_ < first + count) {
+        active_line_ = NO_ACTIVE_LINE;
+        active_.clear();
+    } else {
+        flush_active_line();
+    }
+
+    if (count > 0) {
+        erase_range(root_, first, count);
+        fix_root();
+    }
+
+    std::vector<Piece> pieces;
+    for (const Piece& piece : replacement) {
+        if (piece.count > 0) pieces.push_back(piece);
+    }
+    if (!pieces.empty()) {
+        insert_pieces(root_, first, pieces);
+        fix_root();
+    }
+}
+
+// ===== Change tracking =====
+
+void TextBuffer::note_change(size_t first, size_t old_count, size_t new_count) {
+    if (!changed_) {
+        changed_ = ChangedRange{first, old_count, new_count};
+        return;
+    }
+    // Union of both in current line numbers. Lines of it outside the range so
+    // far are still the old ones, one for one.
+    const size_t begin = std::min(changed_->first, first);
+    const size_t end = std::max(changed_->first + changed_->new_count, first + old_count);
+    changed_->old_count = end - begin - changed_->new_count + changed_->old_count;
+    changed_->new_count = end - begin - old_count + new_count;
+    changed_->first = begin;
+}
+
+std::optional<TextBuffer::ChangedRange> TextBuffer::take_changed_range() {
+    return std::exchange(changed_, std::nullopt);
+}
+
+size_t TextBuffer::append_line(std::string_view text) {
+    // Arena text never moves, so `text` may even point into it
+    const char* data = add_.store(text);
+    add_lines_.push_back(std::string_view(data, text.size()));
+    return add_lines_.size() - 1;
+}
+
+// ===== Active line =====
+
+void TextBuffer::activate_line(size_t y) {
+    if (y == active_line_) return;
+
+    flush_active_line();
+    active_.assign(line(y));
+    active_line_ = y;
+    active_base_length_ = active_.size();
+}
+
+void TextBuffer::flush_active_line() {
+    if (active_line_ == NO_ACTIVE_LINE) return;
+
+    const size_t y = active_line_;
+    active_line_ = NO_ACTIVE_LINE;
+    store_line(y, active_.text());
+    active_.clear();
+}
+
+// ===== Line content edits =====
+
+void TextBuffer::set_line(size_t y, std::string_view text) {
+    edit_count_++;
+    note_change(y, 1, 1);
+    if (y == active_line_) {
+        // Replaced wholesale, the gap buffer contents are stale
+        active_line_ = NO_ACTIVE_LINE;
+        std::string replacement(text);
+        active_.clear();
+        store_line(y, replacement);
+        return;
+    }
+    store_line(y, text);
+}
+
+void TextBuffer::store_line(size_t y, std::string_view text) {
+    size_t piece, offset;
+    const Node* leaf = locate(root_.get(), y, piece, offset);
+    const Piece& target = leaf->pieces[piece];
+    size_t span_index = target.first + offset;
+
+    // The newest add-buffer line is rewritten in place as long as no snapshot can
+    // see it, so a burst of typing on one line doesn't keep growing the add buffer.
+    if (target.source == Source::ADD && span_index + 1 == add_lines_.size() &&
+        span_index >= sealed_spans_) {
+        const size_t old_length = add_lines_.length(span_index);
+        const char* data = add_.replace_last(text);
+        add_lines_.update_last(std::string_view(data, text.size()));
+
+        // Only the cached byte counts along the path to the line change
+        NodePtr* slot = &root_;
+        while (true) {
+            Node& current = mutable_node(*slot);
+            current.bytes = current.bytes - old_length + text.size();
+            if (current.leaf) break;
+            for (NodePtr& child : current.children) {
+                if (y < child->lines) {
+                    slot = &child;
+                    break;
+                }
+                y -= child->lines;
+            }
+        }
+        return;
+    }
+
+    size_t index = append_line(text);
+    splice(y, 1, {Piece{Source::ADD, index, 1}});
+}
+
+void TextBuffer::insert_text(size_t y, size_t x, std::string_view text) {
+    edit_count_++;
+    note_change(y, 1, 1);
+    activate_line(y);
+    active_.insert(x, text);
+}
+
+void TextBuffer::erase_text(size_t y, size_t x, size_t length) {
+    edit_count_++;
+    note_change(y, 1, 1);
+    activate_line(y);
+    active_.erase(x, length);
+}
+
+// ===== Line structure edits =====
+
+void TextBuffer::split_line(size_t y, size_t x) {
+    edit_count_++;
+    note_change(y, 1, 2);
+    std::string_view current = line(y);
+    std::string head(current.substr(0, x));
+    std::string tail(current.substr(x));
+
+    size_t first = append_line(head);
+    append_line(tail);
+    splice(y, 1, {Piece{Source::ADD, first, 2}});
+}
+
+void TextBuffer::join_lines(size_t y) {
+    edit_count_++;
+    note_change(y, 2, 1);
+    std::string joined(line(y));
+    joined += line(y + 1);
+
+    size_t index = append_line(joined);
+    splice(y, 2, {Piece{Source::ADD, index, 1}});
+}
+
+void TextBuffer::insert_line(size_t y, std::string_view text) {
+    edit_count_++;
+    note_change(y, 0, 1);
+    size_t index = append_line(text);
+    splice(y, 0, {Piece{Source::ADD, index, 1}});
+}
+
+void TextBuffer::insert_lines(size_t y, const std::vector<std::string>& lines) {
+    replace_lines(y, 0, lines);
+}
+
+void TextBuffer::erase_lines(size_t first, size_t count) {
+    edit_count_++;
+    note_change(first, count, 0);
+    splice(first, count, {});
+}
+
+void TextBuffer::replace_lines(size_t first, size_t count, const std::vector<std::string>& lines) {
+    edit_count_++;
+    note_change(first, count, lines.size());
+    size_t first_span = add_lines_.size();
+    for (const std::string& text : lines) {
+        append_line(text);
+    }
+    splice(first, count, {Piece{Source::ADD, first_span, lines.size()}});
+}
+
+void TextBuffer::append_lines(std::string_view text) {
+    if (text.empty()) return;
+    edit_count_++;
+    const size_t first_span = store_lines(text);
+    note_change(total_lines_, 0, add_lines_.size() - first_span);
+    splice(total_lines_, 0, {Piece{Source::ADD, first_span, add_lines_.size() - first_span}});
+}
+
+void TextBuffer::compact() {
+    std::string text;
+    text.reserve(byte_count() + 1);
+    write_to([&text](std::string_view block) {
+        text.append(block);
+        return true;
+    });
+    load(std::move(text));
+}
+
+// ===== Add buffer compaction =====
+
+static constexpr size_t NOT_MOVED = static_cast<size_t>(-1);
+static constexpr size_t FREED = NOT_MOVED - 1;  // Not moved and counted as freed
+
+void TextBuffer::copy_add_pieces(NodePtr& node, TextArena& arena, LineTable& lines, std::vector<size_t>& moved,
+                                 std::unordered_map<const Node*, NodePtr>& copied) {
+    // Reached from another tree before - share the copy
+    const Node* original = node.get();
+    if (auto found = copied.find(original); found != copied.end()) {
+        node = found->second;
+        return;
+    }
+
+    Node& current = mutable_node(node);
+    if (!current.leaf) {
+        for (NodePtr& child : current.children) {
+            copy_add_pieces(child, arena, lines, moved, copied);
+        }
+        copied.emplace(original, node);
+        return;
+    }
+
+    for (Piece& piece : current.pieces) {
+        if (piece.source != Source::ADD) continue;
+        // A piece another tree copied already, in one run, is kept where it went
+        const size_t start = moved[piece.first];
+        bool whole = start != NOT_MOVED;
+        for (size_t i = 1; whole && i < piece.count; i++) {
+            whole = moved[piece.first + i] == start + i;
+        }
+        if (whole) {
+            piece.first = start;
+            continue;
+        }
+
+        // Copied as a whole, so the piece's lines stay consecutive - the
+        // node's line and byte counts don't change
+        const size_t first = lines.size();
+        for (size_t i = 0; i < piece.count; i++) {
+            const std::string_view text = add_lines_.text(piece.first + i);
+            lines.push_back(std::string_view(arena.store(text), text.size()));
+            if (moved[piece.first + i] == NOT_MOVED) moved[piece.first + i] = first + i;
+        }
+        piece.first = first;
+    }
+    copied.emplace(original, node);
+}
+
+std::vector<size_t> TextBuffer::compact_add_buffer(const std::vector<LineRef*>& refs,
+                                                   const std::vector<Snapshot*>& snapshots,
+                                                   const std::vector<Piece>& released) {
+    flush_active_line();
+
+    TextArena arena;
+    LineTable lines;
+    std::vector<size_t> moved(add_lines_.size(), NOT_MOVED);
+    std::unordered_map<const Node*, NodePtr> copied;
+    // The old trees stay alive until the end, so no address in `copied` is reused meanwhile
+    std::vector<NodePtr> old_roots{root_};
+    copy_add_pieces(root_, arena, lines, moved, copied);
+    for (Snapshot* snapshot : snapshots) {
+        NodePtr root = std::const_pointer_cast<Node>(snapshot->root);
+        old_roots.push_back(root);
+        copy_add_pieces(root, arena, lines, moved, copied);
+        snapshot->root = std::move(root);
+    }
+
+    // Lines only the history still refers to
+    for (LineRef* ref : refs) {
+        if (ref->source != Source::ADD) continue;
+        size_t& index = moved[ref->index];
+        if (index == NOT_MOVED) {
+            const std::string_view text = add_lines_.text(ref->index);
+            lines.push_back(std::string_view(arena.store(text), text.size()));
+            index = lines.size() - 1;
+        }
+        ref->index = index;
+    }
+
+    // Lines no one kept are freed, each counted once
+    std::vector<size_t> freed(released.size(), 0);
+    for (size_t i = 0; i < released.size(); i++) {
+        for (size_t j = released[i].first; j < released[i].first + released[i].count; j++) {
+            if (moved[j] != NOT_MOVED) continue;
+            freed[i] += add_lines_.length(j) + LineTable::ROW_BYTES;
+            moved[j] = FREED;
+        }
+    }
+
+    add_ = std::move(arena);
+    add_lines_ = std::move(lines);
+    // Handles now point at every line, none may be rewritten in place
+    sealed_spans_ = add_lines_.size();
+    return freed;
+}
+
+// ===== Patching =====
+
+std::vector<LineDiff::Change> TextBuffer::diff(const LineTable& lines) const {
+    // Hashes first, the bytes only when they match
+    std::vector<std::string_view> texts;
+    std::vector<uint64_t> hashes;
+    texts.reserve(total_lines_);
+    hashes.reserve(total_lines_);
+    for (auto it = begin(); it != end(); ++it) {
+        texts.push_back(*it);
+        hashes.push_back(it.info().hash);
+    }
+
+    return LineDiff::diff(total_lines_, lines.size(), [&](size_t i, size_t j) {
+        return hashes[i] == lines.hash(j) && texts[i] == lines.text(j);
+    });
+}
+
+void TextBuffer::patch(const std::vector<LineDiff::Change>& changes, const LineTable& lines) {
+    // Back to front, so the line numbers of the changes still to do stay valid
+    for (auto change = changes.rbegin(); change != changes.rend(); ++change) {
+        std::vector<std::string> replacement;
+        replacement.reserve(change->new_count);
+        for (size_t j = change->new_first; j < change->new_first + change->new_count; j++) {
+            replacement.emplace_back(lines.text(j));
+        }
+        replace_lines(change->old_first, change->old_count, replacement);
+    }
+}
+
+// ===== Snapshots =====
+
+TextBuffer::Snapshot TextBuffer::snapshot() {
+    flush_active_line();
+
+    // Everything appended so far may now be referenced by the snapshot
+    sealed_spans_ = add_lines_.size();
+    return Snapshot{root_, total_lines_};
+}
+
+void TextBuffer::restore(const Snapshot& snapshot) {
+    edit_count_++;
+    note_change(0, total_lines_, snapshot.line_count);
+    // The active line is part of the document being replaced
+    active_line_ = NO_ACTIVE_LINE;
+    active_.clear();
+    // Shared with the snapshot, the first edit copies what it touches
+    root_ = std::const_pointer_cast<Node>(snapshot.root);
+    total_lines_ = snapshot.line_count;
+}
+
+size_t TextBuffer::snapshot_bytes(const std::vector<const Snapshot*>& snapshots) const {
+    std::unordered_set<const Node*> seen;
+    auto walk = [&](auto& self, const Node* node, bool count) -> size_t {
+        if (!seen.insert(node).second) return 0;
+        size_t bytes = 0;
+        if (count) {
+            bytes += sizeof(Node) + node->pieces.capacity() * sizeof(Piece) +
+                     node->children.capacity() * sizeof(NodePtr);
+            for (const Piece& piece : node->pieces) {
+                if (piece.source == Source::ADD) bytes += piece_bytes(piece);
+            }
+        }
+        for (const NodePtr& child : node->children) bytes += self(self, child.get(), count);
+        return bytes;
+    };
+
+    // The document's nodes first, they are in use anyway
+    walk(walk, root_.get(), false);
+    size_t bytes = 0;
+    for (const Snapshot* snapshot : snapshots) {
+        if (snapshot->root) bytes += walk(walk, snapshot->root.get(), true);
+    }
+    return bytes;
+}
+
+// ===== Line handles =====
+
+std::vector<TextBuffer::LineRef> TextBuffer::line_refs(size_t first, size_t count) {
+    flush_active_line();
+    sealed_spans_ = add_lines_.size();
+
+    std::vector<LineRef> refs;
+    refs.reserve(count);
+    auto it = iterator_at(first);
+    for (size_t i = 0; i < count; i++, ++it) {
+        refs.push_back(it.ref());
+    }
+    return refs;
+}
+
+std::vector<TextBuffer::LineRef> TextBuffer::line_refs(const Snapshot& snapshot, size_t first, size_t count) const {
+    // Snapshot lines were sealed when the snapshot was taken
+    std::vector<LineRef> refs;
+    refs.reserve(count);
+    auto it = iterator_at(snapshot, first);
+    for (size_t i = 0; i < count; i++, ++it) {
+        refs.push_back(it.ref());
+    }
+    return refs;
+}
+
+size_t TextBuffer::store_lines(std::string_view text) {
+    return *store_lines(text.size(), [text](char* data) {
+        std::memcpy(data, text.data(), text.size());
+        return true;
+    });
+}
+
+std::optional<size_t> TextBuffer::store_lines(size_t size, const std::function<bool(char* data)>& fill) {
+    return store_block(size, nullptr, fill);
+}
+
+std::optional<size_t> TextBuffer::store_lines(size_t size, const std::vector<LineScan>& scans,
+                                              const std::function<bool(char* data)>& fill) {
+    return store_block(size, &scans, fill);
+}
+
+std::optional<size_t> TextBuffer::store_block(size_t size, const std::vector<LineScan>* scans,
+                                              const std::function<bool(char* data)>& fill) {
+    const size_t first_span = add_lines_.size();
+    if (size == 0) return first_span;
+    char* data = add_.store_uninitialized(size);
+    if (!fill(data)) return std::nullopt;
+    if (scans) {
+        add_lines_.push_scanned(std::string_view(data, size), *scans);
+    } else {
+        add_lines_.push_lines(std::string_view(data, size), std::numeric_limits<size_t>::max());
+    }
+    // The block is one store() - store_line() must not rewrite it in place as
+    // if it were the newest line alone
+    sealed_spans_ = add_lines_.size();
+    return first_span;
+}
+
+void TextBuffer::replace_lines(size_t first, size_t count, const std::vector<LineRef>& lines) {
+    edit_count_++;
+    note_change(first, count, lines.size());
+    // Consecutive handles into the same buffer collapse into one piece
+    std::vector<Piece> pieces;
+    for (const LineRef& ref : lines) {
+        if (!pieces.empty() && pieces.back().source == ref.source &&
+            pieces.back().first + pieces.back().count == ref.index) {
+            pieces.back().count++;
+        } else {
+            pieces.push_back(Piece{ref.source, ref.index, 1});
+        }
+    }
+    splice(first, count, pieces);
+}
+
+void TextBuffer::replace_lines(size_t first, size_t count, const std::vector<Piece>& pieces) {
+    edit_count_++;
+    size_t lines = 0;
+    for (const Piece& piece : pieces) lines += piece.count;
+    note_change(first, count, lines);
+    splice(first, count, pieces);
+}
@@ -0,0 +1,386 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <gap_buffer.hpp>
+#include <line_diff.hpp>
+#include <line_table.hpp>
+#include <mapped_file.hpp>
+#include <paged_line_index.hpp>
+#include <text_arena.hpp>
+
+class LineIndexer;
+
+/// @brief Piece-table text buffer - the document model shared by all managers
+///
+/// The loaded file is kept read-only in the original buffer, every line that is
+/// typed or edited is appended to an append-only add buffer. The document itself
+/// is an ordered sequence of pieces, each one describing a run of consecutive
+/// lines stored in one of those two buffers.
+///
+/// The pieces live in the leaves of a balanced B-tree, every node caches the
+/// number of lines and bytes below it. Line lookup, insert, erase, split and
+/// join are O(log n) in the number of pieces. Nodes are shared copy-on-write,
+/// so a snapshot is just a reference to the current root.
+///
+/// The line being typed on is held in a GapBuffer ("active line") instead, so
+/// single-character edits don't rewrite the line. It is written back into the
+/// tree when another line is edited, the line structure changes or a snapshot
+/// is taken.
+///
+/// Each backing buffer has a LineTable with per-line metadata (hash, ASCII
+/// flag) computed when the line is stored.
+///
+/// A memory-mapped file is indexed lazily: load() splits only the first lines
+/// and a LineIndexer splits the rest in the background. The document grows at
+/// the end whenever poll_index() picks up indexed lines, until then it holds
+/// a prefix of the file.
+///
+/// A file larger than memory is loaded paged: the original buffer gets a
+/// sparse PagedLineIndex instead of a LineTable, so besides the mapping (which
+/// the kernel pages in and out on demand) only edited lines take up memory.
+///
+/// Line access hands out std::string_view's, they stay valid until the next
+/// modification of the buffer.
+class TextBuffer {
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<Node>;
+
+public:
+    /// @brief Which backing buffer a piece refers to
+    enum class Source : unsigned char {
+        ORIGINAL,
+        ADD
+    };
+
+    /// @brief A run of `count` consecutive lines, starting at span `first` of `source`
+    struct Piece {
+        Source source;
+        size_t first;
+        size_t count;
+    };
+
+    /// @brief Handle to one stored line, valid until the next load()/clear()
+    ///
+    /// Stored lines never change, so holding a handle is as good as holding the
+    /// text - copying it never copies the line.
+    struct LineRef {
+        Source source;
+        size_t index;
+    };
+
+    /// @brief Lines touched by edits: `old_count` lines at `first` became `new_count` lines
+    struct ChangedRange {
+        size_t first = 0;
+        size_t old_count = 0;
+        size_t new_count = 0;
+    };
+
+    /// @brief Frozen version of the document, shares all nodes and text with the buffer
+    struct Snapshot {
+        std::shared_ptr<const Node> root;
+        size_t line_count = 0;
+    };
+
+    /// @brief Bidirectional iterator over the lines of the document or of a snapshot
+    class LineIterator {
+    public:
+        std::string_view operator*() const;
+        LineIterator& operator++();
+        LineIterator& operator--();
+        bool operator==(const LineIterator& other) const { return line_ == other.line_; }
+
+        LineInfo info() const;
+        /// @brief Compare the text of two lines of the same buffer
+        /// Lines stored in the same place match without looking at the bytes,
+        /// lines with different hashes differ without looking at the bytes.
+        bool same_text_as(const LineIterator& other) const;
+
+    private:
+        friend class TextBuffer;
+        LineIterator(const TextBuffer* buffer, const Node* root, bool live, size_t y);
+
+        /// @brief Position the iterator on line y by descending from the root
+        void seek(size_t y);
+        /// @brief Handle of the current line (not valid on the active line)
+        LineRef ref() const;
+        bool on_active_line() const { return live_ && line_ == buffer_->active_line_; }
+
+        const TextBuffer* buffer_;
+        const Node* root_;
+        bool live_;                   // Iterating the document (not a snapshot)
+        const Node* leaf_ = nullptr;  // Leaf holding the current line, null at end
+        size_t line_ = 0;             // Document line number
+        size_t piece_ = 0;            // Piece index inside the leaf
+        size_t offset_ = 0;           // Line offset inside the piece
+    };
+
+    TextBuffer();
+    ~TextBuffer();
+
+    /// @brief Replace the document with the given file contents (split on '\n')
+    /// @param contents Raw file bytes, becomes the read-only original buffer
+    void load(std::string contents);
+
+    /// @brief Replace the document with a mapped file, indexing it lazily
+    /// @param file Mapping that becomes the read-only original buffer
+    /// @param first_lines Lines indexed before returning, the rest of a large
+    ///                    file is indexed in the background (0: index nothing
+    ///                    up front - a file past SYNC_INDEX_BYTES is all indexed there)
+    /// @param paged Index the file sparsely, for files too large for a full line table
+    void load(MappedFile file, size_t first_lines, bool paged = false);
+
+    /// @brief Was the file loaded paged?
+    bool is_paged() const { return paged_; }
+
+    /// @brief Reset the document to a single empty line
+    void clear();
+
+    size_t line_count() const { return total_lines_; }
+    bool empty() const { return total_lines_ == 0; }
+
+    /// @brief Size of the document in bytes, counting a '\n' between lines
+    size_t byte_count() const;
+
+    /// @brief Get the text of line y (valid until the next modification)
+    std::string_view line(size_t y) const;
+    size_t line_length(size_t y) const;
+    /// @brief Byte x of line y, cheaper than line(y)[x] on the active line
+    char byte_at(size_t y, size_t x) const;
+    /// @brief Hash and ASCII flag of line y
+    LineInfo line_info(size_t y) const;
+    /// @brief Hash of the whole document, folded from the line hashes
+    /// O(lines) without reading the text, except for a paged file (it reads every line).
+    uint64_t content_hash() const;
+
+    /// @brief Pass the document to `sink` in order, as '\n'-terminated text
+    /// Runs of unedited file lines come as one block straight from the
+    /// original buffer, other lines one by one.
+    /// @return False as soon as `sink` returns false
+    bool write_to(const std::function<bool(std::string_view)>& sink) const;
+
+    /// @brief The document as '\n'-terminated blocks of text, in order (see write_to())
+    /// The active line is flushed and the add buffer sealed, so the blocks stay
+    /// valid and unchanged through later edits - they can be written out on
+    /// another thread meanwhile. Only load(), clear() and detach_original()
+    /// invalidate them.
+    std::vector<std::string_view> text_blocks();
+
+    /// @brief Number of edits so far, changes with every modification of the document
+    uint64_t edit_count() const { return edit_count_; }
+
+    /// @brief Lines touched by the edits since the last call, nullopt if there were none
+    /// Every edit widens the range by the lines it touched, in O(1). Lines
+    /// between two edits are part of the range but unchanged, and an edit may
+    /// have put back the text that was there. Loading resets it.
+    std::optional<ChangedRange> take_changed_range();
+
+    /// @brief Start paging in the file text of lines [first, first + count), a hint
+    void prefetch_lines(size_t first, size_t count) const;
+
+    // ===== Iteration =====
+    LineIterator begin() const { return iterator_at(0); }
+    LineIterator end() const { return iterator_at(total_lines_); }
+    LineIterator iterator_at(size_t y) const;
+
+    // ===== Line content edits =====
+    void set_line(size_t y, std::string_view text);
+    void insert_text(size_t y, size_t x, std::string_view text);
+    void erase_text(size_t y, size_t x, size_t length);
+
+    // ===== Line structure edits =====
+    /// @brief Split line y at byte x, the tail becomes line y + 1
+    void split_line(size_t y, size_t x);
+    /// @brief Append line y + 1 to line y and remove it
+    void join_lines(size_t y);
+    void insert_line(size_t y, std::string_view text);
+    void insert_lines(size_t y, const std::vector<std::string>& lines);
+    void erase_lines(size_t first, size_t count);
+    /// @brief Replace `count` lines starting at `first` with `lines`
+    void replace_lines(size_t first, size_t count, const std::vector<std::string>& lines);
+    /// @brief Append '\n'-terminated lines at the end, copied into the add buffer in one block
+    void append_lines(std::string_view text);
+
+    /// @brief Store the document anew, releasing the text of lines no longer in it
+    /// Costs a copy of the document, must not be called while indexing().
+    void compact();
+
+    // ===== Background indexing =====
+    /// @brief Is the end of the file still being indexed? The document is a prefix of the file until then
+    bool indexing() const { return indexer_ != nullptr; }
+    /// @brief Share of the file indexed so far, 0.0 to 1.0
+    float index_progress() const;
+    /// @brief Append the lines indexed since the last call to the document
+    /// @return True if the document grew
+    bool poll_index();
+    /// @brief Callback run on the indexer thread when poll_index() has new lines
+    /// Kept across loads. Once this returns, the previous callback is not called anymore.
+    void set_index_listener(std::function<void()> listener);
+
+    /// @brief Copy a mapped original buffer into memory and drop the mapping
+    /// Needed before the mapped file is overwritten in place. No-op if nothing
+    /// is mapped, must not be called while indexing() - nor for a paged file,
+    /// unless it fits in memory after all.
+    void detach_original();
+
+    /// @brief Is the original buffer a mapping of the file now at `filename`?
+    bool maps_file(const std::string& filename) const { return mapped_.maps(filename); }
+
+    // ===== Patching =====
+    /// @brief Line ranges where the document differs from `lines` (see LineDiff::diff)
+    std::vector<LineDiff::Change> diff(const LineTable& lines) const;
+    /// @brief Make the document equal to `lines`, given their diff()
+    /// Only the changed ranges are replaced, everything else stays where it is stored.
+    void patch(const std::vector<LineDiff::Change>& changes, const LineTable& lines);
+
+    // ===== Snapshots =====
+    /// @brief Freeze the current document, O(1) - the tree is shared until edited
+    Snapshot snapshot();
+    LineIterator iterator_at(const Snapshot& snapshot, size_t y) const;
+    LineIterator end(const Snapshot& snapshot) const { return iterator_at(snapshot, snapshot.line_count); }
+    /// @brief Make a snapshot of this buffer the document again, O(1) - one edit of every line
+    void restore(const Snapshot& snapshot);
+    /// @brief Memory the snapshots keep in use beyond the document: their tree
+    /// nodes not shared with it, and the text of edited lines in those nodes
+    /// (an upper bound - the lines may be held by other handles too). O(tree nodes).
+    size_t snapshot_bytes(const std::vector<const Snapshot*>& snapshots) const;
+
+    // ===== Line handles =====
+    /// @brief Handles of `count` lines starting at `first`
+    /// The active line is flushed and the lines are sealed, so they can't be
+    /// rewritten in place while a handle refers to them.
+    std::vector<LineRef> line_refs(size_t first, size_t count);
+    std::vector<LineRef> line_refs(const Snapshot& snapshot, size_t first, size_t count) const;
+    std::string_view text(LineRef ref) const { return span_text(ref.source, ref.index); }
+    /// @brief Replace `count` lines starting at `first` with previously stored lines
+    void replace_lines(size_t first, size_t count, const std::vector<LineRef>& lines);
+    /// @brief Store '\n'-terminated lines in the add buffer, in one block, without putting them in the document
+    /// @return Index of the first one's handle, the others follow: {Source::ADD, first + i}
+    size_t store_lines(std::string_view text);
+    /// @brief Like store_lines(text), for `size` bytes of text `fill` writes in place (e.g. decompressing)
+    /// @return Nothing, and nothing is stored, if `fill` returned false
+    std::optional<size_t> store_lines(size_t size, const std::function<bool(char* data)>& fill);
+    /// @brief Like store_lines(size, fill), for a `fill` that also splits the text into `scans`
+    /// (e.g. on the threads decompressing it), the lines are taken from there
+    std::optional<size_t> store_lines(size_t size, const std::vector<LineScan>& scans,
+                                      const std::function<bool(char* data)>& fill);
+    /// @brief Replace `count` lines starting at `first` with runs of previously stored lines
+    void replace_lines(size_t first, size_t count, const std::vector<Piece>& pieces);
+
+    /// @brief Copy the add-buffer lines still in use to fresh storage and free the rest
+    /// The add buffer only ever grows, lines edited away or dropped from the
+    /// history keep their text until this runs. In use are the lines of the
+    /// document, `refs` (handles held elsewhere) and `snapshots` - those are
+    /// updated in place, snapshots keep sharing their nodes with each other and
+    /// the document. Costs O(text kept). Invalidates every other handle,
+    /// snapshot, line view and text_blocks() - none may be in use.
+    /// @param released Runs of lines their holders let go of, to learn what that freed
+    /// @return For each run in `released`, the bytes freed of its lines (text
+    ///         and table row) - a line in several runs counts for the first
+    std::vector<size_t> compact_add_buffer(const std::vector<LineRef*>& refs,
+                                           const std::vector<Snapshot*>& snapshots = {},
+                                           const std::vector<Piece>& released = {});
+
+private:
+    // Maximum pieces per leaf / children per internal node, nodes below a
+    // quarter of that are merged with a neighbour
+    static constexpr size_t MAX_NODE_ITEMS = 32;
+    static constexpr size_t MIN_NODE_ITEMS = MAX_NODE_ITEMS / 4;
+
+    const LineTable& table(Source source) const {
+        return source == Source::ORIGINAL ? original_lines_ : add_lines_;
+    }
+    std::string_view span_text(Source source, size_t index) const;
+    LineInfo span_info(Source source, size_t index) const;
+    size_t original_size() const { return paged_ ? original_pages_.size() : original_lines_.size(); }
+
+    /// @brief Total bytes (newlines excluded) of the first `count` lines of a piece
+    size_t piece_bytes(const Piece& piece, size_t count) const;
+    size_t piece_bytes(const Piece& piece) const { return piece_bytes(piece, piece.count); }
+
+    /// @brief store_lines() of both kinds, the lines split here unless `scans` is given
+    std::optional<size_t> store_block(size_t size, const std::vector<LineScan>* scans,
+                                      const std::function<bool(char* data)>& fill);
+
+    /// @brief Find the leaf holding line y, plus piece index and line offset in it
+    static const Node* locate(const Node* root, size_t y, size_t& piece, size_t& offset);
+
+    // ===== Tree maintenance =====
+    /// @brief Get a node for writing, copying it first if a snapshot shares it
+    static Node& mutable_node(NodePtr& node);
+    /// @brief Recompute the cached line/byte counts of a node from its items
+    void refresh(Node& node) const;
+    /// @brief Drop empty children, merge underfull ones and split overfull ones
+    void rebalance(Node& node) const;
+    /// @brief Grow or shrink the tree height after the root changed size
+    void fix_root();
+
+    void erase_range(NodePtr& node, size_t first, size_t count);
+    void insert_pieces(NodePtr& node, size_t y, const std::vector<Piece>& pieces);
+
+    // ===== Active line =====
+    /// @brief Move line y into the gap buffer (flushing the previous active line)
+    void activate_line(size_t y);
+    /// @brief Write the active line back into the tree
+    void flush_active_line();
+    /// @brief Store new text for line y in the add buffer and tree
+    void store_line(size_t y, std::string_view text);
+
+    /// @brief Replace `count` lines at `first` with the given pieces
+    void splice(size_t first, size_t count, const std::vector<Piece>& replacement);
+
+    /// @brief Copy the text of the ADD pieces below `node` to `lines`, in document order
+    /// `moved` maps old span indices to the new ones, `copied` old nodes to
+    /// their updated copies - a node shared by several trees is copied once.
+    void copy_add_pieces(NodePtr& node, TextArena& arena, LineTable& lines, std::vector<size_t>& moved,
+                         std::unordered_map<const Node*, NodePtr>& copied);
+
+    /// @brief Widen changed_ by an edit that replaced `old_count` lines at `first` with `new_count`
+    void note_change(size_t first, size_t old_count, size_t new_count);
+
+    /// @brief Append a line to the add buffer, returns the new span index
+    size_t append_line(std::string_view text);
+
+    /// @brief Pass the lines of one node to write_to()'s sink, `y` is the line number of its first line
+    bool write_node(const Node& node, size_t& y, const std::function<bool(std::string_view)>& sink) const;
+
+    /// @brief Drop the document, its storage and any indexing in progress
+    void release();
+    /// @brief Make the document the lines of the original buffer indexed so far
+    void reset_document();
+
+    // Below this many unindexed bytes a mapped file is indexed right away,
+    // starting a thread would take longer than the work
+    static constexpr size_t SYNC_INDEX_BYTES = 1024 * 1024;
+
+    std::string original_;               // File contents, never modified after load
+    MappedFile mapped_;                  // ... or the mapped file, whichever is in use
+    TextArena add_;                      // Append-only storage for new and edited lines
+    LineTable original_lines_;           // Line table of the original buffer
+    PagedLineIndex original_pages_;      // ... or its sparse index when paged_
+    bool paged_ = false;
+    LineTable add_lines_;                // Line table of the add buffer
+    NodePtr root_;                       // The document
+    size_t total_lines_ = 0;
+    uint64_t edit_count_ = 0;
+    std::optional<ChangedRange> changed_; // In current line numbers, see take_changed_range()
+
+    static constexpr size_t NO_ACTIVE_LINE = static_cast<size_t>(-1);
+    mutable GapBuffer active_;           // Text of the active line
+    size_t active_line_ = NO_ACTIVE_LINE;
+    size_t active_base_length_ = 0;      // Length of the active line in the tree
+
+    // Add-buffer lines a snapshot may reference; lines past this mark belong to
+    // the live document only and can be rewritten in place.
+    mutable size_t sealed_spans_ = 0;
+
+    std::unique_ptr<LineIndexer> indexer_;  // Splits the rest of mapped_, null when done
+    std::function<void()> index_listener_;
+};
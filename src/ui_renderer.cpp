@@ -1,6 +1,7 @@
 #include "ui_renderer.hpp"
 #include "utf8_utils.hpp"
 #include "ftxui/screen/terminal.hpp"
+#include <algorithm>
 //#include <shared_types.hpp>
 
 using namespace ftxui;
@@ -94,155 +95,70 @@ bool UIRenderer::supports_emojis() const {
     return emoji_capable;
 }
 
-UIRenderer::ParseResult UIRenderer::parse_markdown_segment(const std::string& line_text, size_t start_pos, bool is_selected, int cursor_x_in_line) {
-    ParseResult result;
-    result.bytes_consumed = 0;
-
-    if (start_pos >= line_text.length()) {
-        return result;
-    }
-
-    // Check for markdown markers
-    std::string remaining = line_text.substr(start_pos);
-
-    // Check for bold **
-    if (remaining.length() >= 2 && remaining.substr(0, 2) == "**") {
-        size_t end_pos = remaining.find("**", 2);
-        if (end_pos != std::string::npos) {
-            std::string content = remaining.substr(2, end_pos - 2);
-            result.bytes_consumed = end_pos + 2;
-
-            // Recursively parse content for nested formatting
-            size_t content_pos = 0;
-            while (content_pos < content.length()) {
-                auto nested = parse_markdown_segment(content, content_pos, is_selected,
-                    cursor_x_in_line >= 0 ? cursor_x_in_line - (int)(start_pos + 2) : -1);
-
-                // Apply bold to all nested elements
-                for (auto& elem : nested.elements) {
-                    elem = elem | bold;
-                }
-                result.elements.insert(result.elements.end(), nested.elements.begin(), nested.elements.end());
-                content_pos += nested.bytes_consumed;
-            }
-            return result;
-        }
-    }
-
-    // Check for strikethrough ~~
-    if (remaining.length() >= 2 && remaining.substr(0, 2) == "~~") {
-        size_t end_pos = remaining.find("~~", 2);
-        if (end_pos != std::string::npos) {
-            std::string content = remaining.substr(2, end_pos - 2);
-            result.bytes_consumed = end_pos + 2;
-
-            // Recursively parse content for nested formatting
-            size_t content_pos = 0;
-            while (content_pos < content.length()) {
-                auto nested = parse_markdown_segment(content, content_pos, is_selected,
-                    cursor_x_in_line >= 0 ? cursor_x_in_line - (int)(start_pos + 2) : -1);
-
-                // Apply strikethrough to all nested elements
-                for (auto& elem : nested.elements) {
-                    elem = elem | strikethrough;
-                }
-                result.elements.insert(result.elements.end(), nested.elements.begin(), nested.elements.end());
-                content_pos += nested.bytes_consumed;
-            }
-            return result;
-        }
-    }
-
-    // Check for underline <u>
-    if (remaining.length() >= 3 && remaining.substr(0, 3) == "<u>") {
-        size_t end_pos = remaining.find("</u>");
-        if (end_pos != std::string::npos) {
-            std::string content = remaining.substr(3, end_pos - 3);
-            result.bytes_consumed = end_pos + 4;
-
-            // Recursively parse content for nested formatting
-            size_t content_pos = 0;
-            while (content_pos < content.length()) {
-                auto nested = parse_markdown_segment(content, content_pos, is_selected,
-                    cursor_x_in_line >= 0 ? cursor_x_in_line - (int)(start_pos + 3) : -1);
-
-                // Apply underline to all nested elements
-                for (auto& elem : nested.elements) {
-                    elem = elem | underlined;
-                }
-                result.elements.insert(result.elements.end(), nested.elements.begin(), nested.elements.end());
-                content_pos += nested.bytes_consumed;
-            }
-            return result;
-        }
-    }
-
-    // Check for italic *
-    if (remaining.length() >= 1 && remaining[0] == '*') {
-        size_t end_pos = remaining.find("*", 1);
-        if (end_pos != std::string::npos) {
-            std::string content = remaining.substr(1, end_pos - 1);
-            result.bytes_consumed = end_pos + 2;
-
-            // Recursively parse content for nested formatting
-            size_t content_pos = 0;
-            while (content_pos < content.length()) {
-                auto nested = parse_markdown_segment(content, content_pos, is_selected,
-                    cursor_x_in_line >= 0 ? cursor_x_in_line - (int)(start_pos + 1) : -1);
-
-                // Apply italic to all nested elements
-                for (auto& elem : nested.elements) {
-                    elem = elem | italic;
-                }
-                result.elements.insert(result.elements.end(), nested.elements.begin(), nested.elements.end());
-                content_pos += nested.bytes_consumed;
-            }
-            return result;
-        }
+void UIRenderer::append_run(std::vector<StyledRun>& runs, std::string_view text, uint8_t style) {
+    if (runs.empty() || runs.back().style != style) {
+        runs.push_back(StyledRun{std::string(text), style});
+    } else {
+        runs.back().text.append(text);
     }
+}
 
-    // No formatting found - return single character
-    int char_len = UTF8Utils::get_char_length(line_text, start_pos);
-    std::string ch_str = line_text.substr(start_pos, char_len);
-    result.bytes_consumed = char_len;
-
-    bool is_cursor_here = (cursor_x_in_line >= 0 && (int)start_pos == cursor_x_in_line);
-    auto elem = text(ch_str);
-    if (is_cursor_here) elem = elem | inverted | bold;
-    if (is_selected) elem = elem | bgcolor(Color::Blue) | color(Color::Black);
-    result.elements.push_back(elem);
-
-    return result;
+Element UIRenderer::render_run(const StyledRun& run) {
+    auto elem = text(run.text);
+    if (run.style & StyledRun::CURSOR) elem = elem | inverted | bold;
+    else if (run.style & StyledRun::SELECTED) elem = elem | bgcolor(Color::Blue) | color(Color::Black);
+    if (run.style & StyledRun::BOLD) elem = elem | bold;
+    if (run.style & StyledRun::ITALIC) elem = elem | italic;
+    if (run.style & StyledRun::UNDERLINE) elem = elem | underlined;
+    if (run.style & StyledRun::STRIKETHROUGH) elem = elem | strikethrough;
+    return elem;
 }
 
 Element UIRenderer::render(const RenderParams& params) {
     int screen_height = Terminal::Size().dimy;
     int visible_lines = screen_height - 3;
 
-    auto lines = render_lines(params.buffer, params.cursor_x, params.cursor_y, params.scroll_y, visible_lines, params.is_char_selected_fn, params.editor_mode);
+    auto lines = render_lines(params.buffer, params.cursor_x, params.cursor_y, params.scroll_y, visible_lines, params.selection, params.format_spans, params.editor_mode);
+
+    std::string debug_info;
+    if (params.debug_mode) {
+        debug_info = "Line cache: " + std::to_string(line_cache_stats_.frame_hits) + " hit, " +
+                     std::to_string(line_cache_stats_.frame_misses) + " missed (" +
+                     std::to_string(line_cache_stats_.hits) + "/" + std::to_string(line_cache_stats_.misses) +
+                     " in all) ";
+    }
 
     return vbox({
         render_header(params.filename, params.modified, params.can_undo, params.can_redo, params.bold_active, params.italic_active, params.underline_active, params.strikethrough_active, params.editor_mode),
         separator() | bgcolor(seperator_color_bg) | color(seperator_color_fg),
         vbox(std::move(lines)) | flex | (cached_color_mode_dark ? bgcolor(COLOR_MODE_DARK_BG) | color(COLOR_MODE_DARK_FG) : bgcolor(COLOR_MODE_LIGHT_BG) | color(COLOR_MODE_LIGHT_FG)),
         separator() | bgcolor(seperator_color_bg) | color(seperator_color_fg),
-        render_status_bar(params.cursor_x, params.cursor_y, params.status_message, params.status_shown, params.status_type),
+        render_status_bar(params.cursor_x, params.cursor_y, params.status_message, params.status_shown, params.status_type, params.progress_label, params.progress_percent, debug_info),
         render_shortcuts()
     });
 }
 
 Elements UIRenderer::render_lines(
-    const std::vector<std::string>& buffer,
+    const TextBuffer& buffer,
     int cursor_x, int cursor_y,
     int scroll_y,
     int visible_lines,
-    std::function<bool(int, int)> is_char_selected_fn,
+    const SelectionRange& selection,
+    FormatSpanIndex& format_spans,
     EditorMode editor_mode
 ) {
     Elements lines_display;
-    int max_line_num_width = std::to_string(buffer.size()).length();
+    int max_line_num_width = std::to_string(buffer.line_count()).length();
+    const bool markdown = editor_mode == EditorMode::FANCY || editor_mode == EditorMode::DOCUMENT;
+
+    frame_++;
+    line_cache_stats_.frame_hits = 0;
+    line_cache_stats_.frame_misses = 0;
+    std::vector<StyledRun> runs;
 
-    for (int i = 0; i < visible_lines && (scroll_y + i) < (int)buffer.size(); i++) {
+    // Visible lines are consecutive, walk them with one iterator instead of a lookup per line
+    auto line_it = buffer.iterator_at(scroll_y);
+    for (int i = 0; i < visible_lines && (scroll_y + i) < (int)buffer.line_count(); i++, ++line_it) {
         int line_idx = scroll_y + i;
         std::string line_num = std::to_string(line_idx + 1);
 
@@ -251,77 +167,109 @@ Elements UIRenderer::render_lines(
             line_num = " " + line_num;
         }
 
-        std::string line_content = buffer[line_idx];
-
-        // Build line with selection highlighting and markdown parsing
-        Elements line_elements;
-        size_t byte_pos = 0;
-
-        while (byte_pos <= line_content.length()) {
-            if (byte_pos == line_content.length() && line_idx != cursor_y) break;
-
-            bool is_selected = is_char_selected_fn(byte_pos, line_idx);
-
-            if (byte_pos < line_content.length()) {
-                // Handle tabs specially
-                if (line_content[byte_pos] == '\t') {
-                    bool is_cursor = (line_idx == cursor_y && (int)byte_pos == cursor_x);
-                    auto elem = text(tab_symbol);  // 4 spaces to represent a tab
-                    if (is_cursor) elem = elem | inverted | bold;
-                    else if (is_selected) elem = elem | bgcolor(Color::Blue) | color(Color::Black);
-                    line_elements.push_back(elem);
-                    byte_pos++;
-                } else {
-                    // Only parse markdown in FANCY and DOCUMENT modes
-                    if (editor_mode == EditorMode::FANCY || editor_mode == EditorMode::DOCUMENT) {
-                        // Parse markdown and apply formatting
-                        // Pass cursor_x if this is the cursor line, -1 otherwise
-                        int cursor_x_for_parse = (line_idx == cursor_y) ? cursor_x : -1;
-                        auto parse_result = parse_markdown_segment(line_content, byte_pos, is_selected, cursor_x_for_parse);
-
-                        for (auto& elem : parse_result.elements) {
-                            line_elements.push_back(elem);
-                        }
-                        byte_pos += parse_result.bytes_consumed;
-                        if (parse_result.bytes_consumed == 0) {
-                            // Fallback - advance by one character to avoid infinite loop
-                            byte_pos++;
-                        }
-                    } else {
-                        // BASIC or CODE mode - render plain text without markdown parsing
-                        int char_len = UTF8Utils::get_char_length(line_content, byte_pos);
-                        std::string ch_str = line_content.substr(byte_pos, char_len);
-                        bool is_cursor = (line_idx == cursor_y && (int)byte_pos == cursor_x);
-                        auto elem = text(ch_str);
-                        if (is_cursor) elem = elem | inverted | bold;
-                        else if (is_selected) elem = elem | bgcolor(Color::Blue) | color(Color::Black);
-                        line_elements.push_back(elem);
-                        byte_pos += char_len;
-                    }
-                }
-            } else {
-                bool is_cursor = (line_idx == cursor_y && (int)byte_pos == cursor_x);
-                auto elem = text(" ");
-                if (is_cursor) elem = elem | inverted | bold;
-                line_elements.push_back(elem);
-                byte_pos++;
+        const std::string_view line_content = *line_it;
+        const LineInfo line_info = line_it.info();
+        const int cursor_in_line = line_idx == cursor_y ? cursor_x : -1;
+        int selection_begin, selection_end;
+        selection.in_line(line_idx, line_content.length(), selection_begin, selection_end);
+        selection_end = std::min<int>(selection_end, line_content.length());
+        if (selection_begin >= selection_end) {
+            selection_begin = selection_end = 0;
+        }
+
+        // Typing or moving the cursor changes one or two lines, the others are
+        // taken from the last frame as they are
+        const LineCacheKey key{line_info.hash, editor_mode, color_mode_dark, selection_begin, selection_end, cursor_in_line};
+        LineCacheEntry& entry = line_cache_[key];
+        Element content;
+        // An element can be in the tree once only - a second line with the same text is built again
+        if (entry.content && entry.frame != frame_ && entry.text == line_content) {
+            content = entry.content;
+            entry.frame = frame_;
+            line_cache_stats_.hits++;
+            line_cache_stats_.frame_hits++;
+        } else {
+            const FormatSpans* spans = markdown ? &format_spans.line(line_content, line_info.hash) : nullptr;
+            content = render_line_content(runs, line_content, line_info.ascii, spans, cursor_in_line,
+                                          selection_begin, selection_end);
+            if (entry.frame != frame_) {
+                entry.text.assign(line_content);
+                entry.content = content;
+                entry.frame = frame_;
             }
+            line_cache_stats_.misses++;
+            line_cache_stats_.frame_misses++;
         }
 
         // line number + separator + content
-        auto line_elem = hbox(std::move(line_elements));
-        auto full_line = hbox({
+        lines_display.push_back(hbox({
             text(line_num) | color(Color::GrayDark),
             text(" │ ") | color(Color::GrayDark),
-            line_elem
-        });
-
-        lines_display.push_back(full_line);
+            std::move(content)
+        }));
     }
 
+    if (line_cache_.size() > LINE_CACHE_SCREENS * std::max(visible_lines, 1)) {
+        std::erase_if(line_cache_, [this](const auto& item) { return item.second.frame != frame_; });
+    }
     return lines_display;
 }
 
+Element UIRenderer::render_line_content(std::vector<StyledRun>& runs, std::string_view line_content, bool ascii,
+                                        const FormatSpans* spans, int cursor, int selection_begin, int selection_end) {
+    static_assert(StyledRun::BOLD == FormatSpans::bit(Formatter::Type::BOLD) &&
+                  StyledRun::ITALIC == FormatSpans::bit(Formatter::Type::ITALIC) &&
+                  StyledRun::UNDERLINE == FormatSpans::bit(Formatter::Type::UNDERLINE) &&
+                  StyledRun::STRIKETHROUGH == FormatSpans::bit(Formatter::Type::STRIKETHROUGH),
+                  "span formats are used as run styles");
+    static const std::vector<FormatSpans::Step> plain{FormatSpans::Step{}};
+    const std::vector<FormatSpans::Step>& steps = spans != nullptr ? spans->steps() : plain;
+
+    // The cursor hides the selection under it
+    auto style_at = [&](size_t byte_pos) -> uint8_t {
+        if ((int)byte_pos == cursor) return StyledRun::CURSOR;
+        return (int)byte_pos >= selection_begin && (int)byte_pos < selection_end ? StyledRun::SELECTED : 0;
+    };
+
+    // A line is cut into runs of characters with the same style, one element
+    // per run instead of one per character - a plain line is one element
+    runs.clear();
+    size_t step = 0;
+    size_t byte_pos = 0;
+    while (byte_pos < line_content.length()) {
+        while (step + 1 < steps.size() && steps[step + 1].begin <= (int)byte_pos) step++;
+        // ASCII lines (the common case) need no UTF-8 decoding
+        const size_t char_len = ascii ? 1 : UTF8Utils::get_char_length(line_content, byte_pos);
+        if (!steps[step].marker) {
+            append_run(runs,
+                       line_content[byte_pos] == '\t' ? std::string_view(tab_symbol) : line_content.substr(byte_pos, char_len),
+                       steps[step].formats | style_at(byte_pos));
+        }
+        byte_pos += char_len;
+    }
+    // Room for the cursor past the end of its line
+    if (cursor >= 0) {
+        append_run(runs, " ", cursor == (int)line_content.length() ? StyledRun::CURSOR : 0);
+    }
+
+    Elements elements;
+    elements.reserve(runs.size());
+    for (const StyledRun& run : runs) {
+        elements.push_back(render_run(run));
+    }
+    return hbox(std::move(elements));
+}
+
+size_t UIRenderer::LineCacheKeyHash::operator()(const LineCacheKey& key) const {
+    // The text hash is well mixed already, the rest is folded into it
+    uint64_t hash = key.hash;
+    hash ^= (static_cast<uint64_t>(key.mode) << 1 | key.dark) * 0x9E3779B97F4A7C15ull;
+    hash ^= (static_cast<uint64_t>(static_cast<uint32_t>(key.selection_begin)) << 32 |
+             static_cast<uint32_t>(key.selection_end)) * 0xC2B2AE3D27D4EB4Full;
+    hash ^= static_cast<uint64_t>(static_cast<uint32_t>(key.cursor)) * 0x165667B19E3779F9ull;
+    return static_cast<size_t>(hash);
+}
+
 Element UIRenderer::render_header(const std::string& filename, bool modified, bool can_undo, bool can_redo,
                                   bool bold_active, bool italic_active, bool underline_active, bool strikethrough_active,
                                   EditorMode editor_mode) {
@@ -352,7 +300,9 @@ Element UIRenderer::render_header(const std::string& filename, bool modified, bo
 Element UIRenderer::render_status_bar(
     int cursor_x, int cursor_y,
     const std::string& status_message,
-    bool status_shown, StatusBarType status_type
+    bool status_shown, StatusBarType status_type,
+    const char* progress_label, int progress_percent,
+    const std::string& debug_info
 ) {
     Color background_color;
     Color foreground_color;
@@ -383,8 +333,20 @@ Element UIRenderer::render_status_bar(
                           ", Col " + std::to_string(cursor_x + 1);
     std::string status_display = status_shown ? status_message : pos_info;
 
+    // While the file is still loading or saving, say how far along it is
+    Element progress_indicator = emptyElement();
+    if (progress_label != nullptr) {
+        progress_indicator = hbox({
+            text(std::string(progress_label) + " "),
+            gauge(progress_percent / 100.0f) | size(WIDTH, EQUAL, 20),
+            text(" " + std::to_string(progress_percent) + "% ")
+        });
+    }
+
     return hbox({
-        text(" " + status_display) | flex
+        text(" " + status_display) | flex,
+        debug_info.empty() ? emptyElement() : text(debug_info),
+        progress_indicator
     }) | bgcolor(background_color) |
          color(foreground_color)   |
          (is_bold ? bold : nothing);
@@ -2,9 +2,15 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+#include <unordered_map>
 #include "ftxui/dom/elements.hpp"
 #include "shared_types.hpp"
 #include "ui_button.hpp"
+#include "text_buffer.hpp"
+#include "format_span_index.hpp"
 
 /// @brief Handles all UI rendering for the editor
 class UIRenderer {
@@ -17,22 +23,84 @@ public:
     ftxui::Element render(const RenderParams& params);
     inline static bool color_mode_dark = { true };
 
+    /// @brief Render the text lines with line numbers and selection (the text area alone, see bench/render_bench)
+    ///
+    /// The text of a line is reused from an earlier frame when nothing it
+    /// depends on has changed, see LineCacheKey.
+    ftxui::Elements render_lines(
+        const TextBuffer& buffer,
+        int cursor_x, int cursor_y,
+        int scroll_y,
+        int visible_lines,
+        const SelectionRange& selection,
+        FormatSpanIndex& format_spans,
+        EditorMode editor_mode
+    );
+
+    /// @brief Counters of the line cache of render_lines(), shown in debug mode
+    struct LineCacheStats {
+        size_t hits = 0;            // Lines reused from an earlier frame, since the start
+        size_t misses = 0;          // ... and lines built
+        size_t frame_hits = 0;      // The same for the last frame
+        size_t frame_misses = 0;
+    };
+    const LineCacheStats& line_cache_stats() const { return line_cache_stats_; }
+    /// @brief Forget the cached lines, the next frame builds them all
+    void clear_line_cache() { line_cache_.clear(); }
+
 private:
     /// @brief Check if the terminal supports emojis
     /// @return True if emojis are supported, false otherwise
     bool supports_emojis() const;
     
-    /// @brief Parse markdown formatting from text and apply FTXUI styles
-    /// @param text The text to parse (may contain markdown)
-    /// @param start_pos Starting position in the text
-    /// @param is_selected Whether this text is selected
-    /// @param cursor_x_in_line Cursor X position in line (-1 if not on this line)
-    /// @return Vector of styled elements and the number of bytes consumed
-    struct ParseResult {
-        ftxui::Elements elements;
-        size_t bytes_consumed;
+    /// @brief Characters of a line in one style (StyledRun::BOLD etc.), rendered as one text element
+    struct StyledRun {
+        enum Style : uint8_t {
+            BOLD = 1 << 0,
+            ITALIC = 1 << 1,
+            UNDERLINE = 1 << 2,
+            STRIKETHROUGH = 1 << 3,
+            SELECTED = 1 << 4,
+            CURSOR = 1 << 5
+        };
+        std::string text;
+        uint8_t style = 0;
     };
-    ParseResult parse_markdown_segment(const std::string& text, size_t start_pos, bool is_selected, int cursor_x_in_line);
+
+    /// @brief Add text to the last run if it has the same style, or start a new run
+    static void append_run(std::vector<StyledRun>& runs, std::string_view text, uint8_t style);
+    static ftxui::Element render_run(const StyledRun& run);
+
+    /// @brief Element of the text of a line, without the line number
+    /// @param spans Markdown formatting (FANCY and DOCUMENT modes): markers are
+    ///        hidden, the text gets the formats of the spans it is in. Null for plain text.
+    static ftxui::Element render_line_content(std::vector<StyledRun>& runs, std::string_view line, bool ascii,
+                                              const FormatSpans* spans, int cursor, int selection_begin,
+                                              int selection_end);
+
+    /// @brief Everything the text element of a line depends on besides the text
+    struct LineCacheKey {
+        uint64_t hash;              // LineInfo::hash of the text
+        EditorMode mode;
+        bool dark;
+        int selection_begin;        // Selected bytes of the line, both 0 if none are
+        int selection_end;
+        int cursor;                 // Cursor column, -1 on the other lines
+        bool operator==(const LineCacheKey&) const = default;
+    };
+    struct LineCacheKeyHash {
+        size_t operator()(const LineCacheKey& key) const;
+    };
+    struct LineCacheEntry {
+        std::string text;           // Compared on a hit, in case of a hash collision
+        ftxui::Element content;
+        uint64_t frame = 0;         // Last frame it was shown in
+    };
+    // Lines of recent frames are kept until there are this many screens of them
+    static constexpr size_t LINE_CACHE_SCREENS = 4;
+    std::unordered_map<LineCacheKey, LineCacheEntry, LineCacheKeyHash> line_cache_;
+    uint64_t frame_ = 0;
+    LineCacheStats line_cache_stats_;
 
     inline static const std::string tab_symbol = { "➡️   " };
     inline static const ftxui::Element spacing = { ftxui::text(" ") };
@@ -47,7 +115,9 @@ private:
     ftxui::Element render_status_bar(
         int cursor_x, int cursor_y,
         const std::string& status_message,
-        bool status_shown, StatusBarType status_type
+        bool status_shown, StatusBarType status_type,
+        const char* progress_label, int progress_percent,
+        const std::string& debug_info
     );
     
     /// @brief Render the shortcuts bar, the bar below the writing area.
@@ -71,16 +141,6 @@ private:
     /// @brief Render the close button
     ftxui::Element render_close_button();
     
-    /// @brief Render the text lines with line numbers and selection
-    ftxui::Elements render_lines(
-        const std::vector<std::string>& buffer,
-        int cursor_x, int cursor_y,
-        int scroll_y,
-        int visible_lines,
-        std::function<bool(int, int)> is_char_selected_fn,
-        EditorMode editor_mode
-    );
-
     // Button instances for efficient rendering with dirty flags
     std::unique_ptr<UIButton> save_button_;
     std::unique_ptr<UIButton> bold_button_;
@@ -0,0 +1,211 @@
+#include <undo_history_file.hpp>
+#include <batch_writer.hpp>
+#include <line_table.hpp>
+#include <undo_spill_file.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t ENTRY_FIELDS_SIZE = sizeof(int64_t) + 5 * sizeof(int32_t);
+constexpr size_t FOOTER_SIZE = 3 * sizeof(uint64_t);
+
+/// @brief Reads native integers off a mapping, every read checked against its end
+struct Reader {
+    std::string_view data;
+    size_t at = 0;
+
+    template <typename T>
+    bool take(T& value) {
+        if (data.size() - at < sizeof(value)) return false;
+        std::memcpy(&value, data.data() + at, sizeof(value));
+        at += sizeof(value);
+        return true;
+    }
+};
+
+template <typename T>
+bool add_number(BatchWriter& writer, T value) {
+    return writer.add(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+}
+
+} // namespace
+
+// ===== Locating =====
+
+bool UndoHistoryFile::stat_key(const std::string& filename, Key& key) {
+    char resolved[PATH_MAX];
+    if (realpath(filename.c_str(), resolved) == nullptr) return false;
+    struct stat st;
+    if (stat(resolved, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    key.path = resolved;
+    key.size = static_cast<uint64_t>(st.st_size);
+    key.modified_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+fs::path UndoHistoryFile::location(const std::string& path) {
+    fs::path directory;
+    const char* xdg_state_home = std::getenv("XDG_STATE_HOME");
+    if (xdg_state_home && fs::path(xdg_state_home).is_absolute()) {
+        directory = fs::path(xdg_state_home) / "bznota" / "undo";
+    } else {
+        const char* home = std::getenv("HOME");
+        if (!home) return {};
+        directory = fs::path(home) / ".local" / "state" / "bznota" / "undo";
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.undo",
+                  static_cast<unsigned long long>(LineInfo::describe(path).hash));
+    return directory / name;
+}
+
+// ===== Reading =====
+
+bool UndoHistoryFile::open(const Key& key) {
+    close();
+    const fs::path path = location(key.path);
+    if (path.empty() || !mapped_.open(path.string())) return false;
+
+    // Header - a history for another version of the file is no use
+    Reader header{mapped_.view()};
+    char magic[sizeof(MAGIC)];
+    uint64_t size = 0, path_length = 0;
+    int64_t modified_ns = 0;
+    const bool header_ok = header.take(magic) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                           header.take(size) && header.take(modified_ns) && header.take(content_hash_) &&
+                           header.take(path_length) && path_length <= header.data.size() - header.at &&
+                           header.data.substr(header.at, path_length) == key.path;
+    if (!header_ok || size != key.size || modified_ns != key.modified_ns) {
+        close();
+        return false;
+    }
+
+    // Footer, then the index it points at
+    const std::string_view data = mapped_.view();
+    uint64_t index_offset = 0, entry_count = 0, undo_count = 0;
+    Reader footer{data, data.size() >= FOOTER_SIZE ? data.size() - FOOTER_SIZE : data.size()};
+    if (!footer.take(index_offset) || !footer.take(entry_count) || !footer.take(undo_count) ||
+        undo_count > entry_count || index_offset > data.size() - FOOTER_SIZE ||
+        entry_count > (data.size() - FOOTER_SIZE - index_offset) / (2 * sizeof(uint64_t))) {
+        close();
+        return false;
+    }
+
+    Reader index{data.substr(0, data.size() - FOOTER_SIZE), index_offset};
+    entries_.reserve(entry_count);
+    for (uint64_t i = 0; i < entry_count; i++) {
+        uint64_t offset = 0, length = 0;
+        index.take(offset);
+        index.take(length);
+        Reader fields{data.substr(0, index_offset), offset};
+        Entry entry;
+        if (offset > index_offset || length < ENTRY_FIELDS_SIZE || length > index_offset - offset ||
+            !fields.take(entry.time_ns) || !fields.take(entry.start_line) ||
+            !fields.take(entry.cursor_x_before) || !fields.take(entry.cursor_y_before) ||
+            !fields.take(entry.cursor_x_after) || !fields.take(entry.cursor_y_after)) {
+            close();
+            return false;
+        }
+        // The lines are only looked at when the entry is undone
+        entry.lines = data.substr(offset + ENTRY_FIELDS_SIZE, length - ENTRY_FIELDS_SIZE);
+        entries_.push_back(entry);
+    }
+    undo_count_ = undo_count;
+    return true;
+}
+
+void UndoHistoryFile::close() {
+    mapped_.close();
+    content_hash_ = 0;
+    entries_.clear();
+    undo_count_ = 0;
+}
+
+// ===== Writing =====
+
+UndoHistoryFile::Writer::Writer() = default;
+
+UndoHistoryFile::Writer::~Writer() {
+    // Not finished, the old history stays
+    if (fd_ >= 0) {
+        ::close(fd_);
+        unlink(temp_path_.c_str());
+    }
+}
+
+bool UndoHistoryFile::Writer::begin(const Key& key) {
+    target_ = location(key.path);
+    if (target_.empty()) return false;
+    std::error_code error;
+    fs::create_directories(target_.parent_path(), error);
+    if (error) return false;
+
+    // Written next to the old one and renamed over it, a crash leaves either
+    temp_path_ = target_.string() + ".XXXXXX";
+    fd_ = mkostemp(temp_path_.data(), O_CLOEXEC);
+    if (fd_ < 0) return false;
+    writer_ = std::make_unique<BatchWriter>(fd_);
+
+    const uint64_t path_length = key.path.size();
+    return writer_->add(std::string_view(MAGIC, sizeof(MAGIC))) && add_number(*writer_, key.size) &&
+           add_number(*writer_, key.modified_ns) && add_number(*writer_, key.content_hash) &&
+           add_number(*writer_, path_length) && writer_->add(key.path);
+}
+
+bool UndoHistoryFile::Writer::add_fields(const Entry& entry) {
+    return add_number(*writer_, entry.time_ns) && add_number(*writer_, entry.start_line) &&
+           add_number(*writer_, entry.cursor_x_before) && add_number(*writer_, entry.cursor_y_before) &&
+           add_number(*writer_, entry.cursor_x_after) && add_number(*writer_, entry.cursor_y_after);
+}
+
+bool UndoHistoryFile::Writer::end_entry(uint64_t offset, bool ok) {
+    if (!ok) return false;
+    index_.push_back(offset);
+    index_.push_back(writer_->bytes_written() - offset);
+    return true;
+}
+
+bool UndoHistoryFile::Writer::add(const Entry& entry, const std::vector<std::string_view>& old_lines,
+                                  const std::vector<std::string_view>& new_lines) {
+    // Flushed around each entry: offsets are counted in written bytes, and the
+    // caller's lines need to stay valid for this call only
+    if (fd_ < 0 || !writer_->flush()) return false;
+    const uint64_t offset = writer_->bytes_written();
+    return end_entry(offset, add_fields(entry) && UndoSpillFile::add_record(*writer_, old_lines, new_lines) &&
+                             writer_->flush());
+}
+
+bool UndoHistoryFile::Writer::add(const Entry& entry) {
+    if (fd_ < 0 || !writer_->flush()) return false;
+    const uint64_t offset = writer_->bytes_written();
+    return end_entry(offset, add_fields(entry) && writer_->add(entry.lines) && writer_->flush());
+}
+
+bool UndoHistoryFile::Writer::finish(size_t undo_count) {
+    if (fd_ < 0 || !writer_->flush()) return false;
+
+    const uint64_t index_offset = writer_->bytes_written();
+    bool ok = true;
+    for (uint64_t value : index_) ok = ok && add_number(*writer_, value);
+    const uint64_t entry_count = index_.size() / 2;
+    ok = ok && add_number(*writer_, index_offset) && add_number(*writer_, entry_count) &&
+         add_number(*writer_, static_cast<uint64_t>(undo_count)) && writer_->flush();
+
+    ok = ::close(fd_) == 0 && ok;
+    fd_ = -1;
+    if (!ok || rename(temp_path_.c_str(), target_.c_str()) != 0) {
+        unlink(temp_path_.c_str());
+        return false;
+    }
+    return true;
+}
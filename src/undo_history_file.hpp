@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mapped_file.hpp>
+
+class BatchWriter;
+
+/// @brief Undo history of one file, kept across sessions
+///
+/// Stored under $XDG_STATE_HOME/bznota/undo/ (~/.local/state/...), one file
+/// per edited file, named after a hash of its absolute path. The history only
+/// belongs to the file as it was when it was written: the header has the
+/// path, size, modification time and a hash of the contents, and a history
+/// that doesn't match is ignored.
+///
+/// Layout, integers in native byte order:
+///   "BZUNDO02", size, mtime (ns), content hash, path length, path
+///   entries - int64 time made (ns), five int32 (line, cursor before x/y,
+///             after x/y), then the lines in UndoSpillFile record layout
+///   index - offset and size of each entry
+///   footer - index offset, entry count, count of the undo entries among them
+///
+/// Opening maps the file and reads only the header, footer and index, the
+/// entries are parsed when they are undone.
+class UndoHistoryFile {
+public:
+    /// @brief The version of the file a history belongs to
+    struct Key {
+        std::string path;
+        uint64_t size = 0;
+        int64_t modified_ns = 0;
+        uint64_t content_hash = 0;
+    };
+
+    /// @brief One saved history entry
+    struct Entry {
+        int64_t time_ns = 0;     // When the edit was made, since the epoch
+        int32_t start_line = 0;
+        int32_t cursor_x_before = 0, cursor_y_before = 0;
+        int32_t cursor_x_after = 0, cursor_y_after = 0;
+        std::string_view lines;  // UndoSpillFile record, points into the mapping
+    };
+
+    /// @brief Key of `filename` as it is on disk, without the content hash
+    /// @return False if it doesn't exist
+    static bool stat_key(const std::string& filename, Key& key);
+
+    /// @brief Where the history of `key.path` is kept
+    static std::filesystem::path location(const std::string& path);
+
+    /// @brief Map the history of `key.path`, if there is one for this size and mtime
+    /// The content hash is only compared by matches(), it needs the whole document.
+    bool open(const Key& key);
+    void close();
+    bool is_open() const { return mapped_.is_open(); }
+
+    /// @brief Does the history belong to contents with this hash?
+    bool matches(uint64_t content_hash) const { return is_open() && content_hash_ == content_hash; }
+
+    /// @brief Undo entries (oldest first), then redo entries (the next redo last)
+    const std::vector<Entry>& entries() const { return entries_; }
+    size_t undo_count() const { return undo_count_; }
+
+    /// @brief Writes a history file: begin(), add() per entry, finish()
+    class Writer {
+    public:
+        Writer();
+        ~Writer();
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        bool begin(const Key& key);
+        bool add(const Entry& entry, const std::vector<std::string_view>& old_lines,
+                 const std::vector<std::string_view>& new_lines);
+        /// @brief Add an entry whose lines are a record already (entry.lines)
+        bool add(const Entry& entry);
+        /// @brief Write the index and move the file into place
+        bool finish(size_t undo_count);
+
+    private:
+        bool add_fields(const Entry& entry);
+        /// @brief Record the entry that started at `offset` in the index
+        bool end_entry(uint64_t offset, bool ok);
+
+        int fd_ = -1;
+        std::string temp_path_;
+        std::filesystem::path target_;
+        std::unique_ptr<BatchWriter> writer_;
+        std::vector<uint64_t> index_;      // Offset and size per entry
+    };
+
+private:
+    static constexpr char MAGIC[8] = {'B', 'Z', 'U', 'N', 'D', 'O', '0', '2'};
+
+    MappedFile mapped_;
+    uint64_t content_hash_ = 0;
+    std::vector<Entry> entries_;
+    size_t undo_count_ = 0;
+};
@@ -1,59 +1,527 @@
 #include <undo_redo_manager.hpp>
+#include <lz_codec.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
 
-UndoRedoManager::UndoRedoManager() {}
+UndoRedoManager::UndoRedoManager() {
+    reset_tree();
+}
+
+void UndoRedoManager::set_memory_budget(size_t bytes) {
+    memory_budget = bytes;
+}
+
+void UndoRedoManager::reset_tree() {
+    nodes.clear();
+    nodes.emplace_back();
+    nodes.back().time = Clock::now();
+    first_index = 0;
+    root = 0;
+    current = 0;
+    oldest_edit = 1;
+    spilled_until = 1;
+    compressed_until = 1;
+}
 
 // ===== save_state =====
 // Called BEFORE each edit (or group of edits).
 // If a previous edit is still pending, commit it first.
 
 void UndoRedoManager::save_state(
-    const std::vector<std::string>& buffer,
+    TextBuffer& buffer,
     int cursor_x,
-    int cursor_y
+    int cursor_y,
+    bool may_compact
 ) {
     // Commit the previous edit (diff pending snapshot vs current buffer)
     if (has_pending) {
         commit_pending(buffer, cursor_x, cursor_y);
     }
+    poll_compression(buffer);
+
+    // Text the history let go of is still in the buffer's add buffer - once
+    // it is worth half the budget, the add buffer is compacted. No snapshot
+    // exists between the commit and the next one, except the checkpoints.
+    if (may_compact && released_bytes > memory_budget / 2) {
+        std::vector<TextBuffer::LineRef*> refs;
+        std::vector<TextBuffer::Snapshot*> checkpoints;
+        std::vector<TextBuffer::Piece> released;
+        std::vector<Compressed*> releasers;
+        for (Node& n : nodes) {
+            // Text read back is stored anew the next time, it goes unless the document holds it
+            n.cmd.stored = {};
+            if (!n.alive) continue;
+            for (TextBuffer::LineRef& ref : n.cmd.old_lines) refs.push_back(&ref);
+            for (TextBuffer::LineRef& ref : n.cmd.new_lines) refs.push_back(&ref);
+            if (n.checkpoint) checkpoints.push_back(&*n.checkpoint);
+            if (n.cmd.compressed) {
+                for (const TextBuffer::Piece& run : n.cmd.compressed->released) {
+                    released.push_back(run);
+                    releasers.push_back(n.cmd.compressed.get());
+                }
+                std::vector<TextBuffer::Piece>().swap(n.cmd.compressed->released);
+            }
+        }
+        // What compression saved shows here - the lines compressed entries let
+        // go of are freed only if no one else holds them
+        const std::vector<size_t> freed = buffer.compact_add_buffer(refs, checkpoints, released);
+        for (size_t i = 0; i < freed.size(); i++) {
+            releasers[i]->freed += freed[i];
+            compression.freed_bytes += freed[i];
+        }
+        released_bytes = 0;
+    }
 
-    // Store current buffer as the "before" snapshot for the upcoming edit
-    pending_buffer = buffer;
+    // Store current buffer as the "before" snapshot for the upcoming edit,
+    // O(1) - it shares the tree, the old lines are only read back on commit.
+    // Edits made outside a group are not part of this one.
+    pending_snapshot = buffer.snapshot();
+    buffer.take_changed_range();
     pending_cx = cursor_x;
     pending_cy = cursor_y;
     has_pending = true;
+}
+
+// ===== clear =====
+
+void UndoRedoManager::clear() {
+    cancel_compression();
+    has_pending = false;
+    pending_snapshot = {};
+    for (Node& n : nodes) release(n.cmd);
+    reset_tree();
+    // The handles went with the buffer contents, so did the text they held on to
+    released_bytes = 0;
+    history_file.close();
+    history_restored = false;
+}
+
+// ===== Budget =====
+
+void UndoRedoManager::release(EditCommand& cmd) {
+    memory_bytes_ -= cmd.bytes;
+    released_bytes += cmd.bytes;
+    cmd.bytes = 0;
+    cmd.stored = {};
+    if (cmd.spilled) {
+        spill_file.release(*cmd.spilled);
+        cmd.spilled.reset();
+    }
+    drop_compressed(cmd);
+}
+
+void UndoRedoManager::kill(Node& dead) {
+    release(dead.cmd);
+    dead.cmd = EditCommand{};
+    std::vector<size_t>().swap(dead.children);
+    dead.checkpoint.reset();
+    dead.alive = false;
+}
+
+bool UndoRedoManager::spill(const TextBuffer& buffer, EditCommand& cmd) {
+    // Restored entries are on disk already
+    if (cmd.spilled || !cmd.restored.empty()) return true;
+
+    std::string old_store, new_store;
+    std::vector<std::string_view> old_text, new_text;
+    if (!line_texts(buffer, cmd, old_store, new_store, old_text, new_text)) return false;
+
+    UndoSpillFile::Record record;
+    if (!spill_file.write(old_text, new_text, record)) return false;
+    drop_compressed(cmd);
+
+    // The handles go, the text they held on to can be compacted away
+    memory_bytes_ -= cmd.bytes;
+    released_bytes += cmd.bytes;
+    cmd.bytes = 0;
+    cmd.spilled = record;
+    std::vector<TextBuffer::LineRef>().swap(cmd.old_lines);
+    std::vector<TextBuffer::LineRef>().swap(cmd.new_lines);
+    return true;
+}
+
+bool UndoRedoManager::drop_oldest() {
+    // The oldest edit hangs off the root - parents are older than their children
+    const size_t last = newest_index();
+    while (oldest_edit <= last && !node(oldest_edit).alive) oldest_edit++;
+    if (oldest_edit > last) return false;
+    const size_t dropped = oldest_edit;
+    Node& old_root = node(root);
+
+    // Is the current state below the dropped edit? Without other branches it
+    // is unless it is the root, no need to look
+    bool below = current != root;
+    if (below && old_root.children.size() > 1) {
+        below = false;
+        for (size_t i = current; i != NO_NODE && i >= dropped; i = node(i).parent) {
+            if (i == dropped) {
+                below = true;
+                break;
+            }
+        }
+    }
+
+    // If so, it becomes the root and every other branch goes - they can only
+    // be reached through the old root. Otherwise it goes with its subtree.
+    // Only the nodes that go are visited.
+    std::vector<size_t> doomed;
+    if (below) {
+        for (size_t child : old_root.children) {
+            if (child != dropped) doomed.push_back(child);
+        }
+    } else {
+        doomed.push_back(dropped);
+        std::erase(old_root.children, dropped);
+        if (old_root.redo_child == dropped) {
+            old_root.redo_child = old_root.children.empty() ? NO_NODE : old_root.children.back();
+        }
+    }
+    while (!doomed.empty()) {
+        Node& n = node(doomed.back());
+        doomed.pop_back();
+        doomed.insert(doomed.end(), n.children.begin(), n.children.end());
+        kill(n);
+    }
+
+    if (below) {
+        kill(old_root);
+        Node& new_root = node(dropped);
+        // A root's command is never applied
+        release(new_root.cmd);
+        new_root.cmd = EditCommand{};
+        new_root.parent = NO_NODE;
+        root = dropped;
+    }
+
+    // The dead leave from the front, the root is always alive
+    while (!nodes.front().alive) {
+        nodes.pop_front();
+        first_index++;
+    }
+    oldest_edit = std::max(oldest_edit, root + 1);
+    spilled_until = std::max(spilled_until, first_index);
+    return true;
+}
+
+void UndoRedoManager::enforce_budget(const TextBuffer& buffer) {
+    // One entry this large would push most of the history out of memory
+    EditCommand& newest = node(current).cmd;
+    if (newest.bytes > memory_budget / 4 && !spill(buffer, newest)) {
+        // No spill file - it only stays if it fits
+        while (memory_bytes_ > memory_budget && node(current).parent != root && drop_oldest()) {}
+    }
+
+    // Oldest first. Without a spill file they are dropped instead.
+    while (memory_bytes_ > memory_budget && spilled_until <= newest_index()) {
+        Node& n = node(spilled_until);
+        if (!n.alive || spilled_until == root || spill(buffer, n.cmd)) {
+            spilled_until++;
+        } else if (!drop_oldest()) {
+            break;
+        }
+    }
+
+    while (spill_file.bytes() > memory_budget * SPILL_BUDGET_FACTOR && drop_oldest()) {}
+}
+
+bool UndoRedoManager::apply(TextBuffer& buffer, EditCommand& cmd, bool undoing) {
+    if (cmd.compressed) {
+        // Decompressed straight into the add buffer, in one block, once per
+        // side - the entry stays compressed, applying it again takes the same lines
+        std::optional<size_t>& first = undoing ? cmd.stored.old_first : cmd.stored.new_first;
+        if (!first) {
+            const auto start = std::chrono::steady_clock::now();
+            const std::string& compressed = undoing ? cmd.compressed->old_text : cmd.compressed->new_text;
+            const size_t size = LzCodec::decompressed_size(compressed);
+            // Each thread splits and hashes the lines of the part it decompressed
+            const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+            std::vector<LineScan> scans(threads);
+            first = buffer.store_lines(size, scans, [&compressed, &scans, threads, size](char* data) {
+                return LzCodec::decompress(compressed, data, threads, [&scans, data, size](size_t part, size_t begin, size_t end) {
+                    scans[part].scan(std::string_view(data, size), begin, end);
+                });
+            });
+            if (!first) return false;
+            // A copy of what the entry holds compressed, garbage once the document moves on
+            released_bytes += size;
+
+            const auto took = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            compression.decompressions++;
+            compression.last_decompressed_bytes = size;
+            compression.last_decompress = took;
+            compression.max_decompress = std::max(compression.max_decompress, took);
+        }
+
+        std::vector<TextBuffer::Piece> pieces = undoing ? cmd.compressed->old_pieces : cmd.compressed->new_pieces;
+        for (TextBuffer::Piece& piece : pieces) {
+            if (piece.source == TextBuffer::Source::ADD) piece.first += *first;
+        }
+        buffer.replace_lines(cmd.start_line, line_count(undoing ? cmd.compressed->new_pieces : cmd.compressed->old_pieces),
+                             pieces);
+        return true;
+    }
+
+    if (!cmd.spilled && cmd.restored.empty()) {
+        if (undoing) {
+            buffer.replace_lines(cmd.start_line, cmd.new_lines.size(), cmd.old_lines);
+        } else {
+            buffer.replace_lines(cmd.start_line, cmd.old_lines.size(), cmd.new_lines);
+        }
+        return true;
+    }
+
+    // Back from disk into the add buffer, once per side - the entry stays
+    // spilled, applying it again takes the same lines
+    std::optional<size_t>& first = undoing ? cmd.stored.old_first : cmd.stored.new_first;
+    if (!first) {
+        std::vector<std::string> old_lines, new_lines;
+        const bool read = cmd.spilled ? spill_file.read(*cmd.spilled, old_lines, new_lines)
+                                      : UndoSpillFile::parse_record(cmd.restored, old_lines, new_lines);
+        if (!read) return false;
+        std::string text;
+        for (const std::string& line : undoing ? old_lines : new_lines) {
+            text.append(line);
+            text.push_back('\n');
+        }
+        first = buffer.store_lines(text);
+        cmd.stored.old_count = old_lines.size();
+        cmd.stored.new_count = new_lines.size();
+        // A copy of what the history holds on disk, garbage once the document moves on
+        released_bytes += text.size();
+    }
+
+    const size_t count = undoing ? cmd.stored.old_count : cmd.stored.new_count;
+    std::vector<TextBuffer::Piece> pieces;
+    if (count > 0) pieces.push_back(TextBuffer::Piece{TextBuffer::Source::ADD, *first, count});
+    buffer.replace_lines(cmd.start_line, undoing ? cmd.stored.new_count : cmd.stored.old_count, pieces);
+    return true;
+}
+
+// ===== Compression =====
+// Cold entries are compressed on a worker thread, one at a time. The job
+// gets a copy of the text, the history goes on changing meanwhile - the
+// result is only taken if its entry is still as it was.
+
+bool UndoRedoManager::compressible(const EditCommand& cmd) {
+    return !cmd.spilled && cmd.restored.empty() && !cmd.compressed && cmd.bytes >= COMPRESS_MIN_BYTES;
+}
+
+void UndoRedoManager::set_compression_listener(std::function<void()> listener) {
+    cancel_compression();
+    compress_listener = std::move(listener);
+}
+
+void UndoRedoManager::cancel_compression() {
+    if (!compress_job) return;
+    compress_job.reset();
+    compressed_until = std::min(compressed_until, compressing);
+    compressing = NO_NODE;
+}
+
+void UndoRedoManager::start_compression(const TextBuffer& buffer) {
+    if (compress_job) return;
+    compressed_until = std::max(compressed_until, first_index);
+    while (compressed_until + COMPRESS_DISTANCE <= newest_index()) {
+        const size_t index = compressed_until++;
+        const Node& n = node(index);
+        if (!n.alive || index == root || !compressible(n.cmd)) continue;
+
+        // One copy on this thread, the compression runs on the worker
+        std::vector<std::string> texts(2);
+        for (size_t side = 0; side < 2; side++) {
+            const std::vector<TextBuffer::LineRef>& lines = side == 0 ? n.cmd.old_lines : n.cmd.new_lines;
+            size_t size = 0;
+            for (const TextBuffer::LineRef& ref : lines) {
+                if (ref.source == TextBuffer::Source::ADD) size += buffer.text(ref).size() + 1;
+            }
+            texts[side].reserve(size);
+            for (const TextBuffer::LineRef& ref : lines) {
+                if (ref.source != TextBuffer::Source::ADD) continue;
+                texts[side].append(buffer.text(ref));
+                texts[side].push_back('\n');
+            }
+        }
+        compressing = index;
+        compress_job = std::make_unique<CompressJob>(std::move(texts), compress_listener);
+        return;
+    }
+}
+
+void UndoRedoManager::poll_compression(const TextBuffer& buffer) {
+    if (compress_job && compress_job->done()) {
+        std::vector<std::string> results = std::move(compress_job->results());
+        compress_job.reset();
+        const size_t index = compressing;
+        compressing = NO_NODE;
+
+        // Spilled, dropped or made the root meanwhile - the result is no use
+        if (has_node(index) && index != root && compressible(node(index).cmd)) {
+            EditCommand& cmd = node(index).cmd;
+            auto compressed = std::make_unique<Compressed>();
+            compressed->old_pieces = pieces_of(cmd.old_lines);
+            compressed->new_pieces = pieces_of(cmd.new_lines);
+            compressed->old_text = std::move(results[0]);
+            compressed->new_text = std::move(results[1]);
+            const size_t raw = LzCodec::decompressed_size(compressed->old_text) +
+                               LzCodec::decompressed_size(compressed->new_text);
+            const size_t bytes = sizeof(Node) + sizeof(Compressed) +
+                                 (compressed->old_pieces.size() + compressed->new_pieces.size()) * sizeof(TextBuffer::Piece) +
+                                 compressed->old_text.size() + compressed->new_text.size();
+            if (bytes < cmd.bytes) {
+                // The entry lets go of the text, the next compaction frees
+                // what no one else holds and tells how much that was
+                for (const auto* lines : {&cmd.old_lines, &cmd.new_lines}) {
+                    for (const TextBuffer::LineRef& ref : *lines) {
+                        if (ref.source != TextBuffer::Source::ADD) continue;
+                        std::vector<TextBuffer::Piece>& runs = compressed->released;
+                        if (!runs.empty() && runs.back().first + runs.back().count == ref.index) {
+                            runs.back().count++;
+                        } else {
+                            runs.push_back(TextBuffer::Piece{TextBuffer::Source::ADD, ref.index, 1});
+                        }
+                    }
+                }
+                memory_bytes_ -= cmd.bytes - bytes;
+                released_bytes += raw;
+                cmd.bytes = bytes;
+                compression.entries++;
+                compression.raw_bytes += raw;
+                compression.compressed_bytes += compressed->old_text.size() + compressed->new_text.size();
+                cmd.compressed = std::move(compressed);
+                std::vector<TextBuffer::LineRef>().swap(cmd.old_lines);
+                std::vector<TextBuffer::LineRef>().swap(cmd.new_lines);
+            }
+        }
+    }
+    start_compression(buffer);
+}
+
+std::vector<TextBuffer::Piece> UndoRedoManager::pieces_of(const std::vector<TextBuffer::LineRef>& lines) {
+    // Edited lines are numbered in order of their text, runs of either kind collapse
+    std::vector<TextBuffer::Piece> pieces;
+    size_t added = 0;
+    for (const TextBuffer::LineRef& ref : lines) {
+        const size_t index = ref.source == TextBuffer::Source::ADD ? added++ : ref.index;
+        if (!pieces.empty() && pieces.back().source == ref.source &&
+            pieces.back().first + pieces.back().count == index) {
+            pieces.back().count++;
+        } else {
+            pieces.push_back(TextBuffer::Piece{ref.source, index, 1});
+        }
+    }
+    return pieces;
+}
+
+size_t UndoRedoManager::line_count(const std::vector<TextBuffer::Piece>& pieces) {
+    size_t count = 0;
+    for (const TextBuffer::Piece& piece : pieces) count += piece.count;
+    return count;
+}
+
+void UndoRedoManager::drop_compressed(EditCommand& cmd) {
+    if (!cmd.compressed) return;
+    cmd.stored = {};
+    compression.entries--;
+    compression.raw_bytes -= LzCodec::decompressed_size(cmd.compressed->old_text) +
+                             LzCodec::decompressed_size(cmd.compressed->new_text);
+    compression.compressed_bytes -= cmd.compressed->old_text.size() + cmd.compressed->new_text.size();
+    compression.freed_bytes -= cmd.compressed->freed;
+    cmd.compressed.reset();
+}
+
+bool UndoRedoManager::line_texts(const TextBuffer& buffer, const EditCommand& cmd, std::string& old_store,
+                                 std::string& new_store, std::vector<std::string_view>& old_text,
+                                 std::vector<std::string_view>& new_text) const {
+    for (size_t side = 0; side < 2; side++) {
+        std::vector<std::string_view>& text = side == 0 ? old_text : new_text;
+        if (!cmd.compressed) {
+            const std::vector<TextBuffer::LineRef>& lines = side == 0 ? cmd.old_lines : cmd.new_lines;
+            text.reserve(lines.size());
+            for (const TextBuffer::LineRef& ref : lines) text.push_back(buffer.text(ref));
+            continue;
+        }
+
+        const std::vector<TextBuffer::Piece>& pieces = side == 0 ? cmd.compressed->old_pieces : cmd.compressed->new_pieces;
+        const std::string& compressed = side == 0 ? cmd.compressed->old_text : cmd.compressed->new_text;
+        std::string& store = side == 0 ? old_store : new_store;
+        store.resize_and_overwrite(LzCodec::decompressed_size(compressed), [](char*, size_t size) { return size; });
+        if (!LzCodec::decompress(compressed, store.data())) return false;
+        text.reserve(line_count(pieces));
+        std::string_view rest = store;
+        for (const TextBuffer::Piece& piece : pieces) {
+            for (size_t i = 0; i < piece.count; i++) {
+                if (piece.source != TextBuffer::Source::ADD) {
+                    text.push_back(buffer.text({piece.source, piece.first + i}));
+                    continue;
+                }
+                const size_t end = rest.find('\n');
+                if (end == std::string_view::npos) return false;
+                text.push_back(rest.substr(0, end));
+                rest.remove_prefix(end + 1);
+            }
+        }
+    }
+    return true;
+}
 
-    // A new edit invalidates the redo history
-    redo_stack.clear();
+size_t UndoRedoManager::checkpoint_count() const {
+    size_t count = 0;
+    for (const Node& n : nodes) {
+        if (n.alive && n.checkpoint) count++;
+    }
+    return count;
+}
+
+size_t UndoRedoManager::checkpoint_bytes(const TextBuffer& buffer) const {
+    std::vector<const TextBuffer::Snapshot*> checkpoints;
+    for (const Node& n : nodes) {
+        if (n.alive && n.checkpoint) checkpoints.push_back(&*n.checkpoint);
+    }
+    return buffer.snapshot_bytes(checkpoints);
 }
 
 // ===== commit_pending =====
-// Diffs the pending "before" buffer against the current "after" buffer.
-// Only the changed line range is stored as an EditCommand.
+// Takes the range of lines the buffer reports as touched since save_state()
+// and stores only that range as an EditCommand - the rest of the document is
+// never looked at, so committing costs O(size of the change).
 
 void UndoRedoManager::commit_pending(
-    const std::vector<std::string>& current_buffer,
+    TextBuffer& current_buffer,
     int cursor_x,
     int cursor_y
 ) {
     if (!has_pending) return;
 
-    const auto& old_buf = pending_buffer;
-    const auto& new_buf = current_buffer;
-    const int old_size = static_cast<int>(old_buf.size());
-    const int new_size = static_cast<int>(new_buf.size());
+    const TextBuffer::Snapshot& old_buf = pending_snapshot;
+    TextBuffer& new_buf = current_buffer;
 
-    // --- Find first differing line from the top ---
-    int first_diff = 0;
-    while (first_diff < old_size && first_diff < new_size &&
-           old_buf[first_diff] == new_buf[first_diff]) {
+    std::optional<TextBuffer::ChangedRange> range = new_buf.take_changed_range();
+    if (!range) {
+        has_pending = false;
+        pending_snapshot = {};
+        return;
+    }
+
+    // The range may include untouched lines between two edits, or text an edit
+    // put back - trim the lines that match at either end. Lines are compared
+    // through same_text_as(): unchanged lines still point at the same stored
+    // text as the snapshot, so the bytes are rarely looked at.
+    int first_diff = static_cast<int>(range->first);
+    int old_end = first_diff + static_cast<int>(range->old_count) - 1;
+    int new_end = first_diff + static_cast<int>(range->new_count) - 1;
+
+    auto old_it = new_buf.iterator_at(old_buf, first_diff);
+    auto new_it = new_buf.iterator_at(first_diff);
+    while (first_diff <= old_end && first_diff <= new_end && old_it.same_text_as(new_it)) {
+        ++old_it;
+        ++new_it;
         first_diff++;
     }
 
-    // --- Find last differing line from the bottom ---
-    int old_end = old_size - 1;
-    int new_end = new_size - 1;
-    while (old_end >= first_diff && new_end >= first_diff &&
-           old_buf[old_end] == new_buf[new_end]) {
+    old_it = new_buf.iterator_at(old_buf, old_end + 1);
+    new_it = new_buf.iterator_at(new_end + 1);
+    while (old_end >= first_diff && new_end >= first_diff && (--old_it).same_text_as(--new_it)) {
         old_end--;
         new_end--;
     }
@@ -61,7 +529,7 @@ void UndoRedoManager::commit_pending(
     // If nothing changed, discard
     if (first_diff > old_end && first_diff > new_end) {
         has_pending = false;
-        pending_buffer.clear();
+        pending_snapshot = {};
         return;
     }
 
@@ -73,28 +541,50 @@ void UndoRedoManager::commit_pending(
     cmd.cursor_x_after  = cursor_x;
     cmd.cursor_y_after  = cursor_y;
 
-    for (int i = first_diff; i <= old_end; i++) {
-        cmd.old_lines.push_back(old_buf[i]);
-    }
-    for (int i = first_diff; i <= new_end; i++) {
-        cmd.new_lines.push_back(new_buf[i]);
-    }
+    // Handles only, the line text stays where the buffer stored it
+    cmd.old_lines = new_buf.line_refs(old_buf, first_diff, old_end - first_diff + 1);
+    cmd.new_lines = new_buf.line_refs(first_diff, new_end - first_diff + 1);
 
-    undo_stack.push_back(std::move(cmd));
+    // What the entry keeps in use: its handles, and the text of edited lines -
+    // file lines stay where they are with or without the history
+    cmd.bytes = sizeof(Node) + (cmd.old_lines.size() + cmd.new_lines.size()) * sizeof(TextBuffer::LineRef);
+    for (const auto* lines : {&cmd.old_lines, &cmd.new_lines}) {
+        for (const TextBuffer::LineRef& ref : *lines) {
+            if (ref.source == TextBuffer::Source::ADD) cmd.bytes += new_buf.text(ref).size();
+        }
+    }
+    memory_bytes_ += cmd.bytes;
 
-    // Limit history depth
-    if (undo_stack.size() > max_history) {
-        undo_stack.erase(undo_stack.begin());
+    // --- A new node below the current one, the branch redo follows ---
+    Node& parent = node(current);
+    // The state before the edit is at hand - a checkpoint for free
+    if (!parent.checkpoint && parent.depth % CHECKPOINT_INTERVAL == 0) {
+        parent.checkpoint = pending_snapshot;
+    }
+    Node child;
+    child.cmd = std::move(cmd);
+    child.parent = current;
+    child.depth = parent.depth + 1;
+    child.time = Clock::now();
+    if (child.depth % CHECKPOINT_INTERVAL == 0) {
+        child.checkpoint = new_buf.snapshot();
     }
+    nodes.push_back(std::move(child));
+    current = newest_index();
+    parent.redo_child = current;
+    parent.children.push_back(current);
 
     has_pending = false;
-    pending_buffer.clear();
+    pending_snapshot = {};
+
+    enforce_budget(new_buf);
+    start_compression(new_buf);
 }
 
 // ===== undo =====
 
 bool UndoRedoManager::undo(
-    std::vector<std::string>& buffer,
+    TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y
 ) {
@@ -103,45 +593,252 @@ bool UndoRedoManager::undo(
         commit_pending(buffer, cursor_x, cursor_y);
     }
 
-    if (undo_stack.empty()) return false;
-
-    EditCommand cmd = std::move(undo_stack.back());
-    undo_stack.pop_back();
+    if (current == root) return false;
 
     // Replace new_lines with old_lines at start_line
-    auto it = buffer.begin() + cmd.start_line;
-    buffer.erase(it, it + static_cast<int>(cmd.new_lines.size()));
-    buffer.insert(buffer.begin() + cmd.start_line,
-                  cmd.old_lines.begin(), cmd.old_lines.end());
+    Node& n = node(current);
+    if (!apply(buffer, n.cmd, true)) {
+        // Older entries build on this one, none of them can be undone either
+        clear();
+        return false;
+    }
 
-    cursor_x = cmd.cursor_x_before;
-    cursor_y = cmd.cursor_y_before;
+    cursor_x = n.cmd.cursor_x_before;
+    cursor_y = n.cmd.cursor_y_before;
 
-    redo_stack.push_back(std::move(cmd));
+    // Redo comes back here
+    node(n.parent).redo_child = current;
+    current = n.parent;
     return true;
 }
 
 // ===== redo =====
 
 bool UndoRedoManager::redo(
-    std::vector<std::string>& buffer,
+    TextBuffer& buffer,
     int& cursor_x,
     int& cursor_y
 ) {
-    if (redo_stack.empty()) return false;
-
-    EditCommand cmd = std::move(redo_stack.back());
-    redo_stack.pop_back();
+    if (!can_redo()) return false;
 
     // Replace old_lines with new_lines at start_line
-    auto it = buffer.begin() + cmd.start_line;
-    buffer.erase(it, it + static_cast<int>(cmd.old_lines.size()));
-    buffer.insert(buffer.begin() + cmd.start_line,
-                  cmd.new_lines.begin(), cmd.new_lines.end());
+    const size_t child = node(current).redo_child;
+    Node& n = node(child);
+    if (!apply(buffer, n.cmd, false)) {
+        clear();
+        return false;
+    }
+
+    cursor_x = n.cmd.cursor_x_after;
+    cursor_y = n.cmd.cursor_y_after;
+
+    current = child;
+    return true;
+}
+
+// ===== Jumps =====
+// Up to the common ancestor and down to the target, or - when fewer commands
+// are replayed that way - restore the nearest checkpoint above the target and
+// go down from there.
+
+bool UndoRedoManager::jump_to(
+    TextBuffer& buffer,
+    size_t index,
+    int& cursor_x,
+    int& cursor_y
+) {
+    if (has_pending) {
+        commit_pending(buffer, cursor_x, cursor_y);
+    }
+    if (!has_node(index)) return false;
+    if (index == current) return true;
+
+    size_t up = current;
+    size_t down = index;
+    while (up != down) {
+        if (node(up).depth >= node(down).depth) {
+            up = node(up).parent;
+        } else {
+            down = node(down).parent;
+        }
+    }
+    const size_t common = up;
+    const size_t via_common = node(current).depth + node(index).depth - 2 * node(common).depth;
+
+    size_t checkpoint = index;
+    while (checkpoint != NO_NODE && !node(checkpoint).checkpoint) checkpoint = node(checkpoint).parent;
+    const bool from_checkpoint = checkpoint != NO_NODE && node(index).depth - node(checkpoint).depth < via_common;
+
+    size_t start = common;
+    if (from_checkpoint) {
+        buffer.restore(*node(checkpoint).checkpoint);
+        start = checkpoint;
+        if (index != root) {
+            cursor_x = node(index).cmd.cursor_x_after;
+            cursor_y = node(index).cmd.cursor_y_after;
+        }
+    } else {
+        for (size_t at = current; at != common; at = node(at).parent) {
+            EditCommand& cmd = node(at).cmd;
+            if (!apply(buffer, cmd, true)) {
+                clear();
+                return false;
+            }
+            cursor_x = cmd.cursor_x_before;
+            cursor_y = cmd.cursor_y_before;
+        }
+    }
 
-    cursor_x = cmd.cursor_x_after;
-    cursor_y = cmd.cursor_y_after;
+    // Down to the target - redo follows this branch from now on
+    std::vector<size_t> path;
+    for (size_t at = index; at != start; at = node(at).parent) path.push_back(at);
+    for (auto at = path.rbegin(); at != path.rend(); ++at) {
+        Node& n = node(*at);
+        if (!apply(buffer, n.cmd, false)) {
+            clear();
+            return false;
+        }
+        node(n.parent).redo_child = *at;
+        cursor_x = n.cmd.cursor_x_after;
+        cursor_y = n.cmd.cursor_y_after;
+    }
 
-    undo_stack.push_back(std::move(cmd));
+    current = index;
     return true;
 }
+
+size_t UndoRedoManager::node_at(Clock::time_point time) const {
+    for (size_t i = newest_index(); i > root; i--) {
+        const Node& n = node(i);
+        if (n.alive && n.time <= time) return i;
+    }
+    return root;
+}
+
+// ===== Saved history =====
+// Written when the editor closes, restored when the same file is opened again.
+
+bool UndoRedoManager::save_history(TextBuffer& buffer, const std::string& filename, int cursor_x, int cursor_y) {
+    if (has_pending) {
+        commit_pending(buffer, cursor_x, cursor_y);
+    }
+
+    UndoHistoryFile::Key key;
+    if (!UndoHistoryFile::stat_key(filename, key)) return false;
+
+    // The way to the current state and on along the redo branch
+    std::vector<const Node*> undo_path, redo_path;
+    for (size_t at = current; at != root; at = node(at).parent) undo_path.push_back(&node(at));
+    std::reverse(undo_path.begin(), undo_path.end());
+    for (size_t at = node(current).redo_child; at != NO_NODE; at = node(at).redo_child) {
+        redo_path.push_back(&node(at));
+    }
+
+    if (undo_path.empty() && redo_path.empty()) {
+        std::error_code error;
+        std::filesystem::remove(UndoHistoryFile::location(key.path), error);
+        return true;
+    }
+
+    // Restored entries are carried over from session to session - the oldest
+    // ones go once the file would outgrow the spill file's budget
+    auto size_of = [](const Node* n) -> size_t {
+        if (!n->cmd.restored.empty()) return n->cmd.restored.size();
+        if (n->cmd.compressed) {
+            return n->cmd.bytes + LzCodec::decompressed_size(n->cmd.compressed->old_text) +
+                   LzCodec::decompressed_size(n->cmd.compressed->new_text);
+        }
+        return n->cmd.spilled ? n->cmd.spilled->size : n->cmd.bytes;
+    };
+    size_t total = 0;
+    for (const Node* n : undo_path) total += size_of(n);
+    for (const Node* n : redo_path) total += size_of(n);
+    size_t first = 0;
+    while (first < undo_path.size() && total > memory_budget * SPILL_BUDGET_FACTOR) {
+        total -= size_of(undo_path[first++]);
+    }
+
+    key.content_hash = buffer.content_hash();
+    UndoHistoryFile::Writer writer;
+    if (!writer.begin(key)) return false;
+
+    auto write = [&](const Node* n) {
+        const EditCommand& cmd = n->cmd;
+        UndoHistoryFile::Entry entry;
+        entry.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(n->time.time_since_epoch()).count();
+        entry.start_line = cmd.start_line;
+        entry.cursor_x_before = cmd.cursor_x_before;
+        entry.cursor_y_before = cmd.cursor_y_before;
+        entry.cursor_x_after = cmd.cursor_x_after;
+        entry.cursor_y_after = cmd.cursor_y_after;
+        if (!cmd.restored.empty()) {
+            entry.lines = cmd.restored;
+            return writer.add(entry);
+        }
+
+        std::vector<std::string> old_read, new_read;
+        if (cmd.spilled) {
+            if (!spill_file.read(*cmd.spilled, old_read, new_read)) return false;
+            return writer.add(entry, std::vector<std::string_view>(old_read.begin(), old_read.end()),
+                              std::vector<std::string_view>(new_read.begin(), new_read.end()));
+        }
+        std::string old_store, new_store;
+        std::vector<std::string_view> old_text, new_text;
+        return line_texts(buffer, cmd, old_store, new_store, old_text, new_text) &&
+               writer.add(entry, old_text, new_text);
+    };
+
+    for (size_t i = first; i < undo_path.size(); i++) {
+        if (!write(undo_path[i])) return false;
+    }
+    for (const Node* n : redo_path) {
+        if (!write(n)) return false;
+    }
+    return writer.finish(undo_path.size() - first);
+}
+
+bool UndoRedoManager::open_history(const std::string& filename) {
+    history_file.close();
+    history_restored = false;
+    UndoHistoryFile::Key key;
+    return UndoHistoryFile::stat_key(filename, key) && history_file.open(key);
+}
+
+size_t UndoRedoManager::restore_history(TextBuffer& buffer) {
+    if (!history_pending()) return 0;
+
+    // The contents are compared only now - size and time alone can match a
+    // file that was rewritten meanwhile. A paged file is too large to hash.
+    if (has_pending || nodes.size() > 1 || buffer.is_paged() || !history_file.matches(buffer.content_hash())) {
+        history_file.close();
+        return 0;
+    }
+
+    // One branch: the undo entries lead to the current state, the redo ones on from it
+    const std::vector<UndoHistoryFile::Entry>& entries = history_file.entries();
+    const size_t undo_count = history_file.undo_count();
+    nodes.front().time = Clock::time_point{};
+    for (size_t i = 0; i < entries.size(); i++) {
+        Node child;
+        child.cmd.start_line = entries[i].start_line;
+        child.cmd.cursor_x_before = entries[i].cursor_x_before;
+        child.cmd.cursor_y_before = entries[i].cursor_y_before;
+        child.cmd.cursor_x_after = entries[i].cursor_x_after;
+        child.cmd.cursor_y_after = entries[i].cursor_y_after;
+        child.cmd.restored = entries[i].lines;
+        child.parent = newest_index();
+        child.depth = nodes.back().depth + 1;
+        child.time = Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::nanoseconds(entries[i].time_ns)));
+        nodes.back().redo_child = child.parent + 1;
+        nodes.back().children.push_back(child.parent + 1);
+        nodes.push_back(std::move(child));
+    }
+    current = root + undo_count;
+    // The states of the others are not at hand
+    node(current).checkpoint = buffer.snapshot();
+    // Already on disk, the budget never spills them
+    spilled_until = newest_index() + 1;
+    history_restored = true;
+    return undo_count;
+}
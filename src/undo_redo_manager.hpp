@@ -1,6 +1,15 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <deque>
+#include <optional>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <text_buffer.hpp>
+#include <compress_job.hpp>
+#include <undo_spill_file.hpp>
+#include <undo_history_file.hpp>
 
 /// @brief Manages undo/redo history using the Command pattern.
 ///
@@ -8,69 +17,271 @@
 /// only the lines that changed (a diff). Memory usage goes from
 /// O(history_depth * buffer_size) to O(buffer_size + sum_of_diffs).
 ///
-/// The public API (save_state, undo, redo) is unchanged from the old
-/// snapshot-based approach, so callers don't need any modifications.
+/// The "before" state of a pending edit is a TextBuffer snapshot, which shares
+/// its tree with the live buffer. The buffer reports the line range its edits
+/// touched (TextBuffer::take_changed_range()), only that range is compared and
+/// stored when the edit is committed. Commands hold TextBuffer::LineRef handles
+/// rather than copies of the lines, the text itself is stored once by the
+/// buffer no matter how many history entries refer to it.
+///
+/// The history is a tree: every state of the document is a node, its command
+/// leads there from its parent. An edit after undoing starts a new branch, the
+/// old one stays and can be reached with jump_to(). Redo follows the branch
+/// last created or undone from. Every CHECKPOINT_INTERVAL levels a node keeps
+/// a snapshot of its state (O(1), it shares the tree with the buffer), so a
+/// jump restores the nearest checkpoint above the target and replays fewer
+/// than CHECKPOINT_INTERVAL commands - unless going through the common
+/// ancestor with the current state is shorter.
+///
+/// History is bounded by a memory budget rather than a number of entries.
+/// Past the budget the oldest entries are spilled: their text goes to an
+/// UndoSpillFile and is read back when they are applied. An entry larger than
+/// a quarter of the budget is spilled right away. The spill file is bounded
+/// too (SPILL_BUDGET_FACTOR times the budget), past that the oldest edits are
+/// dropped: the branches that don't lead to the current state, or the root
+/// moves down towards it.
+///
+/// Cold entries - COMPRESS_DISTANCE or more behind the newest, with at least
+/// COMPRESS_MIN_BYTES of edited text - are compressed in the background
+/// (LzCodec on a CompressJob, one at a time), and let go of their text - the
+/// next add-buffer compaction frees what the document or another entry doesn't
+/// hold. Applying one decompresses its text into the add buffer in one block,
+/// once per side.
+///
+/// The history can be kept across sessions in an UndoHistoryFile (the path
+/// to the current state and the redo branch, not the other branches).
+/// Restored entries point into its mapping and are parsed only when they are
+/// applied, so restoring costs O(entries) however much text they hold.
 class UndoRedoManager {
 public:
+    using Clock = std::chrono::system_clock;
+    static constexpr size_t NO_NODE = static_cast<size_t>(-1);
+
+    /// @brief An entry's lines, the text of edited ones '\n'-terminated and compressed (LzCodec)
+    /// The lines are runs, of file lines (Source::ORIGINAL) or of lines of the
+    /// text (Source::ADD, numbered from its first line) - a paste is one run.
+    struct Compressed {
+        std::vector<TextBuffer::Piece> old_pieces, new_pieces;
+        std::string old_text, new_text;
+        std::vector<TextBuffer::Piece> released;  // Add-buffer lines let go of, until the next compaction ...
+        size_t freed = 0;                         // ... which tells how much of them it freed
+    };
+
+    /// @brief Compression of cold entries, for diagnostics
+    struct CompressionStats {
+        size_t entries = 0;                  // Entries compressed now ...
+        size_t raw_bytes = 0;                // ... their edited text ...
+        size_t compressed_bytes = 0;         // ... what it was compressed to ...
+        size_t freed_bytes = 0;              // ... and what compaction freed of the lines they let go of -
+                                             // text the document or another entry holds stays
+        size_t decompressions = 0;           // Sides of entries decompressed so far
+        size_t last_decompressed_bytes = 0;
+        std::chrono::microseconds last_decompress{0}, max_decompress{0};
+    };
+
+    /// @brief Where apply() put the text of an entry back in the add buffer (spilled, restored or compressed entries)
+    /// Applying the entry again takes the same lines, until the add buffer is compacted.
+    struct Stored {
+        std::optional<size_t> old_first, new_first;  // First line of each side stored so far
+        size_t old_count = 0, new_count = 0;         // Lines of each side, known once one is stored (not compressed)
+    };
+
     /// @brief Represents a single edit as a diff of the affected line range.
     ///
     /// To undo: replace new_lines with old_lines at start_line.
     /// To redo: replace old_lines with new_lines at start_line.
     struct EditCommand {
         int start_line;                      // First line in the affected range
-        std::vector<std::string> old_lines;  // Lines *before* the edit
-        std::vector<std::string> new_lines;  // Lines *after*  the edit
+        std::vector<TextBuffer::LineRef> old_lines;  // Lines *before* the edit
+        std::vector<TextBuffer::LineRef> new_lines;  // Lines *after*  the edit
         int cursor_x_before, cursor_y_before;
         int cursor_x_after,  cursor_y_after;
+        size_t bytes = 0;                    // Memory the entry keeps in use (0 once spilled)
+        std::optional<UndoSpillFile::Record> spilled;  // Set when the lines are in the spill file instead ...
+        std::string_view restored;           // ... or in the history file (a record in its mapping)
+        std::unique_ptr<Compressed> compressed;  // ... or compressed in memory, in place of the handles
+        Stored stored;                       // Text read back or decompressed by apply()
     };
 
     UndoRedoManager();
 
+    /// @brief Memory the history may keep in use before entries are spilled to disk
+    void set_memory_budget(size_t bytes);
+
+    /// @brief Called from a worker thread when a background compression is done,
+    /// the owner then calls poll_compression() on its own thread
+    /// Setting it cancels a running compression (it is started again later).
+    void set_compression_listener(std::function<void()> listener);
+    /// @brief Take over a finished compression and start the next one
+    void poll_compression(const TextBuffer& buffer);
+
     /// @brief Call before an edit begins. Captures a "before" snapshot.
     ///
     /// If a previous edit was still pending (not yet committed), this
-    /// commits it first by diffing the pending snapshot against the
-    /// current buffer, then stores that diff as an EditCommand.
+    /// commits it first: the range of lines the buffer reports as changed
+    /// is stored as a new node below the current one.
+    /// @param may_compact The buffer's add buffer may be compacted (no
+    ///                    text_blocks() may be in use, e.g. by a running save)
     void save_state(
-        const std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int cursor_x,
-        int cursor_y
+        int cursor_y,
+        bool may_compact = true
     );
 
     /// @brief Undo the most recent edit.
+    /// @return False if there was nothing to undo, or a spilled entry couldn't
+    ///         be read back (the history is dropped then)
     bool undo(
-        std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y
     );
 
     /// @brief Redo the most recently undone edit.
     bool redo(
-        std::vector<std::string>& buffer,
+        TextBuffer& buffer,
         int& cursor_x,
         int& cursor_y
     );
 
-    bool can_undo() const { return has_pending || !undo_stack.empty(); }
-    bool can_redo() const { return !redo_stack.empty(); }
+    /// @brief Go to the state of node `index`, on any branch
+    /// @return False if there is no such node, or an entry couldn't be read
+    ///         back (the history is dropped then)
+    bool jump_to(
+        TextBuffer& buffer,
+        size_t index,
+        int& cursor_x,
+        int& cursor_y
+    );
+
+    /// @brief Newest node made at or before `time` (the root if none is)
+    size_t node_at(Clock::time_point time) const;
+
+    /// @brief Drop all history, e.g. after the buffer was reloaded from disk.
+    void clear();
+
+    /// @brief Write the history for `filename`, whose contents on disk must be what `buffer` holds
+    /// An empty history removes the file's saved one.
+    /// @return False if it couldn't be written
+    bool save_history(TextBuffer& buffer, const std::string& filename, int cursor_x, int cursor_y);
+    /// @brief Map the saved history of `filename`, if it was saved for the file as it is now
+    /// Cheap, the contents are compared by restore_history() once the whole buffer is there.
+    bool open_history(const std::string& filename);
+    bool history_pending() const { return history_file.is_open() && !history_restored; }
+    /// @brief Take over the opened history if it belongs to the buffer's contents
+    /// Must be called before any edit. A history that doesn't belong is closed.
+    /// @return Number of undo entries restored
+    size_t restore_history(TextBuffer& buffer);
+
+    bool can_undo() const { return has_pending || current != root; }
+    // A pending edit starts a new branch, there is nothing to redo past it
+    bool can_redo() const { return !has_pending && node(current).redo_child != NO_NODE; }
+
+    /// @brief Node numbers: of the current state, the root and the newest node
+    size_t current_index() const { return current; }
+    size_t root_index() const { return root; }
+    size_t newest_index() const { return first_index + nodes.size() - 1; }
+    bool has_node(size_t index) const { return index >= first_index && index <= newest_index() && node(index).alive; }
+
+    /// @brief Memory the history keeps in use / bytes spilled to disk, for diagnostics
+    size_t memory_bytes() const { return memory_bytes_; }
+    size_t spilled_bytes() const { return spill_file.bytes(); }
+    /// @brief Checkpoints kept, and the memory they keep in use beyond the document (O(tree nodes))
+    size_t checkpoint_count() const;
+    size_t checkpoint_bytes(const TextBuffer& buffer) const;
+    const CompressionStats& compression_stats() const { return compression; }
 
 private:
-    /// @brief Diff pending_buffer vs current buffer, push result to undo_stack.
+    /// @brief One state of the document
+    struct Node {
+        EditCommand cmd{};                   // From the parent's state to this one, unused at the root
+        size_t parent = NO_NODE;
+        size_t redo_child = NO_NODE;         // Where redo goes: the child last created or undone from
+        std::vector<size_t> children;        // Live ones, oldest first
+        size_t depth = 0;                    // Edits since the first root
+        Clock::time_point time;              // When the edit was made
+        std::optional<TextBuffer::Snapshot> checkpoint;  // The whole state, at every CHECKPOINT_INTERVAL-th depth
+        bool alive = true;                   // False once dropped, until it leaves the front of `nodes`
+    };
+
+    Node& node(size_t index) { return nodes[index - first_index]; }
+    const Node& node(size_t index) const { return nodes[index - first_index]; }
+
+    /// @brief Store the changed range (pending_snapshot vs current buffer) as a child of the current node.
     void commit_pending(
-        const std::vector<std::string>& current_buffer,
+        TextBuffer& current_buffer,
         int cursor_x,
         int cursor_y
     );
 
+    /// @brief Spill and drop entries until the history fits its budgets again
+    void enforce_budget(const TextBuffer& buffer);
+    /// @brief Move an entry's lines to the spill file, false if that failed
+    bool spill(const TextBuffer& buffer, EditCommand& cmd);
+    /// @brief Drop the oldest edit with the states that are only reachable through it
+    /// @return False if there is no edit left
+    bool drop_oldest();
+    /// @brief Take a node out of the tree
+    void kill(Node& dead);
+    /// @brief Account for an entry leaving the history
+    void release(EditCommand& cmd);
+    /// @brief Put the lines from before (undoing) or after `cmd` in place, reading them back if spilled
+    bool apply(TextBuffer& buffer, EditCommand& cmd, bool undoing);
+    /// @brief Text of an entry's lines, decompressed into `old_store` / `new_store` if compressed
+    bool line_texts(const TextBuffer& buffer, const EditCommand& cmd, std::string& old_store,
+                    std::string& new_store, std::vector<std::string_view>& old_text,
+                    std::vector<std::string_view>& new_text) const;
+    /// @brief Text only in memory, and enough of it to be worth compressing
+    static bool compressible(const EditCommand& cmd);
+    /// @brief Start compressing the oldest cold entry not compressed yet, unless a job is running
+    void start_compression(const TextBuffer& buffer);
+    /// @brief Stop a running compression, its entry is picked again later
+    void cancel_compression();
+    /// @brief Runs of `lines` for a Compressed entry
+    static std::vector<TextBuffer::Piece> pieces_of(const std::vector<TextBuffer::LineRef>& lines);
+    static size_t line_count(const std::vector<TextBuffer::Piece>& pieces);
+    /// @brief Let go of an entry's compressed text
+    void drop_compressed(EditCommand& cmd);
+    /// @brief Start over with a single root node, for the buffer's current state
+    void reset_tree();
+
     // --- Pending edit tracking ---
     bool has_pending = false;
-    std::vector<std::string> pending_buffer;  // Temporary "before" snapshot
+    TextBuffer::Snapshot pending_snapshot;    // Temporary "before" snapshot
     int pending_cx = 0;
     int pending_cy = 0;
 
-    // --- Command stacks ---
-    std::vector<EditCommand> undo_stack;
-    std::vector<EditCommand> redo_stack;
+    // --- Tree ---
+    // Nodes in the order they were made, a parent before its children. Node
+    // `first_index + i` is nodes[i]: numbers stay the same while old nodes
+    // leave the front.
+    std::deque<Node> nodes;
+    size_t first_index = 0;
+    size_t root = 0;
+    size_t current = 0;
+    size_t oldest_edit = 1;                   // No live node other than the root before this one
+    size_t spilled_until = 1;                 // Nodes before this one are spilled (or dead)
+    static constexpr size_t CHECKPOINT_INTERVAL = 32;
+
+    // --- Budget ---
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+    static constexpr size_t SPILL_BUDGET_FACTOR = 8;
+    size_t memory_budget = DEFAULT_MEMORY_BUDGET;
+    size_t memory_bytes_ = 0;                 // Sum of the entries' bytes
+    size_t released_bytes = 0;                // Text let go of since the add buffer was last compacted
+    UndoSpillFile spill_file;
+
+    // --- Compression ---
+    static constexpr size_t COMPRESS_DISTANCE = 16;
+    static constexpr size_t COMPRESS_MIN_BYTES = 64 * 1024;
+    std::unique_ptr<CompressJob> compress_job;
+    size_t compressing = NO_NODE;             // Node the job is for
+    size_t compressed_until = 1;              // Nodes before this one were looked at
+    std::function<void()> compress_listener;
+    CompressionStats compression;
 
-    static constexpr size_t max_history = 255;
+    // --- Saved history ---
+    UndoHistoryFile history_file;             // Mapped while restored entries point into it
+    bool history_restored = false;
 };
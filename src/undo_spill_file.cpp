@@ -0,0 +1,118 @@
+#include <undo_spill_file.hpp>
+#include <batch_writer.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+UndoSpillFile::~UndoSpillFile() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool UndoSpillFile::open() {
+    if (fd_ >= 0) return true;
+
+    const char* directory = std::getenv("TMPDIR");
+    if (directory == nullptr || *directory == '\0') directory = "/tmp";
+
+    // Never linked into the directory where the file system supports it ...
+    fd_ = ::open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd_ >= 0) return true;
+
+    // ... otherwise removed right after it is created
+    std::string path = std::string(directory) + "/bznota_undo_XXXXXX";
+    fd_ = mkostemp(path.data(), O_CLOEXEC);
+    if (fd_ < 0) return false;
+    unlink(path.c_str());
+    return true;
+}
+
+bool UndoSpillFile::add_record(BatchWriter& writer, const std::vector<std::string_view>& old_lines,
+                               const std::vector<std::string_view>& new_lines) {
+    // Lengths are staged by the writer (they are short), so a local is fine
+    auto add_number = [&writer](uint64_t value) {
+        return writer.add(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+    };
+    if (!add_number(old_lines.size()) || !add_number(new_lines.size())) return false;
+    for (const auto* lines : {&old_lines, &new_lines}) {
+        for (std::string_view line : *lines) {
+            if (!add_number(line.size()) || !writer.add(line)) return false;
+        }
+    }
+    return true;
+}
+
+bool UndoSpillFile::parse_record(std::string_view data, std::vector<std::string>& old_lines,
+                                 std::vector<std::string>& new_lines) {
+    // Every read is checked against the record size, a damaged file only fails the parse
+    size_t at = 0;
+    auto take_number = [&](uint64_t& value) {
+        if (data.size() - at < sizeof(value)) return false;
+        std::memcpy(&value, data.data() + at, sizeof(value));
+        at += sizeof(value);
+        return true;
+    };
+    uint64_t counts[2];
+    if (!take_number(counts[0]) || !take_number(counts[1])) return false;
+
+    std::vector<std::string>* lists[2] = {&old_lines, &new_lines};
+    for (int list = 0; list < 2; list++) {
+        lists[list]->clear();
+        for (uint64_t i = 0; i < counts[list]; i++) {
+            uint64_t length;
+            if (!take_number(length) || data.size() - at < length) return false;
+            lists[list]->emplace_back(data.substr(at, length));
+            at += length;
+        }
+    }
+    return true;
+}
+
+bool UndoSpillFile::write(const std::vector<std::string_view>& old_lines, const std::vector<std::string_view>& new_lines,
+                          Record& record) {
+    if (!open()) return false;
+
+    BatchWriter writer(fd_);
+    const bool ok = lseek(fd_, static_cast<off_t>(end_), SEEK_SET) >= 0 &&
+                    add_record(writer, old_lines, new_lines) && writer.flush();
+    if (!ok) {
+        // Whatever made it out is dropped again
+        [[maybe_unused]] int result = ftruncate(fd_, static_cast<off_t>(end_));
+        return false;
+    }
+
+    record.offset = end_;
+    record.size = writer.bytes_written();
+    end_ += record.size;
+    live_bytes_ += record.size;
+    return true;
+}
+
+bool UndoSpillFile::read(const Record& record, std::vector<std::string>& old_lines,
+                         std::vector<std::string>& new_lines) const {
+    std::string data(record.size, '\0');
+    size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t length = pread(fd_, data.data() + done, data.size() - done, static_cast<off_t>(record.offset + done));
+        if (length < 0 && errno == EINTR) continue;
+        if (length <= 0) return false;
+        done += static_cast<size_t>(length);
+    }
+    return parse_record(data, old_lines, new_lines);
+}
+
+void UndoSpillFile::release(const Record& record) {
+    if (fd_ < 0 || record.size == 0) return;
+    live_bytes_ -= record.size;
+
+    if (live_bytes_ == 0) {
+        // Nothing left, start over at the beginning
+        [[maybe_unused]] int result = ftruncate(fd_, 0);
+        end_ = 0;
+        return;
+    }
+    // Best effort, the space comes back at the latest when the file is truncated
+    fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(record.offset),
+              static_cast<off_t>(record.size));
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class BatchWriter;
+
+/// @brief Temp file holding the text of undo history entries that were moved out of memory
+///
+/// The file is created unlinked in $TMPDIR on first use, so it goes away with
+/// the editor, crash or not. Records are appended and read back whole. A
+/// released record's disk space is given back (hole punching), the file is
+/// truncated once no record is left.
+///
+/// Record layout: old line count, new line count, then per line its length
+/// and bytes - the counts and lengths as 64-bit native integers.
+class UndoSpillFile {
+public:
+    struct Record {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    UndoSpillFile() = default;
+    ~UndoSpillFile();
+
+    UndoSpillFile(const UndoSpillFile&) = delete;
+    UndoSpillFile& operator=(const UndoSpillFile&) = delete;
+
+    /// @brief Append one entry's lines as a record
+    /// @return False if the file can't be created or written, nothing is stored then
+    bool write(const std::vector<std::string_view>& old_lines, const std::vector<std::string_view>& new_lines,
+               Record& record);
+
+    /// @brief Read back the lines of a record
+    bool read(const Record& record, std::vector<std::string>& old_lines, std::vector<std::string>& new_lines) const;
+
+    /// @brief The record is not needed anymore
+    void release(const Record& record);
+
+    /// @brief Bytes of records not released yet
+    uint64_t bytes() const { return live_bytes_; }
+
+    /// @brief Queue one record's bytes (also the layout of UndoHistoryFile entries)
+    static bool add_record(BatchWriter& writer, const std::vector<std::string_view>& old_lines,
+                           const std::vector<std::string_view>& new_lines);
+    /// @brief Split a record back into its lines, false if it is damaged
+    static bool parse_record(std::string_view data, std::vector<std::string>& old_lines, std::vector<std::string>& new_lines);
+
+private:
+    bool open();
+
+    int fd_ = -1;
+    uint64_t end_ = 0;          // Where the next record goes
+    uint64_t live_bytes_ = 0;
+};
@@ -4,11 +4,14 @@
 namespace UTF8Utils {
 
 // Get the number of bytes in a UTF-8 character starting at the given position
-int get_char_length(const std::string& str, size_t pos) {
+int get_char_length(std::string_view str, size_t pos) {
     if (pos >= str.length()) return 0;
 
-    unsigned char c = static_cast<unsigned char>(str[pos]);
+    return get_char_length(static_cast<unsigned char>(str[pos]));
+}
 
+// Get the number of bytes in a UTF-8 character from its first byte
+int get_char_length(unsigned char c) {
     // Single-byte character (ASCII): 0xxxxxxx
     if ((c & 0x80) == 0) return 1;
 
@@ -26,7 +29,7 @@ int get_char_length(const std::string& str, size_t pos) {
 }
 
 // Get the number of UTF-8 characters (codepoints) in a string
-size_t char_count(const std::string& str) {
+size_t char_count(std::string_view str) {
     size_t count = 0;
     size_t pos = 0;
 
@@ -40,7 +43,7 @@ size_t char_count(const std::string& str) {
 }
 
 // Get byte position from character position
-size_t char_to_byte_pos(const std::string& str, size_t char_pos) {
+size_t char_to_byte_pos(std::string_view str, size_t char_pos) {
     size_t byte_pos = 0;
     size_t current_char = 0;
 
@@ -54,7 +57,7 @@ size_t char_to_byte_pos(const std::string& str, size_t char_pos) {
 }
 
 // Get character position from byte position
-size_t byte_to_char_pos(const std::string& str, size_t byte_pos) {
+size_t byte_to_char_pos(std::string_view str, size_t byte_pos) {
     size_t char_pos = 0;
     size_t current_byte = 0;
 
@@ -74,7 +77,7 @@ bool is_char_start(unsigned char byte) {
 }
 
 // Move to the next character boundary
-size_t next_char_boundary(const std::string& str, size_t pos) {
+size_t next_char_boundary(std::string_view str, size_t pos) {
     if (pos >= str.length()) return pos;
 
     int len = get_char_length(str, pos);
@@ -82,7 +85,7 @@ size_t next_char_boundary(const std::string& str, size_t pos) {
 }
 
 // Move to the previous character boundary
-size_t prev_char_boundary(const std::string& str, size_t pos) {
+size_t prev_char_boundary(std::string_view str, size_t pos) {
     if (pos == 0) return 0;
 
     size_t new_pos = pos - 1;